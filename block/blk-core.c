@@ -39,6 +39,8 @@ EXPORT_TRACEPOINT_SYMBOL_GPL(block_rq_remap);
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_bio_complete);
 
 static int __make_request(struct request_queue *q, struct bio *bio);
+static void queue_unplugged(struct request_queue *q, unsigned int depth,
+			    bool from_schedule);
 
 /*
  * For the allocated request tables
@@ -55,6 +57,28 @@ struct kmem_cache *blk_requestq_cachep;
  */
 static struct workqueue_struct *kblockd_workqueue;
 
+/*
+ * Per-cpu staging
+ *
+ * Without a plug, every request takes the queue lock twice: once
+ * to look for a merge and allocate the request, and once to insert it.
+ * A queue that opted in with blk_queue_init_staging() instead collects
+ * new requests on a list of the submitting cpu, merges bios into them
+ * under a per-cpu lock, and hands the list to the elevator under a
+ * single queue lock hold - like an implicit plug shared by all tasks on
+ * that cpu. While the device has nothing in flight the list is flushed
+ * right away, so staging only delays requests that would have had to
+ * wait behind others anyway. Otherwise it is flushed once it holds
+ * BLK_MAX_REQUEST_COUNT requests, or by kblockd.
+ */
+struct blk_staging {
+	spinlock_t		lock;
+	struct list_head	list;
+	unsigned int		count;
+	struct request_queue	*q;
+	struct work_struct	work;
+};
+
 static void drive_stat_acct(struct request *rq, int new_io)
 {
 	struct hd_struct *part;
@@ -284,6 +308,13 @@ EXPORT_SYMBOL(blk_stop_queue);
  */
 void blk_sync_queue(struct request_queue *q)
 {
+	int cpu;
+
+	/* staged requests are handed to the elevator, not dropped */
+	if (q->staging)
+		for_each_possible_cpu(cpu)
+			flush_work_sync(&per_cpu_ptr(q->staging, cpu)->work);
+
 	del_timer_sync(&q->timeout);
 	cancel_delayed_work_sync(&q->delay_work);
 }
@@ -1192,6 +1223,138 @@ out:
 	return ret;
 }
 
+static void blk_flush_staging(struct blk_staging *st)
+{
+	struct request_queue *q = st->q;
+	unsigned int depth = 0;
+	unsigned long flags;
+	struct request *rq;
+	LIST_HEAD(list);
+
+	spin_lock_irqsave(&st->lock, flags);
+	list_splice_init(&st->list, &list);
+	st->count = 0;
+	spin_unlock(&st->lock);
+
+	if (list_empty(&list)) {
+		local_irq_restore(flags);
+		return;
+	}
+
+	spin_lock(q->queue_lock);
+	while (!list_empty(&list)) {
+		rq = list_entry_rq(list.next);
+		list_del_init(&rq->queuelist);
+		/*
+		 * rq is already accounted, so use raw insert
+		 */
+		__elv_add_request(q, rq, ELEVATOR_INSERT_SORT_MERGE);
+		depth++;
+	}
+
+	/*
+	 * This drops the queue lock
+	 */
+	queue_unplugged(q, depth, false);
+	local_irq_restore(flags);
+}
+
+static void blk_staging_work(struct work_struct *work)
+{
+	blk_flush_staging(container_of(work, struct blk_staging, work));
+}
+
+static void blk_stage_request(struct request_queue *q, struct request *req)
+{
+	struct blk_staging *st = per_cpu_ptr(q->staging, raw_smp_processor_id());
+	bool flush;
+
+	drive_stat_acct(req, 1);
+
+	spin_lock_irq(&st->lock);
+	list_add_tail(&req->queuelist, &st->list);
+	flush = ++st->count >= BLK_MAX_REQUEST_COUNT || !queue_in_flight(q);
+	spin_unlock_irq(&st->lock);
+
+	if (flush)
+		blk_flush_staging(st);
+	else
+		kblockd_schedule_work(q, &st->work);
+}
+
+/*
+ * Attempts to merge with the requests staged on this cpu. Returns true
+ * if merge was successful, otherwise false.
+ */
+static bool attempt_staging_merge(struct request_queue *q, struct bio *bio)
+{
+	struct blk_staging *st;
+	struct request *rq;
+	bool ret = false;
+
+	if (!q->staging)
+		return false;
+
+	st = per_cpu_ptr(q->staging, raw_smp_processor_id());
+	spin_lock_irq(&st->lock);
+	list_for_each_entry_reverse(rq, &st->list, queuelist) {
+		int el_ret;
+
+		el_ret = elv_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE) {
+			ret = bio_attempt_back_merge(q, rq, bio);
+			if (ret)
+				break;
+		} else if (el_ret == ELEVATOR_FRONT_MERGE) {
+			ret = bio_attempt_front_merge(q, rq, bio);
+			if (ret)
+				break;
+		}
+	}
+	spin_unlock_irq(&st->lock);
+	return ret;
+}
+
+/**
+ * blk_queue_init_staging - stage requests per cpu before the elevator
+ * @q:  the request queue for the device
+ *
+ * Description:
+ *    Lets requests submitted outside a plug collect and merge on a
+ *    per-cpu list before they are inserted into the elevator in batches,
+ *    which takes the queue lock once per batch instead of once per
+ *    request. Only queues that use the standard request based
+ *    make_request_fn, i.e. that were set up with blk_init_queue(), can
+ *    opt in. Must be called before any I/O is submitted to the queue.
+ **/
+int blk_queue_init_staging(struct request_queue *q)
+{
+	struct blk_staging __percpu *staging;
+	int cpu;
+
+	if (q->make_request_fn != __make_request)
+		return -EINVAL;
+	if (q->staging)
+		return 0;
+
+	staging = alloc_percpu(struct blk_staging);
+	if (!staging)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_staging *st = per_cpu_ptr(staging, cpu);
+
+		spin_lock_init(&st->lock);
+		INIT_LIST_HEAD(&st->list);
+		st->count = 0;
+		st->q = q;
+		INIT_WORK(&st->work, blk_staging_work);
+	}
+	q->staging = staging;
+	return 0;
+}
+EXPORT_SYMBOL(blk_queue_init_staging);
+
 void init_request_from_bio(struct request *req, struct bio *bio)
 {
 	req->cpu = bio->bi_comp_cpu;
@@ -1234,6 +1397,8 @@ static int __make_request(struct request_queue *q, struct bio *bio)
 	 */
 	if (attempt_plug_merge(current, q, bio, &request_count))
 		goto out;
+	if (attempt_staging_merge(q, bio))
+		goto out;
 
 	spin_lock_irq(q->queue_lock);
 
@@ -1301,6 +1466,8 @@ get_rq:
 			blk_flush_plug_list(plug, false);
 		list_add_tail(&req->queuelist, &plug->list);
 		drive_stat_acct(req, 1);
+	} else if (q->staging && where == ELEVATOR_INSERT_SORT) {
+		blk_stage_request(q, req);
 	} else {
 		spin_lock_irq(q->queue_lock);
 		add_acct_request(q, req, where);
@@ -484,6 +484,8 @@ static void blk_release_queue(struct kobject *kobj)
 
 	blk_throtl_exit(q);
 
+	free_percpu(q->staging);
+
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
 
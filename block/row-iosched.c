@@ -26,6 +26,7 @@
 #include <linux/compiler.h>
 #include <linux/blktrace_api.h>
 #include <linux/jiffies.h>
+#include <linux/sort.h>
 
 /*
  * enum row_queue_prio - Priorities of the ROW queues
@@ -69,10 +70,54 @@ static const int queue_quantum[] = {
 	1	/* ROWQ_PRIO_LOW_SWRITE */
 };
 
+/*
+ * Default deadlines for requests in each queue, in msec. A request that
+ * has waited longer than its queue's deadline preempts a lower priority
+ * queue the same way an unserved queue does. 0 means no deadline.
+ */
+static const int queue_deadline[] = {
+	50,	/* ROWQ_PRIO_HIGH_READ */
+	100,	/* ROWQ_PRIO_REG_READ */
+	0,	/* ROWQ_PRIO_HIGH_SWRITE */
+	0,	/* ROWQ_PRIO_REG_SWRITE */
+	0,	/* ROWQ_PRIO_REG_WRITE */
+	0,	/* ROWQ_PRIO_LOW_READ */
+	0	/* ROWQ_PRIO_LOW_SWRITE */
+};
+
 /* Default values for idling on read queues */
 #define ROW_IDLE_TIME_MSEC 5	/* msec */
 #define ROW_READ_FREQ_MSEC 20	/* msec */
 
+/*
+ * Completion latency feedback. The latency of foreground reads (the HIGH
+ * and REG read queues) is averaged and compared against the target every
+ * ROW_ADAPT_WINDOW read completions. When reads miss the target, write
+ * quanta fall back to their configured values and the read idle window
+ * is stretched; while reads stay well within it, write quanta are scaled
+ * up again so that writeback gets more of the device.
+ */
+#define ROW_TARGET_READ_LAT_MSEC	20	/* msec, 0 disables */
+#define ROW_ADAPT_WINDOW		16
+#define ROW_MAX_WRITE_SCALE		8
+#define ROW_MAX_IDLE_SCALE		4
+
+/* Number of most recent completion latencies kept per queue */
+#define ROW_LAT_SAMPLES			64
+
+/**
+ * struct row_lat_stats - completion latency samples of a queue
+ * @samples:		ring of the last completion latencies (usec)
+ * @next:		next slot to fill in @samples
+ * @nr:			number of valid entries in @samples
+ *
+ */
+struct row_lat_stats {
+	u32			samples[ROW_LAT_SAMPLES];
+	unsigned int		next;
+	unsigned int		nr;
+};
+
 /**
  * struct rowq_idling_data -  parameters for idling on the queue
  * @last_insert_time:	time the last request was inserted
@@ -94,6 +139,7 @@ struct rowq_idling_data {
  *			the current dispatch cycle
  * @slice:		number of requests to dispatch in a cycle
  * @idle_data:		data for idling on queues
+ * @lat:		completion latency samples
  *
  */
 struct row_queue {
@@ -106,6 +152,8 @@ struct row_queue {
 
 	/* used only for READ queues */
 	struct rowq_idling_data	idle_data;
+
+	struct row_lat_stats	lat;
 };
 
 /**
@@ -136,6 +184,11 @@ struct idling_data {
  *			scheduler, nr_reqs[1] holds the number of all WRITE
  *			requests in scheduler
  * @cycle_flags:	used for marking unserved queueus
+ * @target_read_lat:	target completion latency of foreground reads (msec)
+ * @read_lat_avg:	running average of foreground read latency (usec)
+ * @nr_read_completed:	foreground reads completed since the last adaption
+ * @write_scale:	factor applied to the write queues' quanta
+ * @idle_scale:		factor applied to the read idle window
  *
  */
 struct row_data {
@@ -144,6 +197,7 @@ struct row_data {
 	struct {
 		struct row_queue	rqueue;
 		int			disp_quantum;
+		unsigned long		deadline;
 	} row_queues[ROWQ_MAX_PRIO];
 
 	enum row_queue_prio		curr_queue;
@@ -152,9 +206,19 @@ struct row_data {
 	unsigned int			nr_reqs[2];
 
 	unsigned int			cycle_flags;
+
+	int				target_read_lat;
+	u32				read_lat_avg;
+	unsigned int			nr_read_completed;
+	unsigned int			write_scale;
+	unsigned int			idle_scale;
 };
 
 #define RQ_ROWQ(rq) ((struct row_queue *) ((rq)->elevator_private[0]))
+/* Insertion time in usec, truncated to 32 bits */
+#define RQ_INSERT_TIME(rq) ((u32)(unsigned long)((rq)->elevator_private[1]))
+#define RQ_SET_INSERT_TIME(rq, t) \
+	((rq)->elevator_private[1] = (void *)(unsigned long)(t))
 
 #define row_log(q, fmt, args...)   \
 	blk_add_trace_msg(q, "%s():" fmt , __func__, ##args)
@@ -180,6 +244,22 @@ static inline int row_rowq_unserved(struct row_data *rd,
 	return rd->cycle_flags & (1 << qnum);
 }
 
+static inline bool row_rowq_is_fg_read(enum row_queue_prio qnum)
+{
+	return qnum == ROWQ_PRIO_HIGH_READ || qnum == ROWQ_PRIO_REG_READ;
+}
+
+static inline bool row_rowq_is_write(enum row_queue_prio qnum)
+{
+	return qnum == ROWQ_PRIO_HIGH_SWRITE || qnum == ROWQ_PRIO_REG_SWRITE ||
+		qnum == ROWQ_PRIO_REG_WRITE || qnum == ROWQ_PRIO_LOW_SWRITE;
+}
+
+static inline u32 row_now_us(void)
+{
+	return (u32)ktime_to_us(ktime_get());
+}
+
 /******************** Static helper functions ***********************/
 /*
  * kick_queue() - Wake up device driver queue thread
@@ -237,6 +317,112 @@ static inline void row_get_next_queue(struct row_data *rd)
 		row_restart_disp_cycle(rd);
 }
 
+/*
+ * row_rowq_quantum() - Effective dispatch quantum of a queue
+ * @rd:		pointer to struct row_data
+ * @qnum:	queue index
+ *
+ * Write queues get their configured quantum scaled by the latency
+ * feedback; all other queues use the configured quantum as is.
+ */
+static inline int row_rowq_quantum(struct row_data *rd,
+				   enum row_queue_prio qnum)
+{
+	int quantum = rd->row_queues[qnum].disp_quantum;
+
+	if (row_rowq_is_write(qnum))
+		quantum *= rd->write_scale;
+	return quantum;
+}
+
+/*
+ * row_rowq_expired() - Check the head of a queue against its deadline
+ * @rd:		pointer to struct row_data
+ * @qnum:	queue index
+ *
+ */
+static inline bool row_rowq_expired(struct row_data *rd,
+				    enum row_queue_prio qnum)
+{
+	struct list_head *fifo = &rd->row_queues[qnum].rqueue.fifo;
+
+	if (!rd->row_queues[qnum].deadline || list_empty(fifo))
+		return false;
+	return time_after_eq(jiffies, rq_fifo_time(rq_entry_fifo(fifo->next)));
+}
+
+/*
+ * row_adapt() - Adjust write quanta and read idling to the target latency
+ * @rd:	pointer to struct row_data
+ *
+ * Multiplicative decrease of the write quanta on a miss, additive
+ * increase while reads complete in less than half the target.
+ */
+static void row_adapt(struct row_data *rd)
+{
+	u32 target = rd->target_read_lat * USEC_PER_MSEC;
+
+	if (!target) {
+		rd->write_scale = 1;
+		rd->idle_scale = 1;
+		return;
+	}
+
+	if (rd->read_lat_avg > target) {
+		rd->write_scale = 1;
+		if (rd->idle_scale < ROW_MAX_IDLE_SCALE)
+			rd->idle_scale <<= 1;
+	} else if (rd->read_lat_avg < target / 2) {
+		if (rd->write_scale < ROW_MAX_WRITE_SCALE)
+			rd->write_scale++;
+		if (rd->idle_scale > 1)
+			rd->idle_scale >>= 1;
+	}
+	row_log(rd->dispatch_queue, "read lat %uus write_scale %u idle_scale %u",
+		rd->read_lat_avg, rd->write_scale, rd->idle_scale);
+}
+
+static void row_lat_add(struct row_lat_stats *lat, u32 us)
+{
+	lat->samples[lat->next] = us;
+	lat->next = (lat->next + 1) % ROW_LAT_SAMPLES;
+	if (lat->nr < ROW_LAT_SAMPLES)
+		lat->nr++;
+}
+
+static int row_lat_cmp(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * row_lat_percentile() - Completion latency percentile of a queue (usec)
+ * @rd:		pointer to struct row_data
+ * @qnum:	queue index
+ * @pct:	percentile, 1..100
+ *
+ * Computed over the last ROW_LAT_SAMPLES completions of the queue.
+ */
+static int row_lat_percentile(struct row_data *rd, enum row_queue_prio qnum,
+			      unsigned int pct)
+{
+	struct row_lat_stats *lat = &rd->row_queues[qnum].rqueue.lat;
+	u32 samples[ROW_LAT_SAMPLES];
+	unsigned int nr;
+
+	spin_lock_irq(rd->dispatch_queue->queue_lock);
+	nr = lat->nr;
+	memcpy(samples, lat->samples, nr * sizeof(samples[0]));
+	spin_unlock_irq(rd->dispatch_queue->queue_lock);
+
+	if (!nr)
+		return 0;
+	sort(samples, nr, sizeof(samples[0]), row_lat_cmp, NULL);
+	return min_t(u32, samples[DIV_ROUND_UP(nr * pct, 100) - 1], INT_MAX);
+}
+
 /******************* Elevator callback functions *********************/
 
 /*
@@ -253,7 +439,8 @@ static void row_add_request(struct request_queue *q,
 
 	list_add_tail(&rq->queuelist, &rqueue->fifo);
 	rd->nr_reqs[rq_data_dir(rq)]++;
-	rq_set_fifo_time(rq, jiffies); /* for statistics*/
+	rq_set_fifo_time(rq, jiffies + rd->row_queues[rqueue->prio].deadline);
+	RQ_SET_INSERT_TIME(rq, row_now_us());
 
 	if (queue_idling_enabled[rqueue->prio]) {
 		if (delayed_work_pending(&rd->read_idle.idle_work))
@@ -360,10 +547,18 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 	currq = rd->curr_queue;
 
 	/*
-	 * Find the first unserved queue (with higher priority then currq)
-	 * that is not empty
+	 * Find the first queue with higher priority then currq that is
+	 * either unserved and not empty, or holds an expired request
 	 */
 	for (i = 0; i < currq; i++) {
+		if (row_rowq_expired(rd, i)) {
+			row_log_rowq(rd, currq,
+				" Preemting for expired rowq%d", i);
+			rd->curr_queue = i;
+			row_dispatch_insert(rd);
+			ret = 1;
+			goto done;
+		}
 		if (row_rowq_unserved(rd, i) &&
 		    !list_empty(&rd->row_queues[i].rqueue.fifo)) {
 			row_log_rowq(rd, currq,
@@ -376,7 +571,7 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 	}
 
 	if (rd->row_queues[currq].rqueue.nr_dispatched >=
-	    rd->row_queues[currq].disp_quantum) {
+	    row_rowq_quantum(rd, currq)) {
 		rd->row_queues[currq].rqueue.nr_dispatched = 0;
 		row_log_rowq(rd, currq, "Expiring rqueue");
 		ret = row_choose_queue(rd);
@@ -404,8 +599,8 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 		if (!force && queue_idling_enabled[currq] &&
 		    rd->row_queues[currq].rqueue.idle_data.begin_idling) {
 			if (!queue_delayed_work(rd->read_idle.idle_workqueue,
-						&rd->read_idle.idle_work,
-						rd->read_idle.idle_time)) {
+					&rd->read_idle.idle_work,
+					rd->read_idle.idle_time * rd->idle_scale)) {
 				row_log_rowq(rd, currq,
 					     "Work already on queue!");
 				pr_err("ROW_BUG: Work already on queue!");
@@ -451,6 +646,8 @@ static void *row_init_queue(struct request_queue *q)
 	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
 		INIT_LIST_HEAD(&rdata->row_queues[i].rqueue.fifo);
 		rdata->row_queues[i].disp_quantum = queue_quantum[i];
+		rdata->row_queues[i].deadline =
+			msecs_to_jiffies(queue_deadline[i]);
 		rdata->row_queues[i].rqueue.rdata = rdata;
 		rdata->row_queues[i].rqueue.prio = i;
 		rdata->row_queues[i].rqueue.idle_data.begin_idling = false;
@@ -479,6 +676,10 @@ static void *row_init_queue(struct request_queue *q)
 
 	rdata->nr_reqs[READ] = rdata->nr_reqs[WRITE] = 0;
 
+	rdata->target_read_lat = ROW_TARGET_READ_LAT_MSEC;
+	rdata->write_scale = 1;
+	rdata->idle_scale = 1;
+
 	return rdata;
 }
 
@@ -511,11 +712,56 @@ static void row_merged_requests(struct request_queue *q, struct request *rq,
 {
 	struct row_queue   *rqueue = RQ_ROWQ(next);
 
+	/*
+	 * If next expires before rq, assign its expire time to rq and move
+	 * into next position in the fifo. Only within one ROW queue: rq
+	 * must stay on the fifo of the queue RQ_ROWQ(rq) names. The earlier
+	 * insertion time is kept for latency accounting.
+	 */
+	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist) &&
+	    RQ_ROWQ(rq) == rqueue &&
+	    time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
+		list_move(&rq->queuelist, &next->queuelist);
+		rq_set_fifo_time(rq, rq_fifo_time(next));
+	}
+	if ((s32)(RQ_INSERT_TIME(next) - RQ_INSERT_TIME(rq)) < 0)
+		RQ_SET_INSERT_TIME(rq, RQ_INSERT_TIME(next));
+
 	list_del_init(&next->queuelist);
 
 	rqueue->rdata->nr_reqs[rq_data_dir(rq)]--;
 }
 
+/*
+ * row_completed_request() - Account completion latency of a request
+ * @q:		requests queue
+ * @rq:		completed request
+ *
+ * Called with the queue lock held.
+ */
+static void row_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = (struct row_data *)q->elevator->elevator_data;
+	struct row_queue *rqueue = RQ_ROWQ(rq);
+	u32 lat = row_now_us() - RQ_INSERT_TIME(rq);
+
+	row_lat_add(&rqueue->lat, lat);
+
+	if (!row_rowq_is_fg_read(rqueue->prio))
+		return;
+
+	if (!rd->read_lat_avg)
+		rd->read_lat_avg = lat;
+	else
+		rd->read_lat_avg = rd->read_lat_avg - rd->read_lat_avg / 8 +
+			lat / 8;
+
+	if (++rd->nr_read_completed >= ROW_ADAPT_WINDOW) {
+		rd->nr_read_completed = 0;
+		row_adapt(rd);
+	}
+}
+
 /*
  * get_queue_type() - Get queue type for a given request
  *
@@ -599,6 +845,27 @@ SHOW_FUNCTION(row_lp_swrite_quantum_show,
 	rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].disp_quantum, 0);
 SHOW_FUNCTION(row_read_idle_show, rowd->read_idle.idle_time, 1);
 SHOW_FUNCTION(row_read_idle_freq_show, rowd->read_idle.freq, 0);
+SHOW_FUNCTION(row_hp_read_deadline_show,
+	rowd->row_queues[ROWQ_PRIO_HIGH_READ].deadline, 1);
+SHOW_FUNCTION(row_rp_read_deadline_show,
+	rowd->row_queues[ROWQ_PRIO_REG_READ].deadline, 1);
+SHOW_FUNCTION(row_target_read_latency_show, rowd->target_read_lat, 0);
+SHOW_FUNCTION(row_write_quantum_scale_show, rowd->write_scale, 0);
+SHOW_FUNCTION(row_read_idle_scale_show, rowd->idle_scale, 0);
+SHOW_FUNCTION(row_rp_read_lat_p50_show,
+	row_lat_percentile(rowd, ROWQ_PRIO_REG_READ, 50), 0);
+SHOW_FUNCTION(row_rp_read_lat_p90_show,
+	row_lat_percentile(rowd, ROWQ_PRIO_REG_READ, 90), 0);
+SHOW_FUNCTION(row_rp_read_lat_p99_show,
+	row_lat_percentile(rowd, ROWQ_PRIO_REG_READ, 99), 0);
+SHOW_FUNCTION(row_rp_swrite_lat_p50_show,
+	row_lat_percentile(rowd, ROWQ_PRIO_REG_SWRITE, 50), 0);
+SHOW_FUNCTION(row_rp_swrite_lat_p99_show,
+	row_lat_percentile(rowd, ROWQ_PRIO_REG_SWRITE, 99), 0);
+SHOW_FUNCTION(row_rp_write_lat_p50_show,
+	row_lat_percentile(rowd, ROWQ_PRIO_REG_WRITE, 50), 0);
+SHOW_FUNCTION(row_rp_write_lat_p99_show,
+	row_lat_percentile(rowd, ROWQ_PRIO_REG_WRITE, 99), 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -639,12 +906,22 @@ STORE_FUNCTION(row_lp_swrite_quantum_store,
 			1, INT_MAX, 1);
 STORE_FUNCTION(row_read_idle_store, &rowd->read_idle.idle_time, 1, INT_MAX, 1);
 STORE_FUNCTION(row_read_idle_freq_store, &rowd->read_idle.freq, 1, INT_MAX, 0);
+STORE_FUNCTION(row_hp_read_deadline_store,
+			&rowd->row_queues[ROWQ_PRIO_HIGH_READ].deadline,
+			0, INT_MAX, 1);
+STORE_FUNCTION(row_rp_read_deadline_store,
+			&rowd->row_queues[ROWQ_PRIO_REG_READ].deadline,
+			0, INT_MAX, 1);
+STORE_FUNCTION(row_target_read_latency_store, &rowd->target_read_lat,
+			0, INT_MAX, 0);
 
 #undef STORE_FUNCTION
 
 #define ROW_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
 				      row_##name##_store)
+#define ROW_ATTR_RO(name) \
+	__ATTR(name, S_IRUGO, row_##name##_show, NULL)
 
 static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(hp_read_quantum),
@@ -656,12 +933,25 @@ static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(lp_swrite_quantum),
 	ROW_ATTR(read_idle),
 	ROW_ATTR(read_idle_freq),
+	ROW_ATTR(hp_read_deadline),
+	ROW_ATTR(rp_read_deadline),
+	ROW_ATTR(target_read_latency),
+	ROW_ATTR_RO(write_quantum_scale),
+	ROW_ATTR_RO(read_idle_scale),
+	ROW_ATTR_RO(rp_read_lat_p50),
+	ROW_ATTR_RO(rp_read_lat_p90),
+	ROW_ATTR_RO(rp_read_lat_p99),
+	ROW_ATTR_RO(rp_swrite_lat_p50),
+	ROW_ATTR_RO(rp_swrite_lat_p99),
+	ROW_ATTR_RO(rp_write_lat_p50),
+	ROW_ATTR_RO(rp_write_lat_p99),
 	__ATTR_NULL
 };
 
 static struct elevator_type iosched_row = {
 	.ops = {
 		.elevator_merge_req_fn		= row_merged_requests,
+		.elevator_completed_req_fn	= row_completed_request,
 		.elevator_dispatch_fn		= row_dispatch_requests,
 		.elevator_add_req_fn		= row_add_request,
 		.elevator_former_req_fn		= elv_rb_former_request,
@@ -22,6 +22,7 @@
 #include <linux/cpu.h>
 #include <linux/jiffies.h>
 #include <linux/slab.h>
+#include <linux/hrtimer.h>
 #include <asm/cputime.h>
 
 #include "cpuquiet.h"
@@ -30,12 +31,16 @@ struct cpuquiet_cpu_stat {
 	cputime64_t time_up_total;
 	u64 last_update;
 	unsigned int up_down_count;
+	u64 latency_total;		/* usecs spent in the driver */
+	unsigned int latency_count;
+	unsigned int latency_max;	/* slowest transition, usecs */
 	struct kobject cpu_kobject;
 };
 
 struct cpu_attribute {
 	struct attribute attr;
-	enum { up_down_count, time_up_total } type;
+	enum { up_down_count, time_up_total, transition_latency_avg,
+		transition_latency_max } type;
 };
 
 static struct cpuquiet_driver *cpuquiet_curr_driver;
@@ -49,13 +54,27 @@ struct cpuquiet_cpu_stat *stats;
 
 CPU_ATTRIBUTE(up_down_count);
 CPU_ATTRIBUTE(time_up_total);
+CPU_ATTRIBUTE(transition_latency_avg);
+CPU_ATTRIBUTE(transition_latency_max);
 
 static struct attribute *cpu_attributes[] = {
 	&up_down_count_attr.attr,
 	&time_up_total_attr.attr,
+	&transition_latency_avg_attr.attr,
+	&transition_latency_max_attr.attr,
 	NULL,
 };
 
+static void latency_update(struct cpuquiet_cpu_stat *stat, ktime_t start)
+{
+	unsigned int us = ktime_us_delta(ktime_get(), start);
+
+	stat->latency_total += us;
+	stat->latency_count++;
+	if (us > stat->latency_max)
+		stat->latency_max = us;
+}
+
 static void stats_update(struct cpuquiet_cpu_stat *stat, bool up)
 {
 	u64 cur_jiffies = get_jiffies_64();
@@ -74,12 +93,15 @@ static void stats_update(struct cpuquiet_cpu_stat *stat, bool up)
 int cpuquiet_quiesence_cpu(unsigned int cpunumber)
 {
 	int err = -EPERM;
+	ktime_t start = ktime_get();
 
 	if (cpuquiet_curr_driver && cpuquiet_curr_driver->quiesence_cpu)
 		err = cpuquiet_curr_driver->quiesence_cpu(cpunumber);
 
-	if (!err)
+	if (!err) {
 		stats_update(stats + cpunumber, 0);
+		latency_update(stats + cpunumber, start);
+	}
 
 	return err;
 }
@@ -88,12 +110,15 @@ EXPORT_SYMBOL(cpuquiet_quiesence_cpu);
 int cpuquiet_wake_cpu(unsigned int cpunumber)
 {
 	int err = -EPERM;
+	ktime_t start = ktime_get();
 
 	if (cpuquiet_curr_driver && cpuquiet_curr_driver->wake_cpu)
 		err = cpuquiet_curr_driver->wake_cpu(cpunumber);
 
-	if (!err)
+	if (!err) {
 		stats_update(stats + cpunumber, 1);
+		latency_update(stats + cpunumber, start);
+	}
 
 	return err;
 }
@@ -108,6 +133,7 @@ static ssize_t stats_sysfs_show(struct kobject *kobj,
 		container_of(kobj, struct cpuquiet_cpu_stat, cpu_kobject);
 	ssize_t len = 0;
 	bool was_up = stat->up_down_count & 0x1;
+	u64 avg;
 
 	stats_update(stat, was_up);
 
@@ -118,6 +144,15 @@ static ssize_t stats_sysfs_show(struct kobject *kobj,
 	case time_up_total:
 		len =  sprintf(buf, "%llu\n", stat->time_up_total);
 		break;
+	case transition_latency_avg:
+		avg = stat->latency_total;
+		if (stat->latency_count)
+			do_div(avg, stat->latency_count);
+		len = sprintf(buf, "%llu\n", avg);
+		break;
+	case transition_latency_max:
+		len = sprintf(buf, "%u\n", stat->latency_max);
+		break;
 	}
 
 	return len;
@@ -50,8 +50,25 @@ struct idle_info {
 	u64 timestamp;
 };
 
+/*
+ * Per-core history behind the load predictor.  Runqueue depth is tracked
+ * in FSHIFT fixed point, as avg_nr_running_cpu() returns it, by a fast and
+ * a slow moving average; their difference is the trend.  Utilisation
+ * follows a rising load immediately and decays slowly.
+ */
+struct load_hist {
+	unsigned long nr_fast;
+	unsigned long nr_slow;
+	unsigned int load_avg;
+};
+
+#define NR_FAST_SHIFT		1	/* weight 1/2 */
+#define NR_SLOW_SHIFT		3	/* weight 1/8 */
+#define LOAD_DECAY_SHIFT	2	/* weight 1/4 */
+
 static DEFINE_PER_CPU(struct idle_info, idleinfo);
 static DEFINE_PER_CPU(unsigned int, cpu_load);
+static DEFINE_PER_CPU(struct load_hist, loadhist);
 
 static struct timer_list load_timer;
 static bool load_timer_active;
@@ -64,11 +81,23 @@ static unsigned long up_delay;
 static unsigned long down_delay;
 static unsigned long last_change_time;
 static unsigned int  load_sample_rate = 20; /* msec */
+static unsigned int  trend_gain = 100; /* % of the rising trend predicted */
+static unsigned int  down_samples = 3;
+static unsigned int  skewed_samples;
+static unsigned int  nr_cpu_up;
+static unsigned int  nr_cpu_down;
 static struct workqueue_struct *balanced_wq;
 static struct delayed_work balanced_work;
 static BALANCED_STATE balanced_state;
 static struct kobject *balanced_kobject;
 
+static unsigned long ewma(unsigned long avg, unsigned long sample, int shift)
+{
+	if (sample >= avg)
+		return avg + ((sample - avg) >> shift);
+	return avg - ((avg - sample) >> shift);
+}
+
 static void calculate_load_timer(unsigned long data)
 {
 	int i;
@@ -80,6 +109,8 @@ static void calculate_load_timer(unsigned long data)
 	for_each_online_cpu(i) {
 		struct idle_info *iinfo = &per_cpu(idleinfo, i);
 		unsigned int *load = &per_cpu(cpu_load, i);
+		struct load_hist *hist = &per_cpu(loadhist, i);
+		unsigned long nr = avg_nr_running_cpu(i);
 
 		iinfo->idle_last = iinfo->idle_current;
 		iinfo->last_timestamp = iinfo->timestamp;
@@ -91,6 +122,14 @@ static void calculate_load_timer(unsigned long data)
 		idle_time *= 100;
 		do_div(idle_time, elapsed_time);
 		*load = 100 - idle_time;
+
+		hist->nr_fast = ewma(hist->nr_fast, nr, NR_FAST_SHIFT);
+		hist->nr_slow = ewma(hist->nr_slow, nr, NR_SLOW_SHIFT);
+		if (*load >= hist->load_avg)
+			hist->load_avg = *load;
+		else
+			hist->load_avg = ewma(hist->load_avg, *load,
+					      LOAD_DECAY_SHIFT);
 	}
 	mod_timer(&load_timer, jiffies + msecs_to_jiffies(load_sample_rate));
 }
@@ -129,11 +168,11 @@ static unsigned int get_slowest_cpu_n(void)
 	int i;
 
 	for_each_online_cpu(i) {
-		unsigned int *load = &per_cpu(cpu_load, i);
+		unsigned int load = per_cpu(loadhist, i).load_avg;
 
-		if ((i > 0) && (minload > *load)) {
+		if ((i > 0) && (minload > load)) {
 			cpu = i;
-			minload = *load;
+			minload = load;
 		}
 	}
 
@@ -145,11 +184,8 @@ static unsigned int cpu_highest_speed(void)
 	unsigned int maxload = 0;
 	int i;
 
-	for_each_online_cpu(i) {
-		unsigned int *load = &per_cpu(cpu_load, i);
-
-		maxload = max(maxload, *load);
-	}
+	for_each_online_cpu(i)
+		maxload = max(maxload, per_cpu(loadhist, i).load_avg);
 
 	return maxload;
 }
@@ -160,9 +196,7 @@ static unsigned int count_slow_cpus(unsigned int limit)
 	int i;
 
 	for_each_online_cpu(i) {
-		unsigned int *load = &per_cpu(cpu_load, i);
-
-		if (*load <= limit)
+		if (per_cpu(loadhist, i).load_avg <= limit)
 			cnt++;
 	}
 
@@ -177,6 +211,30 @@ static unsigned int nr_run_thresholds[] = {
 static unsigned int nr_run_hysteresis = 2;	/* 0.5 thread */
 static unsigned int nr_run_last;
 
+/*
+ * Runnable threads expected over the next sample period: a rising
+ * runqueue is extrapolated along its trend so that cores come up ahead of
+ * a burst, a falling one is followed only at the slow average so that
+ * they go down late.
+ */
+static unsigned long predicted_nr_running(void)
+{
+	unsigned long sum = 0;
+	int i;
+
+	for_each_online_cpu(i) {
+		struct load_hist *hist = &per_cpu(loadhist, i);
+
+		if (hist->nr_fast > hist->nr_slow)
+			sum += hist->nr_fast + (hist->nr_fast -
+				hist->nr_slow) * trend_gain / 100;
+		else
+			sum += hist->nr_slow;
+	}
+
+	return sum;
+}
+
 static CPU_SPEED_BALANCE balanced_speed_balance(void)
 {
 	unsigned long highest_speed = cpu_highest_speed();
@@ -184,7 +242,7 @@ static CPU_SPEED_BALANCE balanced_speed_balance(void)
 	unsigned long skewed_speed = balanced_speed / 2;
 	unsigned int nr_cpus = num_online_cpus();
 	unsigned int max_cpus = pm_qos_request(PM_QOS_MAX_ONLINE_CPUS) ? : 4;
-	unsigned int avg_nr_run = avg_nr_running();
+	unsigned int avg_nr_run = predicted_nr_running();
 	unsigned int nr_run;
 
 	/* balanced: freq targets for all CPUs are above 50% of highest speed
@@ -218,6 +276,9 @@ static void balanced_work_func(struct work_struct *work)
 
 	CPU_SPEED_BALANCE balance;
 
+	if (balanced_state != UP)
+		skewed_samples = 0;
+
 	switch (balanced_state) {
 	case IDLE:
 		break;
@@ -232,6 +293,11 @@ static void balanced_work_func(struct work_struct *work)
 		break;
 	case UP:
 		balance = balanced_speed_balance();
+		if (balance == CPU_SPEED_SKEWED)
+			skewed_samples++;
+		else
+			skewed_samples = 0;
+
 		switch (balance) {
 
 		/* cpu speed is up and balanced - one more on-line */
@@ -240,8 +306,10 @@ static void balanced_work_func(struct work_struct *work)
 			if (cpu < nr_cpu_ids)
 				up = true;
 			break;
-		/* cpu speed is up, but skewed - remove one core */
+		/* cpu speed is up, but skewed for a while - remove one core */
 		case CPU_SPEED_SKEWED:
+			if (skewed_samples < down_samples)
+				break;
 			cpu = get_slowest_cpu_n();
 			if (cpu < nr_cpu_ids)
 				up = false;
@@ -264,10 +332,14 @@ static void balanced_work_func(struct work_struct *work)
 
 	if (cpu < nr_cpu_ids) {
 		last_change_time = now;
-		if (up)
-			cpuquiet_wake_cpu(cpu);
-		else
-			cpuquiet_quiesence_cpu(cpu);
+		skewed_samples = 0;
+		if (up) {
+			if (!cpuquiet_wake_cpu(cpu))
+				nr_cpu_up++;
+		} else {
+			if (!cpuquiet_quiesence_cpu(cpu))
+				nr_cpu_down++;
+		}
 	}
 }
 
@@ -338,6 +410,10 @@ CPQ_BASIC_ATTRIBUTE(balance_level, 0644, uint);
 CPQ_BASIC_ATTRIBUTE(idle_bottom_freq, 0644, uint);
 CPQ_BASIC_ATTRIBUTE(idle_top_freq, 0644, uint);
 CPQ_BASIC_ATTRIBUTE(load_sample_rate, 0644, uint);
+CPQ_BASIC_ATTRIBUTE(trend_gain, 0644, uint);
+CPQ_BASIC_ATTRIBUTE(down_samples, 0644, uint);
+CPQ_BASIC_ATTRIBUTE(nr_cpu_up, 0444, uint);
+CPQ_BASIC_ATTRIBUTE(nr_cpu_down, 0444, uint);
 CPQ_ATTRIBUTE(up_delay, 0644, ulong, delay_callback);
 CPQ_ATTRIBUTE(down_delay, 0644, ulong, delay_callback);
 
@@ -348,6 +424,10 @@ static struct attribute *balanced_attributes[] = {
 	&up_delay_attr.attr,
 	&down_delay_attr.attr,
 	&load_sample_rate_attr.attr,
+	&trend_gain_attr.attr,
+	&down_samples_attr.attr,
+	&nr_cpu_up_attr.attr,
+	&nr_cpu_down_attr.attr,
 	NULL,
 };
 
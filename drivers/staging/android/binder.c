@@ -19,6 +19,7 @@
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
@@ -36,8 +37,16 @@
 
 #include "binder.h"
 
+/*
+ * binder_lock still protects everything but the buffer allocator: the
+ * proc, node, ref and thread trees, node and ref counts, todo lists,
+ * transaction stacks and thread state. Only the buffer allocation and
+ * payload copy of a transaction run under the target's alloc_lock
+ * instead. See TODO for the rest of the split.
+ */
 static DEFINE_MUTEX(binder_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
+static DEFINE_MUTEX(binder_mmap_lock);
 
 static HLIST_HEAD(binder_procs);
 static HLIST_HEAD(binder_deferred_list);
@@ -105,6 +114,32 @@ module_param_named(debug_mask, binder_debug_mask, uint, S_IWUSR | S_IRUGO);
 static int binder_debug_no_lock;
 module_param_named(proc_no_lock, binder_debug_no_lock, bool, S_IWUSR | S_IRUGO);
 
+/* Mapped but unused buffer pages kept per process, see binder_update_page_range */
+static int binder_reserve_pages = 4;
+
+static int binder_set_reserve_pages(const char *val,
+				    const struct kernel_param *kp)
+{
+	unsigned long pages;
+	int ret;
+
+	ret = strict_strtoul(val, 0, &pages);
+	if (ret)
+		return ret;
+	/* binder_mmap() limits the buffer space of a process to 4M */
+	if (pages > SZ_4M / PAGE_SIZE)
+		return -EINVAL;
+	binder_reserve_pages = pages;
+	return 0;
+}
+
+static struct kernel_param_ops binder_reserve_pages_ops = {
+	.set = binder_set_reserve_pages,
+	.get = param_get_int,
+};
+module_param_cb(reserve_pages, &binder_reserve_pages_ops,
+		&binder_reserve_pages, S_IWUSR | S_IRUGO);
+
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -164,6 +199,53 @@ static inline void binder_stats_created(enum binder_stat_types type)
 	binder_stats.obj_created[type]++;
 }
 
+/*
+ * Transaction latencies, bucketed by log2 of the latency in microseconds.
+ * BINDER_LAT_WAKEUP covers transactions that woke a waiting thread, so
+ * it is dominated by scheduling delay. BINDER_LAT_QUEUE covers those
+ * that sat in a todo list until a thread came back to read it, and
+ * BINDER_LAT_SERVICE is the time from delivery to the matching reply.
+ */
+enum binder_lat_types {
+	BINDER_LAT_WAKEUP,
+	BINDER_LAT_QUEUE,
+	BINDER_LAT_SERVICE,
+	BINDER_LAT_COUNT
+};
+
+#define BINDER_LAT_BUCKETS 20
+
+struct binder_lat_hist {
+	u32 bucket[BINDER_LAT_BUCKETS];
+	u32 count;
+	u32 max_us;
+	u64 total_us;
+};
+
+static const char * const binder_lat_strings[] = {
+	"wakeup",
+	"queue",
+	"service"
+};
+
+static u32 binder_lat_us(ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+
+	if (us < 0)
+		return 0;
+	return min_t(s64, us, UINT_MAX);
+}
+
+static void binder_lat_add(struct binder_lat_hist *hist, u32 us)
+{
+	hist->bucket[min(fls(us), BINDER_LAT_BUCKETS - 1)]++;
+	hist->count++;
+	hist->total_us += us;
+	if (us > hist->max_us)
+		hist->max_us = us;
+}
+
 struct binder_transaction_log_entry {
 	int debug_id;
 	int call_type;
@@ -210,6 +292,16 @@ struct binder_work {
 	} type;
 };
 
+/*
+ * A scheduling policy together with a kernel priority (0..MAX_RT_PRIO-1
+ * for real-time policies, MAX_RT_PRIO..MAX_PRIO-1 for the others), so
+ * that lower prio values always mean higher priority.
+ */
+struct binder_priority {
+	unsigned int sched_policy;
+	int prio;
+};
+
 struct binder_node {
 	int debug_id;
 	struct binder_work work;
@@ -222,6 +314,7 @@ struct binder_node {
 	int internal_strong_refs;
 	int local_weak_refs;
 	int local_strong_refs;
+	int tmp_refs;		/* delays the final kfree, under binder_lock */
 	void __user *ptr;
 	void __user *cookie;
 	unsigned has_strong_ref:1;
@@ -230,7 +323,8 @@ struct binder_node {
 	unsigned pending_weak_ref:1;
 	unsigned has_async_transaction:1;
 	unsigned accept_fds:1;
-	unsigned min_priority:8;
+	unsigned sched_policy:2;
+	int min_priority;	/* kernel prio, see binder_priority */
 	struct list_head async_todo;
 };
 
@@ -277,6 +371,7 @@ enum binder_deferred_state {
 	BINDER_DEFERRED_PUT_FILES    = 0x01,
 	BINDER_DEFERRED_FLUSH        = 0x02,
 	BINDER_DEFERRED_RELEASE      = 0x04,
+	BINDER_DEFERRED_RESERVE      = 0x08,
 };
 
 struct binder_proc {
@@ -294,24 +389,36 @@ struct binder_proc {
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
+	/*
+	 * alloc_lock protects the buffer allocator: buffers, free_buffers,
+	 * allocated_buffers, free_async_space, pages and the page reserve.
+	 * It nests inside binder_lock but is also taken on its own to copy
+	 * transaction data into the target's buffer.
+	 */
+	struct mutex alloc_lock;
 	struct list_head buffers;
 	struct rb_root free_buffers;
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 
 	struct page **pages;
+	unsigned long *page_reserved; /* mapped pages not used by a buffer */
+	int reserved_pages;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
 	wait_queue_head_t wait;
 	struct binder_stats stats;
+	struct binder_lat_hist lat[BINDER_LAT_COUNT];
 	struct list_head delivered_death;
 	int max_threads;
 	int requested_threads;
 	int requested_threads_started;
 	int ready_threads;
-	long default_priority;
+	struct binder_priority default_priority;
 	struct dentry *debugfs_entry;
+	int tmp_ref;	/* delays the final kfree, under binder_lock */
+	int is_dead;
 };
 
 enum {
@@ -352,14 +459,28 @@ struct binder_transaction {
 	struct binder_buffer *buffer;
 	unsigned int	code;
 	unsigned int	flags;
-	long	priority;
-	long	saved_priority;
+	struct binder_priority	priority;
+	struct binder_priority	saved_priority;
 	uid_t	sender_euid;
+	unsigned woke_waiter:1;	/* a thread was waiting at enqueue time */
+	ktime_t	enqueue_time;
+	ktime_t	dequeue_time;
 };
 
+#define CREATE_TRACE_POINTS
+#include "binder_trace.h"
+
 static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
 
+/* Called with binder_lock held */
+static void binder_proc_dec_tmpref(struct binder_proc *proc)
+{
+	proc->tmp_ref--;
+	if (proc->is_dead && !proc->tmp_ref)
+		kfree(proc);
+}
+
 /*
  * copied from get_unused_fd_flags
  */
@@ -498,21 +619,154 @@ out_unlock:
 	return -EBADF;
 }
 
-static void binder_set_nice(long nice)
+static bool binder_rt_policy(unsigned int policy)
+{
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+/*
+ * Policies a binder thread may be switched to. Inheriting SCHED_BATCH or
+ * SCHED_IDLE would leave the serving thread in that class for every later
+ * transaction it handles.
+ */
+static bool binder_supported_policy(unsigned int policy)
+{
+	return policy == SCHED_NORMAL || binder_rt_policy(policy);
+}
+
+static int binder_to_user_prio(unsigned int policy, int prio)
+{
+	if (binder_rt_policy(policy))
+		return MAX_USER_RT_PRIO - 1 - prio;
+	return prio - MAX_RT_PRIO - 20;
+}
+
+static int binder_to_kernel_prio(unsigned int policy, int user_prio)
+{
+	if (binder_rt_policy(policy))
+		return MAX_USER_RT_PRIO - 1 - user_prio;
+	return MAX_RT_PRIO + 20 + user_prio;
+}
+
+/*
+ * Decode the priority bits of a flat_binder_object: an rt priority for
+ * SCHED_FIFO and SCHED_RR, otherwise a nice value read unsigned as it
+ * always was, so that anything above 19 (0x7f from libbinder) still
+ * means no minimum.
+ */
+static int binder_node_min_prio(unsigned int policy, u32 bits)
+{
+	int user_prio = bits;
+
+	if (binder_rt_policy(policy))
+		user_prio = clamp(user_prio, 1, MAX_USER_RT_PRIO - 1);
+	else
+		user_prio = clamp(user_prio, -20, 19);
+	return binder_to_kernel_prio(policy, user_prio);
+}
+
+static struct binder_priority binder_current_priority(void)
 {
+	struct binder_priority prio = {
+		.sched_policy = current->policy,
+		.prio = current->normal_prio,
+	};
+
+	/* Work from SCHED_BATCH and SCHED_IDLE callers runs at nice 0 */
+	if (!binder_supported_policy(prio.sched_policy)) {
+		prio.sched_policy = SCHED_NORMAL;
+		prio.prio = binder_to_kernel_prio(SCHED_NORMAL, 0);
+	}
+
+	return prio;
+}
+
+static struct binder_priority binder_node_priority(struct binder_node *node)
+{
+	struct binder_priority prio = {
+		.sched_policy = node->sched_policy,
+		.prio = node->min_priority,
+	};
+
+	return prio;
+}
+
+/*
+ * Switch the current thread to @desired, falling back to the closest
+ * priority its RLIMIT_RTPRIO and RLIMIT_NICE allow. A real-time request
+ * that the thread may not take is mapped to the best nice value instead.
+ * The policy is always set with SCHED_RESET_ON_FORK so that children of
+ * a boosted binder thread do not inherit the caller's priority.
+ */
+static void binder_set_priority(struct binder_priority desired)
+{
+	unsigned int policy = desired.sched_policy;
+	int priority = binder_to_user_prio(policy, desired.prio);
+	bool has_cap_nice = has_capability_noaudit(current, CAP_SYS_NICE);
+	struct sched_param params;
 	long min_nice;
-	if (can_nice(current, nice)) {
-		set_user_nice(current, nice);
+
+	if (current->policy == policy && current->normal_prio == desired.prio)
 		return;
+
+	if (binder_rt_policy(policy) && !has_cap_nice) {
+		unsigned long max_rtprio = rlimit(RLIMIT_RTPRIO);
+
+		if (max_rtprio == 0) {
+			policy = SCHED_NORMAL;
+			priority = -20;
+		} else if (priority > max_rtprio) {
+			priority = max_rtprio;
+		}
+		binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+			     "binder: %d: rt priority %d:%d capped to %d:%d\n",
+			     current->pid, desired.sched_policy,
+			     binder_to_user_prio(desired.sched_policy,
+						 desired.prio),
+			     policy, priority);
+	}
+
+	if (!binder_rt_policy(policy) && !can_nice(current, priority)) {
+		min_nice = 20 - rlimit(RLIMIT_NICE);
+		binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+			     "binder: %d: nice value %d not allowed use "
+			     "%ld instead\n", current->pid, priority, min_nice);
+		if (min_nice > 19) {
+			binder_user_error("binder: %d RLIMIT_NICE not set\n",
+					  current->pid);
+			min_nice = 19;
+		}
+		priority = min_nice;
+	}
+
+	if (policy != current->policy || binder_rt_policy(policy)) {
+		params.sched_priority = binder_rt_policy(policy) ? priority : 0;
+		sched_setscheduler_nocheck(current,
+					   policy | SCHED_RESET_ON_FORK,
+					   &params);
 	}
-	min_nice = 20 - current->signal->rlim[RLIMIT_NICE].rlim_cur;
-	binder_debug(BINDER_DEBUG_PRIORITY_CAP,
-		     "binder: %d: nice value %ld not allowed use "
-		     "%ld instead\n", current->pid, nice, min_nice);
-	set_user_nice(current, min_nice);
-	if (min_nice < 20)
+	if (!binder_rt_policy(policy))
+		set_user_nice(current, priority);
+}
+
+/*
+ * Pick the priority a thread runs @t at: a synchronous call inherits
+ * the caller's policy and priority, and both kinds of call are raised
+ * to the node's minimum. Async work is never lowered below the thread's
+ * current priority.
+ */
+static void binder_transaction_priority(struct binder_transaction *t,
+					struct binder_node *node)
+{
+	struct binder_priority desired = binder_node_priority(node);
+
+	if (!(t->flags & TF_ONE_WAY)) {
+		if (t->priority.prio < desired.prio)
+			desired = t->priority;
+	} else if (t->saved_priority.prio <= desired.prio) {
 		return;
-	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
+	}
+	binder_set_priority(desired);
 }
 
 static size_t binder_buffer_size(struct binder_proc *proc,
@@ -586,13 +840,15 @@ static void binder_insert_allocated_buffer(struct binder_proc *proc,
 static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 						  void __user *user_ptr)
 {
-	struct rb_node *n = proc->allocated_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	struct binder_buffer *kern_ptr;
 
 	kern_ptr = user_ptr - proc->user_buffer_offset
 		- offsetof(struct binder_buffer, data);
 
+	mutex_lock(&proc->alloc_lock);
+	n = proc->allocated_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(buffer->free);
@@ -602,20 +858,106 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 		else if (kern_ptr > buffer)
 			n = n->rb_right;
 		else
-			return buffer;
+			break;
 	}
-	return NULL;
+	mutex_unlock(&proc->alloc_lock);
+	return n ? buffer : NULL;
 }
 
+/*
+ * Map the run [start, end) of unmapped buffer pages into the kernel and
+ * into userspace. All pages of the run are allocated first so that the
+ * kernel mapping is set up with a single map_vm_area() call. The new
+ * pages are added to the reserve; callers claim the ones they need.
+ */
+static int binder_map_pages(struct binder_proc *proc, void *start, void *end,
+			    struct vm_area_struct *vma)
+{
+	size_t i, first = (start - proc->buffer) / PAGE_SIZE;
+	size_t nr = (end - start) / PAGE_SIZE;
+	struct page **pages = &proc->pages[first];
+	struct page **page_array_ptr = pages;
+	unsigned long user_page_addr;
+	struct vm_struct tmp_area;
+
+	for (i = 0; i < nr; i++) {
+		BUG_ON(pages[i]);
+		pages[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (pages[i] == NULL) {
+			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+			       "for page at %p\n", proc->pid,
+			       start + i * PAGE_SIZE);
+			goto err_alloc_page_failed;
+		}
+	}
+	tmp_area.addr = start;
+	/* map_vm_area() leaves out the last page of the area */
+	tmp_area.size = end - start + PAGE_SIZE;
+	if (map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr)) {
+		printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+		       "to map pages %p-%p in kernel\n",
+		       proc->pid, start, end);
+		goto err_map_kernel_failed;
+	}
+	for (i = 0; i < nr; i++) {
+		user_page_addr = (uintptr_t)start + i * PAGE_SIZE +
+			proc->user_buffer_offset;
+		if (vm_insert_page(vma, user_page_addr, pages[i])) {
+			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+			       "to map page at %lx in userspace\n",
+			       proc->pid, user_page_addr);
+			goto err_vm_insert_page_failed;
+		}
+		/* vm_insert_page does not seem to increment the refcount */
+	}
+
+	for (i = 0; i < nr; i++)
+		__set_bit(first + i, proc->page_reserved);
+	proc->reserved_pages += nr;
+	return 0;
+
+err_vm_insert_page_failed:
+	if (i)
+		zap_page_range(vma, (uintptr_t)start +
+			proc->user_buffer_offset, i * PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)start, end - start);
+	i = nr;
+err_map_kernel_failed:
+err_alloc_page_failed:
+	while (i--) {
+		__free_page(pages[i]);
+		pages[i] = NULL;
+	}
+	return -ENOMEM;
+}
+
+static void binder_unmap_page(struct binder_proc *proc, size_t index,
+			      struct vm_area_struct *vma)
+{
+	void *page_addr = proc->buffer + index * PAGE_SIZE;
+
+	if (vma)
+		zap_page_range(vma, (uintptr_t)page_addr +
+			proc->user_buffer_offset, PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	__free_page(proc->pages[index]);
+	proc->pages[index] = NULL;
+}
+
+/*
+ * Pages no longer covered by a buffer are not unmapped right away but
+ * kept in a per-proc reserve, so that most allocations find their
+ * pages already mapped and neither allocate memory nor take mmap_sem.
+ * The reserve is trimmed and refilled from the deferred workqueue.
+ */
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
 {
-	void *page_addr;
-	unsigned long user_page_addr;
-	struct vm_struct tmp_area;
-	struct page **page;
+	void *page_addr, *run_end;
 	struct mm_struct *mm;
+	size_t index;
+	int ret = 0;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %p-%p\n", proc->pid,
@@ -624,6 +966,15 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
+	if (allocate == 0)
+		goto free_range;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE)
+		if (!proc->pages[(page_addr - proc->buffer) / PAGE_SIZE])
+			break;
+	if (page_addr >= end)
+		goto claim_range;
+
 	if (vma)
 		mm = NULL;
 	else
@@ -634,77 +985,128 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		vma = proc->vma;
 	}
 
-	if (allocate == 0)
-		goto free_range;
-
 	if (vma == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf failed to "
 		       "map pages in userspace, no vma\n", proc->pid);
+		ret = -ENOMEM;
 		goto err_no_vma;
 	}
 
-	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
-		struct page **page_array_ptr;
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (*page == NULL) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "for page at %p\n", proc->pid, page_addr);
-			goto err_alloc_page_failed;
-		}
-		tmp_area.addr = page_addr;
-		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
-		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
-		if (ret) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "to map page at %p in kernel\n",
-			       proc->pid, page_addr);
-			goto err_map_kernel_failed;
-		}
-		user_page_addr =
-			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
-		if (ret) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "to map page at %lx in userspace\n",
-			       proc->pid, user_page_addr);
-			goto err_vm_insert_page_failed;
+	while (page_addr < end) {
+		if (proc->pages[(page_addr - proc->buffer) / PAGE_SIZE]) {
+			page_addr += PAGE_SIZE;
+			continue;
 		}
-		/* vm_insert_page does not seem to increment the refcount */
+		run_end = page_addr + PAGE_SIZE;
+		while (run_end < end &&
+		       !proc->pages[(run_end - proc->buffer) / PAGE_SIZE])
+			run_end += PAGE_SIZE;
+		/* Pages mapped before a failure stay in the reserve */
+		ret = binder_map_pages(proc, page_addr, run_end, vma);
+		if (ret)
+			break;
+		page_addr = run_end;
 	}
+
+err_no_vma:
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
 	}
+	if (ret)
+		return ret;
+
+	/* The reserve ran dry for this range, top it up */
+	if (proc->vma)
+		binder_defer_work(proc, BINDER_DEFERRED_RESERVE);
+
+claim_range:
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		index = (page_addr - proc->buffer) / PAGE_SIZE;
+		BUG_ON(!test_bit(index, proc->page_reserved));
+		__clear_bit(index, proc->page_reserved);
+		proc->reserved_pages--;
+	}
 	return 0;
 
 free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
-err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
-err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
-err_alloc_page_failed:
-		;
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		index = (page_addr - proc->buffer) / PAGE_SIZE;
+		BUG_ON(!proc->pages[index]);
+		BUG_ON(test_bit(index, proc->page_reserved));
+		__set_bit(index, proc->page_reserved);
+		proc->reserved_pages++;
+	}
+	if (proc->vma && proc->reserved_pages > 2 * binder_reserve_pages)
+		binder_defer_work(proc, BINDER_DEFERRED_RESERVE);
+	return 0;
+}
+
+/*
+ * Bring the page reserve back to binder_reserve_pages. Excess pages are
+ * unmapped from the top of the buffer space down. Missing pages are
+ * mapped at the start of the largest free buffer, which is where
+ * allocations that do not fit in smaller holes end up.
+ */
+static void binder_balance_reserve(struct binder_proc *proc)
+{
+	struct binder_buffer *buffer;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	struct rb_node *n;
+	void *start, *end;
+	size_t index;
+	/* the parameter can change under us */
+	int reserve = ACCESS_ONCE(binder_reserve_pages);
+
+	if (proc->vma == NULL)
+		return;
+	smp_rmb(); /* pairs with smp_wmb() in binder_mmap() */
+
+	mutex_lock(&proc->alloc_lock);
+	if (proc->reserved_pages < reserve) {
+		n = rb_last(&proc->free_buffers);
+		if (n == NULL)
+			goto out;
+		buffer = rb_entry(n, struct binder_buffer, rb_node);
+		start = (void *)PAGE_ALIGN((uintptr_t)buffer->data);
+		end = (void *)(((uintptr_t)buffer->data +
+			binder_buffer_size(proc, buffer)) & PAGE_MASK);
+		if (end > start + (reserve - proc->reserved_pages) * PAGE_SIZE)
+			end = start + (reserve - proc->reserved_pages) *
+				PAGE_SIZE;
+		/* Map, then hand the pages straight back to the reserve */
+		if (!binder_update_page_range(proc, 1, start, end, NULL))
+			binder_update_page_range(proc, 0, start, end, NULL);
+		goto out;
+	}
+
+	if (proc->reserved_pages <= 2 * reserve)
+		goto out;
+
+	mm = get_task_mm(proc->tsk);
+	vma = NULL;
+	if (mm) {
+		down_write(&mm->mmap_sem);
+		vma = proc->vma;
+	}
+	index = proc->buffer_size / PAGE_SIZE;
+	while (index-- && proc->reserved_pages > reserve) {
+		if (!test_bit(index, proc->page_reserved))
+			continue;
+		__clear_bit(index, proc->page_reserved);
+		proc->reserved_pages--;
+		binder_unmap_page(proc, index, vma);
 	}
-err_no_vma:
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
 	}
-	return -ENOMEM;
+out:
+	mutex_unlock(&proc->alloc_lock);
 }
 
+/* Called with proc->alloc_lock held */
 static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 					      size_t data_size,
 					      size_t offsets_size, int is_async)
@@ -722,6 +1124,7 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		       proc->pid);
 		return NULL;
 	}
+	smp_rmb(); /* pairs with smp_wmb() in binder_mmap() */
 
 	size = ALIGN(data_size, sizeof(void *)) +
 		ALIGN(offsets_size, sizeof(void *));
@@ -799,6 +1202,9 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		     "%p\n", proc->pid, size, buffer);
 	buffer->data_size = data_size;
 	buffer->offsets_size = offsets_size;
+	buffer->allow_user_free = 0;
+	buffer->transaction = NULL;
+	buffer->target_node = NULL;
 	buffer->async_transaction = is_async;
 	if (is_async) {
 		proc->free_async_space -= size + sizeof(struct binder_buffer);
@@ -868,8 +1274,9 @@ static void binder_delete_free_buffer(struct binder_proc *proc,
 	}
 }
 
-static void binder_free_buf(struct binder_proc *proc,
-			    struct binder_buffer *buffer)
+/* Called with proc->alloc_lock held */
+static void __binder_free_buf(struct binder_proc *proc,
+			      struct binder_buffer *buffer)
 {
 	size_t size, buffer_size;
 
@@ -923,6 +1330,14 @@ static void binder_free_buf(struct binder_proc *proc,
 	binder_insert_free_buffer(proc, buffer);
 }
 
+static void binder_free_buf(struct binder_proc *proc,
+			    struct binder_buffer *buffer)
+{
+	mutex_lock(&proc->alloc_lock);
+	__binder_free_buf(proc, buffer);
+	mutex_unlock(&proc->alloc_lock);
+}
+
 static struct binder_node *binder_get_node(struct binder_proc *proc,
 					   void __user *ptr)
 {
@@ -972,6 +1387,8 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 	node->proc = proc;
 	node->ptr = ptr;
 	node->cookie = cookie;
+	node->sched_policy = SCHED_NORMAL;
+	node->min_priority = binder_to_kernel_prio(SCHED_NORMAL, 0);
 	node->work.type = BINDER_WORK_NODE;
 	INIT_LIST_HEAD(&node->work.entry);
 	INIT_LIST_HEAD(&node->async_todo);
@@ -1039,7 +1456,7 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 		}
 	} else {
 		if (hlist_empty(&node->refs) && !node->local_strong_refs &&
-		    !node->local_weak_refs) {
+		    !node->local_weak_refs && !node->tmp_refs) {
 			list_del_init(&node->work.entry);
 			if (node->proc) {
 				rb_erase(&node->rb_node, &node->proc->nodes);
@@ -1060,6 +1477,24 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 	return 0;
 }
 
+/*
+ * Called with binder_lock held. Only a node whose proc died while the
+ * tmp_ref was held can be left without any other reference here; a
+ * live node is kept by the local strong ref its user holds as well.
+ */
+static void binder_dec_node_tmpref(struct binder_node *node)
+{
+	node->tmp_refs--;
+	BUG_ON(node->tmp_refs < 0);
+	if (node->proc || node->tmp_refs || !hlist_empty(&node->refs))
+		return;
+	hlist_del(&node->dead_node);
+	binder_debug(BINDER_DEBUG_INTERNAL_REFS,
+		     "binder: dead node %d deleted\n", node->debug_id);
+	kfree(node);
+	binder_stats_deleted(BINDER_STAT_NODE);
+}
+
 
 static struct binder_ref *binder_get_ref(struct binder_proc *proc,
 					 uint32_t desc)
@@ -1381,7 +1816,7 @@ static void binder_transaction(struct binder_proc *proc,
 {
 	struct binder_transaction *t;
 	struct binder_work *tcomplete;
-	size_t *offp, *off_end;
+	size_t *uninitialized_var(offp), *off_end;
 	struct binder_proc *target_proc;
 	struct binder_thread *target_thread = NULL;
 	struct binder_node *target_node = NULL;
@@ -1389,7 +1824,10 @@ static void binder_transaction(struct binder_proc *proc,
 	wait_queue_head_t *target_wait;
 	struct binder_transaction *in_reply_to = NULL;
 	struct binder_transaction_log_entry *e;
+	struct binder_buffer *buffer;
 	uint32_t return_error;
+	u32 service_us;
+	int copy_error;
 
 	e = binder_transaction_log_add(&binder_transaction_log);
 	e->call_type = reply ? 2 : !!(tr->flags & TF_ONE_WAY);
@@ -1408,7 +1846,7 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
-		binder_set_nice(in_reply_to->saved_priority);
+		binder_set_priority(in_reply_to->saved_priority);
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
@@ -1422,6 +1860,9 @@ static void binder_transaction(struct binder_proc *proc,
 			in_reply_to = NULL;
 			goto err_bad_call_stack;
 		}
+		service_us = binder_lat_us(in_reply_to->dequeue_time);
+		binder_lat_add(&proc->lat[BINDER_LAT_SERVICE], service_us);
+		trace_binder_transaction_reply(in_reply_to, thread, service_us);
 		thread->transaction_stack = in_reply_to->to_parent;
 		target_thread = in_reply_to->from;
 		if (target_thread == NULL) {
@@ -1481,21 +1922,8 @@ static void binder_transaction(struct binder_proc *proc,
 				return_error = BR_FAILED_REPLY;
 				goto err_bad_call_stack;
 			}
-			while (tmp) {
-				if (tmp->from && tmp->from->proc == target_proc)
-					target_thread = tmp->from;
-				tmp = tmp->from_parent;
-			}
 		}
 	}
-	if (target_thread) {
-		e->to_thread = target_thread->pid;
-		target_list = &target_thread->todo;
-		target_wait = &target_thread->wait;
-	} else {
-		target_list = &target_proc->todo;
-		target_wait = &target_proc->wait;
-	}
 	e->to_proc = target_proc->pid;
 
 	/* TODO: reuse incoming transaction for reply */
@@ -1539,37 +1967,116 @@ static void binder_transaction(struct binder_proc *proc,
 		t->from = NULL;
 	t->sender_euid = proc->tsk->cred->euid;
 	t->to_proc = target_proc;
-	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
-	t->priority = task_nice(current);
-	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
+	t->priority = binder_current_priority();
+
+	/*
+	 * Allocate the buffer and copy the payload into it without
+	 * binder_lock, so that transactions between unrelated processes
+	 * only contend on the target's alloc_lock. The tmp_refs keep the
+	 * memory of target_proc and target_node until binder_lock is taken
+	 * again, even if target_proc dies meanwhile; the local strong ref
+	 * is the one the buffer holds on target_node. Anything else looked
+	 * up above is checked again afterwards.
+	 */
+	if (target_node) {
+		binder_inc_node(target_node, 1, 0, NULL);
+		target_node->tmp_refs++;
+	}
+	target_proc->tmp_ref++;
+	mutex_unlock(&binder_lock);
+
+	copy_error = 0;
+	mutex_lock(&target_proc->alloc_lock);
+	buffer = binder_alloc_buf(target_proc, tr->data_size,
 		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
-	if (t->buffer == NULL) {
+	if (buffer) {
+		buffer->debug_id = t->debug_id;
+		buffer->target_node = target_node;
+		offp = (size_t *)(buffer->data +
+				  ALIGN(tr->data_size, sizeof(void *)));
+		if (copy_from_user(buffer->data, tr->data.ptr.buffer,
+				   tr->data_size))
+			copy_error = 1;
+		else if (copy_from_user(offp, tr->data.ptr.offsets,
+					tr->offsets_size))
+			copy_error = 2;
+	}
+	mutex_unlock(&target_proc->alloc_lock);
+
+	mutex_lock(&binder_lock);
+	if (target_proc->is_dead) {
+		/*
+		 * The buffer was freed along with target_proc, and the
+		 * local refs of target_node were dropped when it died.
+		 */
+		if (target_node)
+			binder_dec_node_tmpref(target_node);
+		binder_proc_dec_tmpref(target_proc);
+		return_error = BR_DEAD_REPLY;
+		goto err_free_transaction;
+	}
+	if (target_node)
+		binder_dec_node_tmpref(target_node);
+	binder_proc_dec_tmpref(target_proc);
+	if (buffer == NULL) {
 		return_error = BR_FAILED_REPLY;
 		goto err_binder_alloc_buf_failed;
 	}
-	t->buffer->allow_user_free = 0;
-	t->buffer->debug_id = t->debug_id;
-	t->buffer->transaction = t;
-	t->buffer->target_node = target_node;
-	if (target_node)
-		binder_inc_node(target_node, 1, 0, NULL);
+	t->buffer = buffer;
+	buffer->transaction = t;
 
-	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
-
-	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size)) {
+	if (copy_error == 1) {
 		binder_user_error("binder: %d:%d got transaction with invalid "
 			"data ptr\n", proc->pid, thread->pid);
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
-	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
+	if (copy_error == 2) {
 		binder_user_error("binder: %d:%d got transaction with invalid "
 			"offsets ptr\n", proc->pid, thread->pid);
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
+
+	/* Threads may have exited while binder_lock was dropped */
+	if (reply) {
+		target_thread = in_reply_to->from;
+		if (target_thread == NULL) {
+			return_error = BR_DEAD_REPLY;
+			goto err_dead_target_thread;
+		}
+		if (target_thread->transaction_stack != in_reply_to) {
+			binder_user_error("binder: %d:%d got reply transaction "
+				"with bad target transaction stack %d, "
+				"expected %d\n",
+				proc->pid, thread->pid,
+				target_thread->transaction_stack ?
+				target_thread->transaction_stack->debug_id : 0,
+				in_reply_to->debug_id);
+			return_error = BR_FAILED_REPLY;
+			in_reply_to = NULL;
+			target_thread = NULL;
+			goto err_dead_target_thread;
+		}
+	} else if (!(tr->flags & TF_ONE_WAY)) {
+		struct binder_transaction *tmp;
+
+		for (tmp = thread->transaction_stack; tmp;
+		     tmp = tmp->from_parent)
+			if (tmp->from && tmp->from->proc == target_proc)
+				target_thread = tmp->from;
+	}
+	t->to_thread = target_thread;
+	if (target_thread) {
+		e->to_thread = target_thread->pid;
+		target_list = &target_thread->todo;
+		target_wait = &target_thread->wait;
+	} else {
+		target_list = &target_proc->todo;
+		target_wait = &target_proc->wait;
+	}
 	if (!IS_ALIGNED(tr->offsets_size, sizeof(size_t))) {
 		binder_user_error("binder: %d:%d got transaction with "
 			"invalid offsets size, %zd\n",
@@ -1601,7 +2108,15 @@ static void binder_transaction(struct binder_proc *proc,
 					return_error = BR_FAILED_REPLY;
 					goto err_binder_new_node_failed;
 				}
-				node->min_priority = fp->flags & FLAT_BINDER_FLAG_PRIORITY_MASK;
+				node->sched_policy = (fp->flags &
+					FLAT_BINDER_FLAG_SCHED_POLICY_MASK) >>
+					FLAT_BINDER_FLAG_SCHED_POLICY_SHIFT;
+				if (!binder_supported_policy(
+						node->sched_policy))
+					node->sched_policy = SCHED_NORMAL;
+				node->min_priority = binder_node_min_prio(
+					node->sched_policy,
+					fp->flags & FLAT_BINDER_FLAG_PRIORITY_MASK);
 				node->accept_fds = !!(fp->flags & FLAT_BINDER_FLAG_ACCEPTS_FDS);
 			}
 			if (fp->cookie != node->cookie) {
@@ -1610,6 +2125,7 @@ static void binder_transaction(struct binder_proc *proc,
 					proc->pid, thread->pid,
 					fp->binder, node->debug_id,
 					fp->cookie, node->cookie);
+				return_error = BR_FAILED_REPLY;
 				goto err_binder_get_ref_for_node_failed;
 			}
 			ref = binder_get_ref_for_node(target_proc, node);
@@ -1733,11 +2249,17 @@ static void binder_transaction(struct binder_proc *proc,
 			target_node->has_async_transaction = 1;
 	}
 	t->work.type = BINDER_WORK_TRANSACTION;
+	t->enqueue_time = ktime_get();
 	list_add_tail(&t->work.entry, target_list);
+	trace_binder_transaction(reply, t, target_node);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
 	list_add_tail(&tcomplete->entry, &thread->todo);
-	if (target_wait)
+	if (target_wait) {
+		t->woke_waiter = waitqueue_active(target_wait);
+		if (t->woke_waiter)
+			trace_binder_transaction_wakeup(t, target_thread);
 		wake_up_interruptible(target_wait);
+	}
 	return;
 
 err_get_unused_fd_failed:
@@ -1748,11 +2270,16 @@ err_binder_get_ref_failed:
 err_binder_new_node_failed:
 err_bad_object_type:
 err_bad_offset:
+err_dead_target_thread:
 err_copy_data_failed:
 	binder_transaction_buffer_release(target_proc, t->buffer, offp);
 	t->buffer->transaction = NULL;
 	binder_free_buf(target_proc, t->buffer);
+	goto err_free_transaction;
 err_binder_alloc_buf_failed:
+	if (target_node)
+		binder_dec_node(target_node, 1, 0);
+err_free_transaction:
 	kfree(tcomplete);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 err_alloc_tcomplete_failed:
@@ -2243,7 +2770,7 @@ retry:
 			wait_event_interruptible(binder_user_error_wait,
 						 binder_stop_on_user_error < 2);
 		}
-		binder_set_nice(proc->default_priority);
+		binder_set_priority(proc->default_priority);
 		if (non_block) {
 			if (!binder_has_proc_work(proc, thread))
 				ret = -EAGAIN;
@@ -2269,6 +2796,7 @@ retry:
 		struct binder_transaction_data tr;
 		struct binder_work *w;
 		struct binder_transaction *t = NULL;
+		u32 lat_us;
 
 		if (!list_empty(&thread->todo))
 			w = list_first_entry(&thread->todo, struct binder_work, entry);
@@ -2406,13 +2934,8 @@ retry:
 			struct binder_node *target_node = t->buffer->target_node;
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
-			t->saved_priority = task_nice(current);
-			if (t->priority < target_node->min_priority &&
-			    !(t->flags & TF_ONE_WAY))
-				binder_set_nice(t->priority);
-			else if (!(t->flags & TF_ONE_WAY) ||
-				 t->saved_priority > target_node->min_priority)
-				binder_set_nice(target_node->min_priority);
+			t->saved_priority = binder_current_priority();
+			binder_transaction_priority(t, target_node);
 			cmd = BR_TRANSACTION;
 		} else {
 			tr.target.ptr = NULL;
@@ -2460,6 +2983,11 @@ retry:
 
 		list_del(&t->work.entry);
 		t->buffer->allow_user_free = 1;
+		lat_us = binder_lat_us(t->enqueue_time);
+		t->dequeue_time = ktime_get();
+		binder_lat_add(&proc->lat[t->woke_waiter ? BINDER_LAT_WAKEUP :
+					  BINDER_LAT_QUEUE], lat_us);
+		trace_binder_transaction_received(t, thread, lat_us);
 		if (cmd == BR_TRANSACTION && !(t->flags & TF_ONE_WAY)) {
 			t->to_parent = thread->transaction_stack;
 			t->to_thread = thread;
@@ -2827,6 +3355,7 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	}
 	vma->vm_flags = (vma->vm_flags | VM_DONTCOPY) & ~VM_MAYWRITE;
 
+	mutex_lock(&binder_mmap_lock);
 	if (proc->buffer) {
 		ret = -EBUSY;
 		failure_string = "already mapped";
@@ -2841,6 +3370,7 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	}
 	proc->buffer = area->addr;
 	proc->user_buffer_offset = vma->vm_start - (uintptr_t)proc->buffer;
+	mutex_unlock(&binder_mmap_lock);
 
 #ifdef CONFIG_CPU_CACHE_VIPT
 	if (cache_is_vipt_aliasing()) {
@@ -2856,6 +3386,13 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		failure_string = "alloc page array";
 		goto err_alloc_pages_failed;
 	}
+	proc->page_reserved = kzalloc(BITS_TO_LONGS((vma->vm_end -
+			vma->vm_start) / PAGE_SIZE) * sizeof(long), GFP_KERNEL);
+	if (proc->page_reserved == NULL) {
+		ret = -ENOMEM;
+		failure_string = "alloc page reserve map";
+		goto err_alloc_page_reserved_failed;
+	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
 
 	vma->vm_ops = &binder_vm_ops;
@@ -2872,7 +3409,12 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	buffer->free = 1;
 	binder_insert_free_buffer(proc, buffer);
 	proc->free_async_space = proc->buffer_size / 2;
-	barrier();
+	/*
+	 * alloc_lock cannot be taken here: it nests outside mmap_sem,
+	 * which the caller holds. Nothing uses the allocator before it
+	 * sees proc->vma, so publish the state above before that.
+	 */
+	smp_wmb();
 	proc->files = get_files_struct(current);
 	proc->vma = vma;
 
@@ -2881,13 +3423,18 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	return 0;
 
 err_alloc_small_buf_failed:
+	kfree(proc->page_reserved);
+	proc->page_reserved = NULL;
+err_alloc_page_reserved_failed:
 	kfree(proc->pages);
 	proc->pages = NULL;
 err_alloc_pages_failed:
+	mutex_lock(&binder_mmap_lock);
 	vfree(proc->buffer);
 	proc->buffer = NULL;
 err_get_vm_area_failed:
 err_already_mapped:
+	mutex_unlock(&binder_mmap_lock);
 err_bad_arg:
 	printk(KERN_ERR "binder_mmap: %d %lx-%lx %s failed %d\n",
 	       proc->pid, vma->vm_start, vma->vm_end, failure_string, ret);
@@ -2908,7 +3455,8 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
-	proc->default_priority = task_nice(current);
+	mutex_init(&proc->alloc_lock);
+	proc->default_priority = binder_current_priority();
 	mutex_lock(&binder_lock);
 	binder_stats_created(BINDER_STAT_PROC);
 	hlist_add_head(&proc->proc_node, &binder_procs);
@@ -2974,6 +3522,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 	BUG_ON(proc->vma);
 	BUG_ON(proc->files);
 
+	proc->is_dead = 1;
 	hlist_del(&proc->proc_node);
 	if (binder_context_mgr_node && binder_context_mgr_node->proc == proc) {
 		binder_debug(BINDER_DEBUG_DEAD_BINDER,
@@ -2998,7 +3547,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 		rb_erase(&node->rb_node, &proc->nodes);
 		list_del_init(&node->work.entry);
 		binder_release_work(&node->async_todo);
-		if (hlist_empty(&node->refs)) {
+		if (hlist_empty(&node->refs) && !node->tmp_refs) {
 			kfree(node);
 			binder_stats_deleted(BINDER_STAT_NODE);
 		} else {
@@ -3039,6 +3588,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 	binder_release_work(&proc->delivered_death);
 	buffers = 0;
 
+	mutex_lock(&proc->alloc_lock);
 	while ((n = rb_first(&proc->allocated_buffers))) {
 		struct binder_buffer *buffer = rb_entry(n, struct binder_buffer,
 							rb_node);
@@ -3051,7 +3601,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 			       proc->pid, t->debug_id);
 			/*BUG();*/
 		}
-		binder_free_buf(proc, buffer);
+		__binder_free_buf(proc, buffer);
 		buffers++;
 	}
 
@@ -3075,8 +3625,11 @@ static void binder_deferred_release(struct binder_proc *proc)
 			}
 		}
 		kfree(proc->pages);
+		kfree(proc->page_reserved);
 		vfree(proc->buffer);
+		proc->pages = NULL;
 	}
+	mutex_unlock(&proc->alloc_lock);
 
 	put_task_struct(proc->tsk);
 
@@ -3087,7 +3640,9 @@ static void binder_deferred_release(struct binder_proc *proc)
 		     proc->pid, threads, nodes, incoming_refs, outgoing_refs,
 		     active_transactions, buffers, page_count);
 
-	kfree(proc);
+	/* A transaction copying into this proc frees it when done */
+	if (!proc->tmp_ref)
+		kfree(proc);
 }
 
 static void binder_deferred_func(struct work_struct *work)
@@ -3121,6 +3676,10 @@ static void binder_deferred_func(struct work_struct *work)
 		if (defer & BINDER_DEFERRED_FLUSH)
 			binder_deferred_flush(proc);
 
+		if ((defer & BINDER_DEFERRED_RESERVE) &&
+		    !(defer & BINDER_DEFERRED_RELEASE))
+			binder_balance_reserve(proc);
+
 		if (defer & BINDER_DEFERRED_RELEASE)
 			binder_deferred_release(proc); /* frees proc */
 
@@ -3148,13 +3707,16 @@ static void print_binder_transaction(struct seq_file *m, const char *prefix,
 				     struct binder_transaction *t)
 {
 	seq_printf(m,
-		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %ld r%d",
+		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %d:%d r%d",
 		   prefix, t->debug_id, t,
 		   t->from ? t->from->proc->pid : 0,
 		   t->from ? t->from->pid : 0,
 		   t->to_proc ? t->to_proc->pid : 0,
 		   t->to_thread ? t->to_thread->pid : 0,
-		   t->code, t->flags, t->priority, t->need_reply);
+		   t->code, t->flags, t->priority.sched_policy,
+		   binder_to_user_prio(t->priority.sched_policy,
+				       t->priority.prio),
+		   t->need_reply);
 	if (t->buffer == NULL) {
 		seq_puts(m, " buffer free\n");
 		return;
@@ -3305,9 +3867,11 @@ static void print_binder_proc(struct seq_file *m,
 			print_binder_ref(m, rb_entry(n, struct binder_ref,
 						     rb_node_desc));
 	}
+	mutex_lock(&proc->alloc_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		print_binder_buffer(m, "  buffer",
 				    rb_entry(n, struct binder_buffer, rb_node));
+	mutex_unlock(&proc->alloc_lock);
 	list_for_each_entry(w, &proc->todo, entry)
 		print_binder_work(m, "  ", "  pending transaction", w);
 	list_for_each_entry(w, &proc->delivered_death, entry) {
@@ -3437,9 +4001,12 @@ static void print_binder_proc_stats(struct seq_file *m,
 	seq_printf(m, "  refs: %d s %d w %d\n", count, strong, weak);
 
 	count = 0;
+	mutex_lock(&proc->alloc_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
+	mutex_unlock(&proc->alloc_lock);
 	seq_printf(m, "  buffers: %d\n", count);
+	seq_printf(m, "  reserved pages: %d\n", proc->reserved_pages);
 
 	count = 0;
 	list_for_each_entry(w, &proc->todo, entry) {
@@ -3501,6 +4068,50 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static void print_binder_lat_hist(struct seq_file *m, const char *name,
+				  struct binder_lat_hist *hist)
+{
+	int i;
+
+	seq_printf(m, "  %s: count %u avg %lluus max %uus\n", name,
+		   hist->count, div_u64(hist->total_us, hist->count),
+		   hist->max_us);
+	for (i = 0; i < BINDER_LAT_BUCKETS; i++) {
+		if (!hist->bucket[i])
+			continue;
+		if (i == BINDER_LAT_BUCKETS - 1)
+			seq_printf(m, "    >= %uus: %u\n", 1U << (i - 1),
+				   hist->bucket[i]);
+		else
+			seq_printf(m, "    < %uus: %u\n", 1U << i,
+				   hist->bucket[i]);
+	}
+}
+
+static int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int do_lock = !binder_debug_no_lock;
+	int i;
+
+	if (do_lock)
+		mutex_lock(&binder_lock);
+
+	seq_puts(m, "binder latency:\n");
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		seq_printf(m, "proc %d\n", proc->pid);
+		for (i = 0; i < BINDER_LAT_COUNT; i++) {
+			if (proc->lat[i].count)
+				print_binder_lat_hist(m, binder_lat_strings[i],
+						      &proc->lat[i]);
+		}
+	}
+	if (do_lock)
+		mutex_unlock(&binder_lock);
+	return 0;
+}
+
 static int binder_transactions_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *proc;
@@ -3577,6 +4188,7 @@ BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
+BINDER_DEBUG_ENTRY(latency);
 
 static int __init binder_init(void)
 {
@@ -3617,6 +4229,11 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    &binder_transaction_log_failed,
 				    &binder_transaction_log_fops);
+		debugfs_create_file("latency",
+				    S_IRUGO,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_latency_fops);
 	}
 	return ret;
 }
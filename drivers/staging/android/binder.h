@@ -37,6 +37,15 @@ enum {
 enum {
 	FLAT_BINDER_FLAG_PRIORITY_MASK = 0xff,
 	FLAT_BINDER_FLAG_ACCEPTS_FDS = 0x100,
+	/*
+	 * Scheduling policy of the node's minimum priority. For SCHED_FIFO
+	 * and SCHED_RR the priority bits hold an rt priority, otherwise a
+	 * nice value from 0 to 19; larger values mean no minimum. SCHED_BATCH
+	 * is treated as SCHED_NORMAL.
+	 */
+	FLAT_BINDER_FLAG_SCHED_POLICY_SHIFT = 9,
+	FLAT_BINDER_FLAG_SCHED_POLICY_MASK =
+		3U << FLAT_BINDER_FLAG_SCHED_POLICY_SHIFT,
 };
 
 /*
@@ -0,0 +1,119 @@
+/*
+ * binder_trace.h - tracepoints for the Android binder driver
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM binder
+
+#if !defined(_BINDER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BINDER_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(binder_transaction,
+	TP_PROTO(bool reply, struct binder_transaction *t,
+		 struct binder_node *target_node),
+	TP_ARGS(reply, t, target_node),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, target_node)
+		__field(int, to_proc)
+		__field(int, to_thread)
+		__field(int, reply)
+		__field(unsigned int, code)
+		__field(unsigned int, flags)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->target_node = target_node ? target_node->debug_id : 0;
+		__entry->to_proc = t->to_proc->pid;
+		__entry->to_thread = t->to_thread ? t->to_thread->pid : 0;
+		__entry->reply = reply;
+		__entry->code = t->code;
+		__entry->flags = t->flags;
+	),
+	TP_printk("transaction=%d dest_node=%d dest_proc=%d dest_thread=%d "
+		  "reply=%d flags=0x%x code=0x%x",
+		  __entry->debug_id, __entry->target_node,
+		  __entry->to_proc, __entry->to_thread,
+		  __entry->reply, __entry->flags, __entry->code)
+);
+
+TRACE_EVENT(binder_transaction_wakeup,
+	TP_PROTO(struct binder_transaction *t, struct binder_thread *thread),
+	TP_ARGS(t, thread),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, to_proc)
+		__field(int, to_thread)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->to_proc = t->to_proc->pid;
+		__entry->to_thread = thread ? thread->pid : 0;
+	),
+	TP_printk("transaction=%d dest_proc=%d dest_thread=%d",
+		  __entry->debug_id, __entry->to_proc, __entry->to_thread)
+);
+
+TRACE_EVENT(binder_transaction_received,
+	TP_PROTO(struct binder_transaction *t, struct binder_thread *thread,
+		 u32 latency_us),
+	TP_ARGS(t, thread, latency_us),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, proc)
+		__field(int, thread)
+		__field(int, woken)
+		__field(u32, latency_us)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->proc = thread->proc->pid;
+		__entry->thread = thread->pid;
+		__entry->woken = t->woke_waiter;
+		__entry->latency_us = latency_us;
+	),
+	TP_printk("transaction=%d proc=%d thread=%d woken=%d latency=%uus",
+		  __entry->debug_id, __entry->proc, __entry->thread,
+		  __entry->woken, __entry->latency_us)
+);
+
+TRACE_EVENT(binder_transaction_reply,
+	TP_PROTO(struct binder_transaction *in_reply_to,
+		 struct binder_thread *thread, u32 service_us),
+	TP_ARGS(in_reply_to, thread, service_us),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, proc)
+		__field(int, thread)
+		__field(u32, service_us)
+	),
+	TP_fast_assign(
+		__entry->debug_id = in_reply_to->debug_id;
+		__entry->proc = thread->proc->pid;
+		__entry->thread = thread->pid;
+		__entry->service_us = service_us;
+	),
+	TP_printk("transaction=%d proc=%d thread=%d service=%uus",
+		  __entry->debug_id, __entry->proc, __entry->thread,
+		  __entry->service_us)
+);
+
+#endif /* _BINDER_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE binder_trace
+#include <trace/define_trace.h>
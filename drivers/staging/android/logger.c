@@ -33,17 +33,24 @@
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.
+ *
+ * 'w_off' and 'head' are free-running byte positions; logger_offset() maps
+ * them into the buffer. Writers copy their entry in from user space
+ * without any lock and then serialize on 'lock' only to place it in the
+ * ring, so that entries keep one global order. Readers take no lock on
+ * the log: every entry between 'head' and 'w_off' is complete, and a
+ * writer moves 'head' forward before it overwrites anything, so a reader
+ * that finds its position behind 'head' after copying an entry knows the
+ * copy may be torn and starts over from 'head'.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
-	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
-	size_t			head;	/* new readers start here */
+	spinlock_t		lock;	/* serializes writers */
+	size_t			w_off;	/* current write head position */
+	size_t			head;	/* oldest entry; new readers start here */
 	size_t			size;	/* size of the log */
 };
 
@@ -51,13 +58,14 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. The structure is protected by its own mutex.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
-	struct list_head	list;	/* entry in logger_log's list */
-	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* serializes users of this reader */
+	size_t			r_off;	/* current read position */
 	bool			r_all;	/* reader can read all entries */
+	bool			r_batch; /* read() returns many entries */
 	int			r_ver;	/* reader ABI version */
 };
 
@@ -89,7 +97,7 @@ static inline struct logger_log *file_get_log(struct file *file)
 
 /*
  * get_entry_header - returns a pointer to the logger_entry header within
- * 'log' starting at offset 'off'. A temporary logger_entry 'scratch' must
+ * 'log' starting at position 'off'. A temporary logger_entry 'scratch' must
  * be provided. Typically the return value will be a pointer within
  * 'logger->buf'.  However, a pointer to 'scratch' may be returned if
  * the log entry spans the end and beginning of the circular buffer.
@@ -97,7 +105,10 @@ static inline struct logger_log *file_get_log(struct file *file)
 static struct logger_entry *get_entry_header(struct logger_log *log,
 		size_t off, struct logger_entry *scratch)
 {
-	size_t len = min(sizeof(struct logger_entry), log->size - off);
+	size_t len;
+
+	off = logger_offset(off);
+	len = min(sizeof(struct logger_entry), log->size - off);
 	if (len != sizeof(struct logger_entry)) {
 		memcpy(((void *) scratch), log->buffer + off, len);
 		memcpy(((void *) scratch) + len, log->buffer,
@@ -112,7 +123,7 @@ static struct logger_entry *get_entry_header(struct logger_log *log,
  * get_entry_msg_len - Grabs the length of the message of the entry
  * starting from from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
 {
@@ -123,6 +134,16 @@ static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
 	return entry->len;
 }
 
+/*
+ * logger_lapped - has the writer moved the log head past 'off'? Anything
+ * read from 'off' onwards before this check returned false was stable.
+ */
+static inline bool logger_lapped(struct logger_log *log, size_t off)
+{
+	smp_rmb();
+	return (ssize_t) (off - ACCESS_ONCE(log->head)) < 0;
+}
+
 static size_t get_user_hdr_len(int ver)
 {
 	if (ver < 2)
@@ -156,78 +177,111 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * logger_catch_up - pull 'reader' forward to the log head if the writer
+ * has overwritten the entries it had not read yet.
  *
- * Caller must hold log->mutex.
+ * Caller must hold reader->mutex.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void logger_catch_up(struct logger_log *log,
+			    struct logger_reader *reader)
 {
-	struct logger_entry scratch;
-	struct logger_entry *entry;
-	size_t len;
-	size_t msg_start;
-
-	/*
-	 * First, copy the header to userspace, using the version of
-	 * the header requested
-	 */
-	entry = get_entry_header(log, reader->r_off, &scratch);
-	if (copy_header_to_user(reader->r_ver, entry, buf))
-		return -EFAULT;
-
-	count -= get_user_hdr_len(reader->r_ver);
-	buf += get_user_hdr_len(reader->r_ver);
-	msg_start = logger_offset(reader->r_off + sizeof(struct logger_entry));
-
-	/*
-	 * We read from the msg in two disjoint operations. First, we read from
-	 * the current msg head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
-	 */
-	len = min(count, log->size - msg_start);
-	if (copy_to_user(buf, log->buffer + msg_start, len))
-		return -EFAULT;
-
-	/*
-	 * Second, we read any remaining bytes, starting back at the head of
-	 * the log.
-	 */
-	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+	if (logger_lapped(log, reader->r_off))
+		reader->r_off = ACCESS_ONCE(log->head);
+	smp_rmb();
+}
 
-	reader->r_off = logger_offset(reader->r_off +
-		sizeof(struct logger_entry) + count);
+/*
+ * logger_peek_entry - copy the header of the next entry 'reader' may read
+ * into 'entry', skipping entries that it is not allowed to see. Returns
+ * false once the reader has caught up with the writer.
+ *
+ * Caller must hold reader->mutex.
+ */
+static bool logger_peek_entry(struct logger_log *log,
+			      struct logger_reader *reader,
+			      struct logger_entry *entry)
+{
+	struct logger_entry scratch;
 
-	return count + get_user_hdr_len(reader->r_ver);
+	while (1) {
+		logger_catch_up(log, reader);
+		if (ACCESS_ONCE(log->w_off) == reader->r_off)
+			return false;
+		smp_rmb();
+
+		*entry = *get_entry_header(log, reader->r_off, &scratch);
+		if (logger_lapped(log, reader->r_off))
+			continue;
+
+		if (reader->r_all || entry->euid == current_euid())
+			return true;
+		reader->r_off += sizeof(struct logger_entry) + entry->len;
+	}
 }
 
 /*
- * get_next_entry_by_uid - Starting at 'off', returns an offset into
- * 'log->buffer' which contains the first entry readable by 'euid'
+ * do_read_log_to_user - reads whole entries from 'log' into the user-space
+ * buffer 'buf' of 'count' bytes: the next entry, or as many as fit if the
+ * reader asked for batching. Returns the number of bytes read, which is
+ * zero if there was nothing to read.
+ *
+ * Caller must hold reader->mutex.
  */
-static size_t get_next_entry_by_uid(struct logger_log *log,
-		size_t off, uid_t euid)
+static ssize_t do_read_log_to_user(struct logger_log *log,
+				   struct logger_reader *reader,
+				   char __user *buf,
+				   size_t count)
 {
-	while (off != log->w_off) {
-		struct logger_entry *entry;
-		struct logger_entry scratch;
-		size_t next_len;
-
-		entry = get_entry_header(log, off, &scratch);
+	size_t hdr_len = get_user_hdr_len(reader->r_ver);
+	struct logger_entry entry;
+	ssize_t copied = 0;
+	size_t len;
+	size_t msg_start;
 
-		if (entry->euid == euid)
-			return off;
+	while (logger_peek_entry(log, reader, &entry)) {
+		if (hdr_len + entry.len > count - copied) {
+			if (!copied)
+				return -EINVAL;
+			break;
+		}
 
-		next_len = sizeof(struct logger_entry) + entry->len;
-		off = logger_offset(off + next_len);
+		/*
+		 * First, copy the header to userspace, using the version of
+		 * the header requested
+		 */
+		if (copy_header_to_user(reader->r_ver, &entry, buf + copied))
+			goto fault;
+
+		/*
+		 * We read from the msg in two disjoint operations. First, we
+		 * read from the msg head offset up to the end of the log, then
+		 * any remaining bytes starting back at the head of the log.
+		 */
+		msg_start = logger_offset(reader->r_off +
+			sizeof(struct logger_entry));
+		len = min_t(size_t, entry.len, log->size - msg_start);
+		if (copy_to_user(buf + copied + hdr_len,
+				 log->buffer + msg_start, len))
+			goto fault;
+		if (entry.len != len &&
+		    copy_to_user(buf + copied + hdr_len + len, log->buffer,
+				 entry.len - len))
+			goto fault;
+
+		/* the writer lapped us while copying, the entry may be torn */
+		if (logger_lapped(log, reader->r_off))
+			continue;
+
+		reader->r_off += sizeof(struct logger_entry) + entry.len;
+		copied += hdr_len + entry.len;
+		if (!reader->r_batch)
+			break;
 	}
 
-	return off;
+	return copied;
+
+fault:
+	return copied ? copied : -EFAULT;
 }
 
 /*
@@ -237,7 +291,8 @@ static size_t get_next_entry_by_uid(struct logger_log *log,
  *
  * 	- O_NONBLOCK works
  * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * 	- Atomically reads exactly one log entry, or as many whole entries as
+ * 	  fit in the buffer after ioctl(LOGGER_SET_BATCH)
  *
  * Will set errno to EINVAL if read
  * buffer is insufficient to hold next entry.
@@ -254,9 +309,7 @@ start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		ret = (ACCESS_ONCE(log->w_off) == reader->r_off);
 		if (!ret)
 			break;
 
@@ -277,152 +330,77 @@ start:
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
-
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
+	mutex_lock(&reader->mutex);
+	ret = do_read_log_to_user(log, reader, buf, count);
+	mutex_unlock(&reader->mutex);
 
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+	if (unlikely(!ret))
 		goto start;
-	}
-
-	/* get the size of the next entry */
-	ret = get_user_hdr_len(reader->r_ver) +
-		get_entry_msg_len(log, reader->r_off);
-	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
-
-out:
-	mutex_unlock(&log->mutex);
 
 	return ret;
 }
 
 /*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
+ * logger_make_room - move the log head forward to the first entry that
+ * will survive writing 'len' more bytes, and publish it before the writer
+ * starts overwriting the entries in front of it.
  *
- * Caller must hold log->mutex.
+ * The caller needs to hold log->lock.
  */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
+static void logger_make_room(struct logger_log *log, size_t len)
 {
-	size_t count = 0;
+	size_t head = log->head;
 
-	do {
-		size_t nr = sizeof(struct logger_entry) +
-			get_entry_msg_len(log, off);
-		off = logger_offset(off + nr);
-		count += nr;
-	} while (count < len);
-
-	return off;
-}
+	while (log->w_off + len - head > log->size)
+		head += sizeof(struct logger_entry) +
+			get_entry_msg_len(log, head);
 
-/*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
- */
-static inline int clock_interval(size_t a, size_t b, size_t c)
-{
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
+	if (head != log->head) {
+		ACCESS_ONCE(log->head) = head;
+		smp_wmb();
 	}
-
-	return 0;
-}
-
-/*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
- *
- * The caller needs to hold log->mutex.
- */
-static void fix_up_readers(struct logger_log *log, size_t len)
-{
-	size_t old = log->w_off;
-	size_t new = logger_offset(old + len);
-	struct logger_reader *reader;
-
-	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
-
-	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * do_write_log - writes 'len' bytes from 'buf' to 'log' at position 'off'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, size_t off,
+			 const void *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	off = logger_offset(off);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-
 }
 
-/*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
- *
- * Returns 'count' on success, negative error code on failure.
- */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
-{
-	size_t len;
-
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
-
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
-			return -EFAULT;
-
-	log->w_off = logger_offset(log->w_off + count);
-
-	return count;
-}
+/* payloads up to this size are staged on the stack, larger ones in kmalloc */
+#define LOGGER_STACK_PAYLOAD	256
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * The payload is copied in from user space before log->lock is taken, so
+ * that a writer which faults or sleeps holds up nobody else.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
+	char stack_payload[LOGGER_STACK_PAYLOAD];
+	char *payload = stack_payload;
 	struct timespec now;
 	ssize_t ret = 0;
+	size_t off;
 
 	now = current_kernel_time();
 
@@ -438,42 +416,52 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
-	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
-	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
-
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	if (header.len > sizeof(stack_payload)) {
+		payload = kmalloc(header.len, GFP_KERNEL);
+		if (unlikely(!payload))
+			return -ENOMEM;
+	}
 
 	while (nr_segs-- > 0) {
-		size_t len;
-		ssize_t nr;
-
 		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
-
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+		size_t len = min_t(size_t, iov->iov_len, header.len - ret);
+
+		if (unlikely(copy_from_user(payload + ret, iov->iov_base,
+					    len))) {
+			ret = -EFAULT;
+			goto out;
 		}
 
 		iov++;
-		ret += nr;
+		ret += len;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_lock(&log->lock);
+
+	/*
+	 * Retire the entries we are about to overwrite first, so that no
+	 * reader can mistake a partially overwritten entry for a valid one.
+	 */
+	logger_make_room(log, sizeof(struct logger_entry) + header.len);
+
+	off = log->w_off;
+	do_write_log(log, off, &header, sizeof(struct logger_entry));
+	off += sizeof(struct logger_entry);
+	do_write_log(log, off, payload, header.len);
+	off += header.len;
+
+	/* readers may only see the entry once it is complete */
+	smp_wmb();
+	ACCESS_ONCE(log->w_off) = off;
+
+	spin_unlock(&log->lock);
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
 
+out:
+	if (payload != stack_payload)
+		kfree(payload);
 	return ret;
 }
 
@@ -508,13 +496,9 @@ static int logger_open(struct inode *inode, struct file *file)
 		reader->r_ver = 1;
 		reader->r_all = in_egroup_p(inode->i_gid) ||
 			capable(CAP_SYSLOG);
-
-		INIT_LIST_HEAD(&reader->list);
-
-		mutex_lock(&log->mutex);
-		reader->r_off = log->head;
-		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		reader->r_batch = false;
+		mutex_init(&reader->mutex);
+		reader->r_off = ACCESS_ONCE(log->head);
 
 		file->private_data = reader;
 	} else
@@ -532,11 +516,6 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
-		struct logger_log *log = reader->log;
-
-		mutex_lock(&log->mutex);
-		list_del(&reader->list);
-		mutex_unlock(&log->mutex);
 
 		kfree(reader);
 	}
@@ -557,6 +536,7 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 {
 	struct logger_reader *reader;
 	struct logger_log *log;
+	struct logger_entry entry;
 	unsigned int ret = POLLOUT | POLLWRNORM;
 
 	if (!(file->f_mode & FMODE_READ))
@@ -567,14 +547,10 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
-
-	if (log->w_off != reader->r_off)
+	mutex_lock(&reader->mutex);
+	if (logger_peek_entry(log, reader, &entry))
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -596,72 +572,61 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
 	struct logger_reader *reader;
+	struct logger_entry entry;
 	long ret = -EINVAL;
 	void __user *argp = (void __user *) arg;
 
-	mutex_lock(&log->mutex);
-
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
-		ret = log->size;
-		break;
+		return log->size;
+	case LOGGER_FLUSH_LOG:
+		if (!(file->f_mode & FMODE_WRITE))
+			return -EBADF;
+		/* readers catch up with the new head on their next access */
+		spin_lock(&log->lock);
+		ACCESS_ONCE(log->head) = log->w_off;
+		spin_unlock(&log->lock);
+		return 0;
 	case LOGGER_GET_LOG_LEN:
-		if (!(file->f_mode & FMODE_READ)) {
-			ret = -EBADF;
-			break;
-		}
-		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
-		else
-			ret = (log->size - reader->r_off) + log->w_off;
-		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
-		if (!(file->f_mode & FMODE_READ)) {
-			ret = -EBADF;
-			break;
-		}
-		reader = file->private_data;
+	case LOGGER_GET_VERSION:
+	case LOGGER_SET_VERSION:
+	case LOGGER_SET_BATCH:
+		break;
+	default:
+		return -EINVAL;
+	}
 
-		if (!reader->r_all)
-			reader->r_off = get_next_entry_by_uid(log,
-				reader->r_off, current_euid());
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+	reader = file->private_data;
+
+	mutex_lock(&reader->mutex);
 
-		if (log->w_off != reader->r_off)
-			ret = get_user_hdr_len(reader->r_ver) +
-				get_entry_msg_len(log, reader->r_off);
+	switch (cmd) {
+	case LOGGER_GET_LOG_LEN:
+		logger_catch_up(log, reader);
+		ret = ACCESS_ONCE(log->w_off) - reader->r_off;
+		break;
+	case LOGGER_GET_NEXT_ENTRY_LEN:
+		if (logger_peek_entry(log, reader, &entry))
+			ret = get_user_hdr_len(reader->r_ver) + entry.len;
 		else
 			ret = 0;
 		break;
-	case LOGGER_FLUSH_LOG:
-		if (!(file->f_mode & FMODE_WRITE)) {
-			ret = -EBADF;
-			break;
-		}
-		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
-		ret = 0;
-		break;
 	case LOGGER_GET_VERSION:
-		if (!(file->f_mode & FMODE_READ)) {
-			ret = -EBADF;
-			break;
-		}
-		reader = file->private_data;
 		ret = reader->r_ver;
 		break;
 	case LOGGER_SET_VERSION:
-		if (!(file->f_mode & FMODE_READ)) {
-			ret = -EBADF;
-			break;
-		}
-		reader = file->private_data;
 		ret = logger_set_version(reader, argp);
 		break;
+	case LOGGER_SET_BATCH:
+		reader->r_batch = !!arg;
+		ret = 0;
+		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -693,8 +658,7 @@ static struct logger_log VAR = { \
 		.parent = NULL, \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
-	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
@@ -66,5 +66,6 @@ struct logger_entry {
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
 #define LOGGER_GET_VERSION		_IO(__LOGGERIO, 5) /* abi version */
 #define LOGGER_SET_VERSION		_IO(__LOGGERIO, 6) /* abi version */
+#define LOGGER_SET_BATCH		_IO(__LOGGERIO, 7) /* multi-entry reads */
 
 #endif /* _LINUX_LOGGER_H */
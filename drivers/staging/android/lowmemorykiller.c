@@ -15,6 +15,9 @@
  * The driver considers memory used for caches to be free, but if a large
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
+ * With CONFIG_VMPRESSURE, cached memory stops counting as free for a while
+ * after reclaim reports critical pressure, that is once most of the pages
+ * it scans can no longer be reclaimed.
  *
  * Copyright (C) 2007-2008 Google, Inc.
  *
@@ -35,6 +38,7 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/vmpressure.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -55,6 +59,11 @@ static int lowmem_minfree_size = 4;
 static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
 
+/* ignore cached memory until this time after critical vmpressure */
+static bool lowmem_pressure_active;
+static unsigned long lowmem_pressure_timeout;
+static uint32_t lowmem_pressure_hold_ms = 1000;
+
 #define lowmem_print(level, x...)			\
 	do {						\
 		if (lowmem_debug_level >= (level))	\
@@ -79,13 +88,33 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 	return NOTIFY_OK;
 }
 
+static int lowmem_vmpressure_notify(struct notifier_block *self,
+				    unsigned long level, void *data)
+{
+	if (level == VMPRESSURE_CRITICAL) {
+		lowmem_pressure_timeout = jiffies +
+			msecs_to_jiffies(lowmem_pressure_hold_ms);
+		smp_wmb();
+		lowmem_pressure_active = true;
+		lowmem_print(3, "lowmem_vmpressure %u%%\n",
+			     *(unsigned int *)data);
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lowmem_vmpressure_nb = {
+	.notifier_call	= lowmem_vmpressure_notify,
+};
+
 static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
 	struct task_struct *p;
 	struct task_struct *selected = NULL;
+	struct hlist_node *pos;
 	int rem = 0;
 	int tasksize;
 	int i;
+	int adj;
 	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
 	int selected_oom_adj;
@@ -105,6 +134,20 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	    time_before_eq(jiffies, lowmem_deathpending_timeout))
 		return 0;
 
+	/*
+	 * Under critical pressure the page cache is being thrashed rather
+	 * than freed, so counting it as free would only delay the kill.
+	 * The flag keeps a timeout from long ago from looking current
+	 * again once jiffies wraps.
+	 */
+	if (lowmem_pressure_active) {
+		smp_rmb();
+		if (time_after(jiffies, lowmem_pressure_timeout))
+			lowmem_pressure_active = false;
+		else
+			other_file = 0;
+	}
+
 	if (lowmem_adj_size < array_size)
 		array_size = lowmem_adj_size;
 	if (lowmem_minfree_size < array_size)
@@ -131,41 +174,53 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	}
 	selected_oom_adj = min_adj;
 
+	/*
+	 * Walk the oom_adj index from the highest bucket down and stop at
+	 * the first one that holds a process with memory to give back, so
+	 * the cost depends on the number of buckets rather than processes.
+	 */
 	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
-
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
+	spin_lock(&oom_adj_index_lock);
+	for (adj = OOM_ADJUST_MAX; adj >= max(min_adj, OOM_DISABLE) &&
+	     !selected; adj--) {
+		hlist_for_each_entry(p, pos, oom_adj_index_head(adj),
+				     oom_adj_node) {
+			struct mm_struct *mm;
+			struct signal_struct *sig;
+			int oom_adj;
+
+			task_lock(p);
+			mm = p->mm;
+			sig = p->signal;
+			if (!mm || !sig) {
+				task_unlock(p);
 				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
+			}
+			oom_adj = sig->oom_adj;
+			if (oom_adj < min_adj) {
+				task_unlock(p);
+				continue;
+			}
+			tasksize = get_mm_rss(mm);
+			task_unlock(p);
+			if (tasksize <= 0)
 				continue;
+			if (selected) {
+				if (oom_adj < selected_oom_adj)
+					continue;
+				if (oom_adj == selected_oom_adj &&
+				    tasksize <= selected_tasksize)
+					continue;
+			}
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = oom_adj;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, "
+				     "to kill\n", p->pid, p->comm, oom_adj,
+				     tasksize);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
 	}
+	spin_unlock(&oom_adj_index_lock);
 	if (selected) {
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
 			     selected->pid, selected->comm,
@@ -189,6 +244,7 @@ static struct shrinker lowmem_shrinker = {
 static int __init lowmem_init(void)
 {
 	task_free_register(&task_nb);
+	vmpressure_register_notifier(&lowmem_vmpressure_nb);
 	register_shrinker(&lowmem_shrinker);
 	return 0;
 }
@@ -196,6 +252,7 @@ static int __init lowmem_init(void)
 static void __exit lowmem_exit(void)
 {
 	unregister_shrinker(&lowmem_shrinker);
+	vmpressure_unregister_notifier(&lowmem_vmpressure_nb);
 	task_free_unregister(&task_nb);
 }
 
@@ -205,6 +262,8 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(vmpressure_hold_ms, lowmem_pressure_hold_ms, uint,
+		   S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
@@ -26,22 +26,40 @@
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
+#include <linux/file.h>
+#include <linux/fs.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/rbtree.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
+#include <linux/crypto.h>
+#include <linux/sched.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
 /* Globals */
 static int zram_major;
 struct zram *devices;
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Backing device I/O that cannot be issued from zram_make_request() */
+static struct workqueue_struct *zram_bdev_wq;
+#endif
 
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
+/* Compression backends selectable through the comp_algorithm node */
+const char * const zram_backends[] = {
+	"lzo",
+	"lz4",
+	"deflate",
+	NULL
+};
+
 static void zram_stat_inc(u32 *v)
 {
 	*v = *v + 1;
@@ -89,21 +107,241 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
+static void zram_fill_page(void *ptr, unsigned long len,
+			   unsigned long element)
+{
+	unsigned int pos;
+	unsigned long *page;
+
+	if (likely(!element)) {
+		memset(ptr, 0, len);
+		return;
+	}
+
+	page = (unsigned long *)ptr;
+
+	for (pos = 0; pos != len / sizeof(*page); pos++)
+		page[pos] = element;
+}
+
+static void zram_strm_free(struct zram_strm *zstrm)
+{
+	if (!IS_ERR_OR_NULL(zstrm->tfm))
+		crypto_free_comp(zstrm->tfm);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+/*
+ * Streams are only allocated from process context, at device init and
+ * when max_comp_streams is raised: the crypto API may load a module and
+ * allocates the transform's working memory with GFP_KERNEL, which must
+ * not happen in the swap-out path.
+ */
+static struct zram_strm *zram_strm_alloc(struct zram *zram)
+{
+	struct zram_strm *zstrm;
+
+	zstrm = kzalloc(sizeof(*zstrm), GFP_KERNEL);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->tfm = crypto_alloc_comp(zram->compressor, 0, 0);
+	/*
+	 * Allocate 2 pages: the compressor can expand an incompressible
+	 * page slightly beyond PAGE_SIZE.
+	 */
+	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (IS_ERR(zstrm->tfm) || !zstrm->buffer) {
+		zram_strm_free(zstrm);
+		return NULL;
+	}
+
+	return zstrm;
+}
+
+/* Get an idle compression stream, waiting for one if all are in use */
+static struct zram_strm *zram_strm_find(struct zram *zram)
+{
+	struct zram_strm *zstrm;
+
+	while (1) {
+		spin_lock(&zram->strm_lock);
+		if (!list_empty(&zram->idle_strm)) {
+			zstrm = list_first_entry(&zram->idle_strm,
+					struct zram_strm, list);
+			list_del(&zstrm->list);
+			spin_unlock(&zram->strm_lock);
+			return zstrm;
+		}
+		spin_unlock(&zram->strm_lock);
+
+		wait_event(zram->strm_wait, !list_empty(&zram->idle_strm));
+	}
+}
+
+static void zram_strm_release(struct zram *zram, struct zram_strm *zstrm)
+{
+	spin_lock(&zram->strm_lock);
+	/* max_strm may have been lowered while this stream was in use */
+	if (zram->avail_strm > zram->max_strm) {
+		zram->avail_strm--;
+		spin_unlock(&zram->strm_lock);
+		zram_strm_free(zstrm);
+		return;
+	}
+	list_add(&zstrm->list, &zram->idle_strm);
+	spin_unlock(&zram->strm_lock);
+	wake_up(&zram->strm_wait);
+}
+
+/*
+ * Allocate streams until there are max_strm. Called with init_lock
+ * held. If that fails, max_strm is lowered to the number there are.
+ */
+static int zram_strm_grow(struct zram *zram)
+{
+	struct zram_strm *zstrm;
+
+	while (zram->avail_strm < zram->max_strm) {
+		zstrm = zram_strm_alloc(zram);
+		if (!zstrm) {
+			pr_warning("Could only allocate %d %s compression "
+				   "streams\n", zram->avail_strm,
+				   zram->compressor);
+			spin_lock(&zram->strm_lock);
+			zram->max_strm = max(zram->avail_strm, 1);
+			spin_unlock(&zram->strm_lock);
+			return -ENOMEM;
+		}
+
+		spin_lock(&zram->strm_lock);
+		list_add(&zstrm->list, &zram->idle_strm);
+		zram->avail_strm++;
+		spin_unlock(&zram->strm_lock);
+		wake_up(&zram->strm_wait);
+	}
+
+	return 0;
+}
+
+int zram_set_max_strm(struct zram *zram, int max_strm)
+{
+	int ret = 0;
+	struct zram_strm *zstrm;
+	LIST_HEAD(victims);
+
+	mutex_lock(&zram->init_lock);
+	spin_lock(&zram->strm_lock);
+	zram->max_strm = max_strm;
+	while (zram->avail_strm > max_strm &&
+	       !list_empty(&zram->idle_strm)) {
+		zstrm = list_first_entry(&zram->idle_strm,
+				struct zram_strm, list);
+		list_move(&zstrm->list, &victims);
+		zram->avail_strm--;
+	}
+	spin_unlock(&zram->strm_lock);
+
+	/* Streams of an uninitialized device are allocated at init */
+	if (zram->init_done)
+		ret = zram_strm_grow(zram);
+	mutex_unlock(&zram->init_lock);
+
+	while (!list_empty(&victims)) {
+		zstrm = list_first_entry(&victims, struct zram_strm, list);
+		list_del(&zstrm->list);
+		zram_strm_free(zstrm);
+	}
+
+	return ret;
+}
+
+static void zram_strm_destroy_all(struct zram *zram)
+{
+	struct zram_strm *zstrm;
+
+	while (!list_empty(&zram->idle_strm)) {
+		zstrm = list_first_entry(&zram->idle_strm,
+				struct zram_strm, list);
+		list_del(&zstrm->list);
+		zram_strm_free(zstrm);
+		zram->avail_strm--;
+	}
+}
+
+static void zram_dtfm_free(struct zram *zram)
+{
+	int cpu;
+	struct crypto_comp *tfm;
+
+	if (!zram->dtfm)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		tfm = *per_cpu_ptr(zram->dtfm, cpu);
+		if (!IS_ERR_OR_NULL(tfm))
+			crypto_free_comp(tfm);
+	}
+	free_percpu(zram->dtfm);
+	zram->dtfm = NULL;
+}
+
+static int zram_dtfm_alloc(struct zram *zram)
+{
+	int cpu;
+	struct crypto_comp *tfm;
+
+	zram->dtfm = alloc_percpu(struct crypto_comp *);
+	if (!zram->dtfm)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		tfm = crypto_alloc_comp(zram->compressor, 0, 0);
+		if (IS_ERR(tfm)) {
+			zram_dtfm_free(zram);
+			return PTR_ERR(tfm);
+		}
+		*per_cpu_ptr(zram->dtfm, cpu) = tfm;
+	}
+
+	return 0;
+}
+
+/*
+ * Decompress a stored object into a page sized buffer. Readers do not
+ * need a compression stream, so they are not limited by max_strm.
+ */
+static int zram_decompress(struct zram *zram, unsigned char *src,
+			   unsigned int slen, unsigned char *dst)
+{
+	int ret;
+	unsigned int dlen = PAGE_SIZE;
+	struct crypto_comp *tfm;
+
+	tfm = *get_cpu_ptr(zram->dtfm);
+	ret = crypto_comp_decompress(tfm, src, slen, dst, &dlen);
+	put_cpu_ptr(zram->dtfm);
+
+	return ret;
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -133,57 +371,570 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+/*
+ * Find a stored object with the given checksum and contents. Called
+ * with zram->lock held.
+ */
+static struct zram_entry *zram_entry_match(struct zram *zram, u32 checksum,
+				unsigned char *mem, unsigned int size)
+{
+	int match;
+	unsigned char *cmem;
+	struct zram_entry *entry;
+	struct rb_node *node = zram->entry_tree.rb_node;
+
+	while (node) {
+		entry = rb_entry(node, struct zram_entry, rb_node);
+
+		if (checksum < entry->checksum)
+			node = node->rb_left;
+		else if (checksum > entry->checksum)
+			node = node->rb_right;
+		else
+			break;
+	}
+
+	if (!node || entry->size != size)
+		return NULL;
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle);
+	if (size != PAGE_SIZE)
+		cmem += sizeof(struct zobj_header);
+	match = !memcmp(cmem, mem, size);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return match ? entry : NULL;
+}
+
+static void zram_entry_insert(struct zram *zram, struct zram_entry *new)
+{
+	struct zram_entry *entry;
+	struct rb_node **link = &zram->entry_tree.rb_node, *parent = NULL;
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct zram_entry, rb_node);
+
+		if (new->checksum < entry->checksum) {
+			link = &parent->rb_left;
+		} else if (new->checksum > entry->checksum) {
+			link = &parent->rb_right;
+		} else {
+			/*
+			 * Checksum collision with different contents. Leave
+			 * the new object out of the index; it just won't
+			 * be shared.
+			 */
+			RB_CLEAR_NODE(&new->rb_node);
+			return;
+		}
+	}
+
+	rb_link_node(&new->rb_node, parent, link);
+	rb_insert_color(&new->rb_node, &zram->entry_tree);
+}
+
+static void zram_entry_put(struct zram *zram, struct zram_entry *entry)
+{
+	if (--entry->refcount)
+		return;
+
+	if (!RB_EMPTY_NODE(&entry->rb_node))
+		rb_erase(&entry->rb_node, &zram->entry_tree);
+	zs_free(zram->mem_pool, entry->handle);
+	kfree(entry);
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Pages that do not compress, or that have not been touched for
+ * idle_threshold seconds, can be moved to a backing block device to
+ * free memory. Such pages keep their block number in the table.
+ */
+static inline int zram_has_backing_dev(struct zram *zram)
+{
+	return zram->bdev != NULL;
+}
+
+static inline void zram_accessed(struct zram *zram, u32 index)
+{
+	zram->table[index].ac_time = jiffies;
+}
+
+/* Returns zram->nr_blocks if the backing device is full */
+static unsigned long zram_alloc_block(struct zram *zram)
+{
+	unsigned long block, flags;
+
+	spin_lock_irqsave(&zram->bitmap_lock, flags);
+	block = find_first_zero_bit(zram->bitmap, zram->nr_blocks);
+	if (block < zram->nr_blocks)
+		__set_bit(block, zram->bitmap);
+	spin_unlock_irqrestore(&zram->bitmap_lock, flags);
+
+	return block;
+}
+
+/*
+ * Returns 1 if a read of block other than skip is in flight, after
+ * marking all such reads so that the last one frees the block. Called
+ * with bitmap_lock held.
+ */
+static int zram_block_pinned(struct zram *zram, unsigned long block,
+			     struct zram_bd_read *skip)
+{
+	int pinned = 0;
+	struct zram_bd_read *rd;
+
+	list_for_each_entry(rd, &zram->inflight_reads, list) {
+		if (rd != skip && rd->block == block) {
+			rd->freed = true;
+			pinned = 1;
+		}
+	}
+
+	return pinned;
+}
+
+static void zram_free_block(struct zram *zram, unsigned long block)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&zram->bitmap_lock, flags);
+	if (!zram_block_pinned(zram, block, NULL))
+		__clear_bit(block, zram->bitmap);
+	spin_unlock_irqrestore(&zram->bitmap_lock, flags);
+}
+
+/* Called on reset, once the table that referenced the blocks is gone */
+static void zram_free_all_blocks(struct zram *zram)
+{
+	if (zram->bitmap)
+		bitmap_zero(zram->bitmap, zram->nr_blocks);
+}
+#else
+static inline int zram_has_backing_dev(struct zram *zram)
+{
+	return 0;
+}
+
+static inline void zram_accessed(struct zram *zram, u32 index)
+{
+}
+
+static inline void zram_free_block(struct zram *zram, unsigned long block)
+{
+}
+
+static inline void zram_free_all_blocks(struct zram *zram)
+{
+}
+#endif
+
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
-	void *obj;
+	struct zram_entry *entry = zram->table[index].entry;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 
-	if (unlikely(!page)) {
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_free_block(zram, zram->table[index].element);
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_stat_dec(&zram->stats.pages_wb);
+		zram->table[index].element = 0;
+		return;
+	}
+
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
 		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
+		 * No memory is allocated for same filled pages.
+		 * Simply clear same page flag.
 		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
+		if (!zram->table[index].element)
 			zram_stat_dec(&zram->stats.pages_zero);
-		}
+		zram_stat_dec(&zram->stats.pages_same);
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		zram->table[index].element = 0;
 		return;
 	}
 
+	if (unlikely(!entry))
+		return;
+
+	clen = entry->size;
+	if (entry->refcount > 1)
+		zram_stat64_sub(zram, &zram->stats.dup_data_size, clen);
+	else
+		zram_stat64_sub(zram, &zram->stats.compr_size, clen);
+	zram_entry_put(zram, entry);
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		clen = PAGE_SIZE;
-		__free_page(page);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
-		goto out;
+	} else if (clen <= PAGE_SIZE / 2) {
+		zram_stat_dec(&zram->stats.good_compress);
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
+	zram_stat_dec(&zram->stats.pages_stored);
 
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
+	zram->table[index].entry = NULL;
+}
 
-out:
-	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
-	zram_stat_dec(&zram->stats.pages_stored);
+/*
+ * Free slots whose swap_slot_free_notify could not take zram->lock.
+ * Must be called with zram->lock held for writing, and before any
+ * write to the table so that a reused slot is not freed afterwards.
+ */
+static void handle_pending_slot_free(struct zram *zram)
+{
+	struct zram_slot_free *free_rq;
+
+	spin_lock(&zram->slot_free_lock);
+	while (zram->slot_free_rq) {
+		free_rq = zram->slot_free_rq;
+		zram->slot_free_rq = free_rq->next;
+		spin_unlock(&zram->slot_free_lock);
+
+		zram_free_page(zram, free_rq->index);
+		kfree(free_rq);
+
+		spin_lock(&zram->slot_free_lock);
+	}
+	spin_unlock(&zram->slot_free_lock);
+}
+
+static void zram_slot_free_work(struct work_struct *work)
+{
+	struct zram *zram = container_of(work, struct zram, free_work);
+
+	down_write(&zram->lock);
+	handle_pending_slot_free(zram);
+	up_write(&zram->lock);
+}
+
+/*
+ * Called by zs_compact() for each object it moves. zram->lock is held
+ * for writing by zram_compact() so the table can be updated directly.
+ */
+static void zram_obj_migrate(void *priv, void *obj, unsigned long handle)
+{
+	struct zobj_header *zheader = obj;
+
+	zheader->entry->handle = handle;
+}
+
+unsigned long zram_compact(struct zram *zram)
+{
+	unsigned long freed;
+
+	down_write(&zram->lock);
+	handle_pending_slot_free(zram);
+	freed = zs_compact(zram->mem_pool);
+	zram_stat64_add(zram, &zram->stats.pages_compacted, freed);
+	up_write(&zram->lock);
+
+	return freed;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void zram_bdev_sync_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/* Synchronously read or write one page of the backing device */
+static int zram_bdev_rw_page(struct zram *zram, struct page *page,
+			     unsigned long block, int rw)
+{
+	int ret;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = block << SECTORS_PER_PAGE_SHIFT;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+	bio->bi_end_io = zram_bdev_sync_end_io;
+	bio->bi_private = &done;
+
+	submit_bio(rw == WRITE ? WRITE_SYNC : READ_SYNC, bio);
+	wait_for_completion(&done);
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	if (rw == WRITE)
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+	else
+		zram_stat64_inc(zram, &zram->stats.bd_reads);
+
+	return ret;
+}
+
+struct zram_bdev_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long block;
+	int rw;
+	int ret;
+};
+
+static void zram_bdev_rw_work(struct work_struct *work)
+{
+	struct zram_bdev_work *bw;
+
+	bw = container_of(work, struct zram_bdev_work, work);
+	bw->ret = zram_bdev_rw_page(bw->zram, bw->page, bw->block, bw->rw);
+}
+
+/*
+ * zram_bdev_rw_page() for callers inside zram_make_request(). A bio
+ * submitted from there is only queued on current->bio_list and is not
+ * dispatched before we return, so waiting for it would never end.
+ * Submit and wait from a worker instead.
+ */
+static int zram_bdev_rw_page_punt(struct zram *zram, struct page *page,
+				  unsigned long block, int rw)
+{
+	struct zram_bdev_work bw = {
+		.zram	= zram,
+		.page	= page,
+		.block	= block,
+		.rw	= rw,
+	};
+
+	INIT_WORK_ONSTACK(&bw.work, zram_bdev_rw_work);
+	queue_work(zram_bdev_wq, &bw.work);
+	flush_work(&bw.work);
+	destroy_work_on_stack(&bw.work);
+
+	return bw.ret;
+}
+
+static void zram_read_ctx_put(struct zram_read_ctx *ctx)
+{
+	if (!atomic_dec_and_test(&ctx->pending))
+		return;
+
+	if (ctx->error) {
+		bio_io_error(ctx->parent);
+	} else {
+		set_bit(BIO_UPTODATE, &ctx->parent->bi_flags);
+		bio_endio(ctx->parent, 0);
+	}
+	kfree(ctx);
+}
+
+static void zram_bdev_read_end_io(struct bio *bio, int err)
+{
+	unsigned long flags;
+	struct zram_bd_read *rd = bio->bi_private;
+	struct zram *zram = rd->zram;
+	struct zram_read_ctx *ctx = rd->ctx;
+
+	if (test_bit(BIO_UPTODATE, &bio->bi_flags))
+		flush_dcache_page(bio->bi_io_vec[0].bv_page);
+	else
+		ctx->error = 1;
+
+	/* Release the block if its page was freed during the read */
+	spin_lock_irqsave(&zram->bitmap_lock, flags);
+	list_del(&rd->list);
+	if (rd->freed && !zram_block_pinned(zram, rd->block, rd))
+		__clear_bit(rd->block, zram->bitmap);
+	spin_unlock_irqrestore(&zram->bitmap_lock, flags);
+
+	kfree(rd);
+	bio_put(bio);
+	zram_read_ctx_put(ctx);
+}
+
+/*
+ * Read a whole page from the backing device straight into the bvec.
+ * The parent bio is completed once all such reads have finished.
+ * Called with zram->lock held, which is dropped before the read
+ * completes; the block is pinned on inflight_reads until then.
+ */
+static int zram_bdev_read_async(struct zram *zram, struct bio_vec *bvec,
+				unsigned long block, struct bio *parent,
+				struct zram_read_ctx **ctxp)
+{
+	unsigned long flags;
+	struct bio *bio;
+	struct zram_bd_read *rd;
+	struct zram_read_ctx *ctx = *ctxp;
+
+	if (!ctx) {
+		ctx = kmalloc(sizeof(*ctx), GFP_NOIO);
+		if (!ctx)
+			return -ENOMEM;
+		ctx->parent = parent;
+		/* Dropped by __zram_make_request() once all bvecs are done */
+		atomic_set(&ctx->pending, 1);
+		ctx->error = 0;
+		*ctxp = ctx;
+	}
+
+	rd = kmalloc(sizeof(*rd), GFP_NOIO);
+	if (!rd)
+		return -ENOMEM;
+	rd->zram = zram;
+	rd->ctx = ctx;
+	rd->block = block;
+	rd->freed = false;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio) {
+		kfree(rd);
+		return -ENOMEM;
+	}
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = block << SECTORS_PER_PAGE_SHIFT;
+	if (!bio_add_page(bio, bvec->bv_page, PAGE_SIZE, bvec->bv_offset)) {
+		bio_put(bio);
+		kfree(rd);
+		return -EIO;
+	}
+	bio->bi_end_io = zram_bdev_read_end_io;
+	bio->bi_private = rd;
+
+	spin_lock_irqsave(&zram->bitmap_lock, flags);
+	list_add(&rd->list, &zram->inflight_reads);
+	spin_unlock_irqrestore(&zram->bitmap_lock, flags);
+
+	atomic_inc(&ctx->pending);
+	submit_bio(READ, bio);
+	zram_stat64_inc(zram, &zram->stats.bd_reads);
+
+	return 0;
+}
+
+static int zram_bvec_read_bdev(struct zram *zram, struct bio_vec *bvec,
+			       u32 index, int offset, struct bio *parent,
+			       struct zram_read_ctx **ctxp)
+{
+	int ret;
+	struct page *page;
+	unsigned char *user_mem;
+	unsigned long block = zram->table[index].element;
+
+	if (bvec->bv_len == PAGE_SIZE)
+		return zram_bdev_read_async(zram, bvec, block, parent, ctxp);
+
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
+
+	ret = zram_bdev_rw_page_punt(zram, page, block, READ);
+	if (!ret) {
+		user_mem = kmap_atomic(bvec->bv_page, KM_USER0);
+		memcpy(user_mem + bvec->bv_offset,
+		       page_address(page) + offset, bvec->bv_len);
+		kunmap_atomic(user_mem, KM_USER0);
+		flush_dcache_page(bvec->bv_page);
+	}
+	__free_page(page);
+
+	return ret;
+}
+
+static int zram_read_before_write_bdev(struct zram *zram, char *mem,
+				       u32 index)
+{
+	int ret;
+	struct page *page;
+
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
+
+	ret = zram_bdev_rw_page_punt(zram, page, zram->table[index].element,
+				     READ);
+	if (!ret)
+		memcpy(mem, page_address(page), PAGE_SIZE);
+	__free_page(page);
+
+	return ret;
+}
+
+/* Called with zram->lock held for writing */
+static void zram_set_wb_page(struct zram *zram, u32 index,
+			     unsigned long block)
+{
+	zram->table[index].element = block;
+	zram_set_flag(zram, index, ZRAM_WB);
+	zram_stat_inc(&zram->stats.pages_wb);
+}
+
+/*
+ * Store an incompressible page on the backing device instead of in
+ * memory. @mem is a lowmem page sized buffer holding the data.
+ */
+static int zram_bvec_write_bdev(struct zram *zram, void *mem, u32 index)
+{
+	int ret;
+	unsigned long block;
+
+	block = zram_alloc_block(zram);
+	if (block == zram->nr_blocks)
+		return -ENOSPC;
+
+	ret = zram_bdev_rw_page_punt(zram, virt_to_page(mem), block, WRITE);
+	if (ret) {
+		zram_free_block(zram, block);
+		return ret;
+	}
+
+	down_write(&zram->lock);
+	handle_pending_slot_free(zram);
+	zram_free_page(zram, index);
+	zram_set_wb_page(zram, index, block);
+	zram_accessed(zram, index);
+	up_write(&zram->lock);
+
+	return 0;
+}
+#else
+static inline void zram_read_ctx_put(struct zram_read_ctx *ctx)
+{
+}
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+static inline int zram_bvec_read_bdev(struct zram *zram,
+		struct bio_vec *bvec, u32 index, int offset,
+		struct bio *parent, struct zram_read_ctx **ctxp)
+{
+	return -EIO;
+}
+
+static inline int zram_read_before_write_bdev(struct zram *zram,
+					      char *mem, u32 index)
+{
+	return -EIO;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static inline int zram_bvec_write_bdev(struct zram *zram, void *mem,
+				       u32 index)
+{
+	return -ENOSPC;
+}
+#endif
+
+static void handle_same_page(struct bio_vec *bvec, unsigned long element)
 {
 	struct page *page = bvec->bv_page;
 	void *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
+	zram_fill_page(user_mem + bvec->bv_offset, bvec->bv_len, element);
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
@@ -194,12 +945,13 @@ static void handle_uncompressed_page(struct zram *zram, struct bio_vec *bvec,
 {
 	struct page *page = bvec->bv_page;
 	unsigned char *user_mem, *cmem;
+	unsigned long handle = zram->table[index].entry->handle;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1);
+	cmem = zs_map_object(zram->mem_pool, handle);
 
 	memcpy(user_mem + bvec->bv_offset, cmem + offset, bvec->bv_len);
-	kunmap_atomic(cmem, KM_USER1);
+	zs_unmap_object(zram->mem_pool, handle);
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
@@ -210,27 +962,35 @@ static inline int is_partial_io(struct bio_vec *bvec)
 	return bvec->bv_len != PAGE_SIZE;
 }
 
-static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
-			  u32 index, int offset, struct bio *bio)
+static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec, u32 index,
+			  int offset, struct bio *bio,
+			  struct zram_read_ctx **ctxp)
 {
 	int ret;
-	size_t clen;
 	struct page *page;
+	struct zram_entry *entry;
 	struct zobj_header *zheader;
 	unsigned char *user_mem, *cmem, *uncmem = NULL;
 
 	page = bvec->bv_page;
 
-	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-		handle_zero_page(bvec);
+	zram_accessed(zram, index);
+
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		handle_same_page(bvec, zram->table[index].element);
 		return 0;
 	}
 
+	if (zram_test_flag(zram, index, ZRAM_WB))
+		return zram_bvec_read_bdev(zram, bvec, index, offset, bio,
+					   ctxp);
+
 	/* Requested page is not present in compressed area */
-	if (unlikely(!zram->table[index].page)) {
+	entry = zram->table[index].entry;
+	if (unlikely(!entry)) {
 		pr_debug("Read before write: sector=%lu, size=%u",
 			 (ulong)(bio->bi_sector), bio->bi_size);
-		handle_zero_page(bvec);
+		handle_same_page(bvec, 0);
 		return 0;
 	}
 
@@ -252,14 +1012,11 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	user_mem = kmap_atomic(page, KM_USER0);
 	if (!is_partial_io(bvec))
 		uncmem = user_mem;
-	clen = PAGE_SIZE;
 
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-		zram->table[index].offset;
+	cmem = zs_map_object(zram->mem_pool, entry->handle);
 
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    xv_get_object_size(cmem) - sizeof(*zheader),
-				    uncmem, &clen);
+	ret = zram_decompress(zram, cmem + sizeof(*zheader), entry->size,
+			      uncmem);
 
 	if (is_partial_io(bvec)) {
 		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
@@ -267,11 +1024,11 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 		kfree(uncmem);
 	}
 
-	kunmap_atomic(cmem, KM_USER1);
+	zs_unmap_object(zram->mem_pool, entry->handle);
 	kunmap_atomic(user_mem, KM_USER0);
 
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 		zram_stat64_inc(zram, &zram->stats.failed_reads);
 		return ret;
@@ -285,33 +1042,39 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
 {
 	int ret;
-	size_t clen = PAGE_SIZE;
+	struct zram_entry *entry;
 	struct zobj_header *zheader;
 	unsigned char *cmem;
 
-	if (zram_test_flag(zram, index, ZRAM_ZERO) ||
-	    !zram->table[index].page) {
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_fill_page(mem, PAGE_SIZE, zram->table[index].element);
+		return 0;
+	}
+
+	if (zram_test_flag(zram, index, ZRAM_WB))
+		return zram_read_before_write_bdev(zram, mem, index);
+
+	entry = zram->table[index].entry;
+	if (!entry) {
 		memset(mem, 0, PAGE_SIZE);
 		return 0;
 	}
 
-	cmem = kmap_atomic(zram->table[index].page, KM_USER0) +
-		zram->table[index].offset;
+	cmem = zs_map_object(zram->mem_pool, entry->handle);
 
 	/* Page is stored uncompressed since it's incompressible */
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		memcpy(mem, cmem, PAGE_SIZE);
-		kunmap_atomic(cmem, KM_USER0);
+		zs_unmap_object(zram->mem_pool, entry->handle);
 		return 0;
 	}
 
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    xv_get_object_size(cmem) - sizeof(*zheader),
-				    mem, &clen);
-	kunmap_atomic(cmem, KM_USER0);
+	ret = zram_decompress(zram, cmem + sizeof(*zheader), entry->size,
+			      mem);
+	zs_unmap_object(zram->mem_pool, entry->handle);
 
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 		zram_stat64_inc(zram, &zram->stats.failed_reads);
 		return ret;
@@ -320,18 +1083,19 @@ static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
 	return 0;
 }
 
-static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
-			   int offset)
+static int __zram_bvec_write(struct zram *zram, struct zram_strm *zstrm,
+			     struct bio_vec *bvec, u32 index, int offset)
 {
 	int ret;
-	u32 store_offset;
-	size_t clen;
+	u32 checksum;
+	unsigned int clen;
+	unsigned long element;
+	struct zram_entry *entry;
 	struct zobj_header *zheader;
-	struct page *page, *page_store;
+	struct page *page;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 
 	page = bvec->bv_page;
-	src = zram->compress_buffer;
 
 	if (is_partial_io(bvec)) {
 		/*
@@ -344,7 +1108,9 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			ret = -ENOMEM;
 			goto out;
 		}
+		down_read(&zram->lock);
 		ret = zram_read_before_write(zram, uncmem, index);
+		up_read(&zram->lock);
 		if (ret) {
 			kfree(uncmem);
 			goto out;
@@ -352,12 +1118,11 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	}
 
 	/*
-	 * System overwrites unused sectors. Free memory associated
-	 * with this sector now.
+	 * Compression runs without zram->lock held so that writers to
+	 * the same device can compress in parallel, each with its own
+	 * stream. The table is only locked to publish the result.
 	 */
-	if (zram->table[index].page ||
-	    zram_test_flag(zram, index, ZRAM_ZERO))
-		zram_free_page(zram, index);
+	src = zstrm->buffer;
 
 	user_mem = kmap_atomic(page, KM_USER0);
 
@@ -367,87 +1132,135 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	else
 		uncmem = user_mem;
 
-	if (page_zero_filled(uncmem)) {
+	if (page_same_filled(uncmem, &element)) {
 		kunmap_atomic(user_mem, KM_USER0);
 		if (is_partial_io(bvec))
 			kfree(uncmem);
-		zram_stat_inc(&zram->stats.pages_zero);
-		zram_set_flag(zram, index, ZRAM_ZERO);
+
+		down_write(&zram->lock);
+		handle_pending_slot_free(zram);
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now.
+		 */
+		zram_free_page(zram, index);
+		if (!element)
+			zram_stat_inc(&zram->stats.pages_zero);
+		zram_stat_inc(&zram->stats.pages_same);
+		zram->table[index].element = element;
+		zram_set_flag(zram, index, ZRAM_SAME);
+		zram_accessed(zram, index);
+		up_write(&zram->lock);
 		ret = 0;
 		goto out;
 	}
 
-	ret = lzo1x_1_compress(uncmem, PAGE_SIZE, src, &clen,
-			       zram->compress_workmem);
+	/* Output buffer is two pages long */
+	clen = 2 * PAGE_SIZE;
+	ret = crypto_comp_compress(zstrm->tfm, uncmem, PAGE_SIZE, src, &clen);
+
+	/*
+	 * Page is incompressible. Store it as-is (uncompressed)
+	 * since we do not want to return too many disk write
+	 * errors which has side effect of hanging the system.
+	 */
+	if (likely(!ret) && unlikely(clen > max_zpage_size)) {
+		clen = PAGE_SIZE;
+		memcpy(src, uncmem, PAGE_SIZE);
+	}
 
 	kunmap_atomic(user_mem, KM_USER0);
 	if (is_partial_io(bvec))
 			kfree(uncmem);
 
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Compression failed! err=%d\n", ret);
 		goto out;
 	}
 
 	/*
-	 * Page is incompressible. Store it as-is (uncompressed)
-	 * since we do not want to return too many disk write
-	 * errors which has side effect of hanging the system.
+	 * Keep incompressible pages out of memory if there is a backing
+	 * device. They stay in memory if it is full or the write fails.
 	 */
-	if (unlikely(clen > max_zpage_size)) {
-		clen = PAGE_SIZE;
-		page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-		if (unlikely(!page_store)) {
-			pr_info("Error allocating memory for "
-				"incompressible page: %u\n", index);
-			ret = -ENOMEM;
-			goto out;
-		}
+	if (clen == PAGE_SIZE && zram_has_backing_dev(zram) &&
+	    !zram_bvec_write_bdev(zram, src, index))
+		return 0;
 
-		store_offset = 0;
-		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_inc(&zram->stats.pages_expand);
-		zram->table[index].page = page_store;
-		src = kmap_atomic(page, KM_USER0);
-		goto memstore;
+	/* Identical pages compress to identical data */
+	checksum = jhash(src, clen, 0);
+
+	/*
+	 * The object is allocated and filled under zram->lock so that
+	 * compaction never sees an object whose entry is not yet
+	 * published.
+	 */
+	down_write(&zram->lock);
+	handle_pending_slot_free(zram);
+
+	entry = zram_entry_match(zram, checksum, src, clen);
+	if (entry) {
+		entry->refcount++;
+		zram_stat64_inc(zram, &zram->stats.dedup_hits);
+		zram_stat64_add(zram, &zram->stats.dup_data_size, clen);
+		goto found;
 	}
 
-	if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-		      &zram->table[index].page, &store_offset,
-		      GFP_NOIO | __GFP_HIGHMEM)) {
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry || zs_malloc(zram->mem_pool, clen == PAGE_SIZE ? clen :
+				clen + sizeof(*zheader), &entry->handle,
+				GFP_NOIO | __GFP_HIGHMEM)) {
+		up_write(&zram->lock);
+		kfree(entry);
 		pr_info("Error allocating memory for compressed "
-			"page: %u, size=%zu\n", index, clen);
+			"page: %u, size=%u\n", index, clen);
 		ret = -ENOMEM;
 		goto out;
 	}
 
-memstore:
-	zram->table[index].offset = store_offset;
+	entry->checksum = checksum;
+	entry->size = clen;
+	entry->refcount = 1;
 
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-		zram->table[index].offset;
+	cmem = zs_map_object(zram->mem_pool, entry->handle);
 
-#if 0
-	/* Back-reference needed for memory defragmentation */
-	if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+	/*
+	 * Back-reference needed for memory compaction. Uncompressed
+	 * pages fill a whole span and are never moved.
+	 */
+	if (likely(clen != PAGE_SIZE)) {
 		zheader = (struct zobj_header *)cmem;
-		zheader->table_idx = index;
+		zheader->entry = entry;
 		cmem += sizeof(*zheader);
 	}
-#endif
 
 	memcpy(cmem, src, clen);
 
-	kunmap_atomic(cmem, KM_USER1);
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-		kunmap_atomic(src, KM_USER0);
+	zs_unmap_object(zram->mem_pool, entry->handle);
 
-	/* Update stats */
+	zram_entry_insert(zram, entry);
 	zram_stat64_add(zram, &zram->stats.compr_size, clen);
+
+found:
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now.
+	 */
+	zram_free_page(zram, index);
+
+	zram->table[index].entry = entry;
+	zram_accessed(zram, index);
+	if (unlikely(clen == PAGE_SIZE)) {
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_stat_inc(&zram->stats.pages_expand);
+	}
+
+	/* Update stats */
 	zram_stat_inc(&zram->stats.pages_stored);
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_inc(&zram->stats.good_compress);
 
+	up_write(&zram->lock);
+
 	return 0;
 
 out:
@@ -456,21 +1269,48 @@ out:
 	return ret;
 }
 
+static int zram_bvec_write(struct zram *zram, struct zram_strm *zstrm,
+			   struct bio_vec *bvec, u32 index, int offset)
+{
+	int ret;
+
+	if (!is_partial_io(bvec))
+		return __zram_bvec_write(zram, zstrm, bvec, index, offset);
+
+	/*
+	 * A partial write merges into the stored page without holding
+	 * zram->lock. Two of them into the same page would each merge
+	 * into the same old copy and one update would be lost. They are
+	 * rare enough, only with unaligned bvecs or pages larger than
+	 * 4K, that one lock per device will do.
+	 */
+	mutex_lock(&zram->rmw_lock);
+	ret = __zram_bvec_write(zram, zstrm, bvec, index, offset);
+	mutex_unlock(&zram->rmw_lock);
+
+	return ret;
+}
+
 static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
-			int offset, struct bio *bio, int rw)
+			int offset, struct bio *bio, int rw,
+			struct zram_read_ctx **ctxp)
 {
 	int ret;
+	struct zram_strm *zstrm;
 
 	if (rw == READ) {
 		down_read(&zram->lock);
-		ret = zram_bvec_read(zram, bvec, index, offset, bio);
+		ret = zram_bvec_read(zram, bvec, index, offset, bio, ctxp);
 		up_read(&zram->lock);
-	} else {
-		down_write(&zram->lock);
-		ret = zram_bvec_write(zram, bvec, index, offset);
-		up_write(&zram->lock);
+		return ret;
 	}
 
+	/* Streams are always taken before zram->lock */
+	zstrm = zram_strm_find(zram);
+	/* zram_bvec_write() takes zram->lock itself */
+	ret = zram_bvec_write(zram, zstrm, bvec, index, offset);
+	zram_strm_release(zram, zstrm);
+
 	return ret;
 }
 
@@ -486,6 +1326,7 @@ static void __zram_make_request(struct zram *zram, struct bio *bio, int rw)
 	int i, offset;
 	u32 index;
 	struct bio_vec *bvec;
+	struct zram_read_ctx *ctx = NULL;
 
 	switch (rw) {
 	case READ:
@@ -513,26 +1354,39 @@ static void __zram_make_request(struct zram *zram, struct bio *bio, int rw)
 			bv.bv_len = max_transfer_size;
 			bv.bv_offset = bvec->bv_offset;
 
-			if (zram_bvec_rw(zram, &bv, index, offset, bio, rw) < 0)
+			if (zram_bvec_rw(zram, &bv, index, offset, bio, rw,
+					 &ctx) < 0)
 				goto out;
 
 			bv.bv_len = bvec->bv_len - max_transfer_size;
 			bv.bv_offset += max_transfer_size;
-			if (zram_bvec_rw(zram, &bv, index+1, 0, bio, rw) < 0)
+			if (zram_bvec_rw(zram, &bv, index+1, 0, bio, rw,
+					 &ctx) < 0)
 				goto out;
 		} else
-			if (zram_bvec_rw(zram, bvec, index, offset, bio, rw)
-			    < 0)
+			if (zram_bvec_rw(zram, bvec, index, offset, bio, rw,
+					 &ctx) < 0)
 				goto out;
 
 		update_position(&index, &offset, bvec);
 	}
 
+	/* Reads from the backing device complete the bio themselves */
+	if (ctx) {
+		zram_read_ctx_put(ctx);
+		return;
+	}
+
 	set_bit(BIO_UPTODATE, &bio->bi_flags);
 	bio_endio(bio, 0);
 	return;
 
 out:
+	if (ctx) {
+		ctx->error = 1;
+		zram_read_ctx_put(ctx);
+		return;
+	}
 	bio_io_error(bio);
 }
 
@@ -576,46 +1430,200 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 	return 0;
 }
 
-void zram_reset_device(struct zram *zram)
+#ifdef CONFIG_ZRAM_WRITEBACK
+int zram_set_backing_dev(struct zram *zram, const char *path)
 {
+	int ret;
+	struct file *file;
+	struct inode *inode;
+	struct block_device *bdev;
+	unsigned long nr_blocks, *bitmap;
+
+	file = filp_open(path, O_RDWR | O_LARGEFILE, 0);
+	if (IS_ERR(file)) {
+		pr_info("Error opening backing device %s\n", path);
+		return PTR_ERR(file);
+	}
+
+	inode = file->f_mapping->host;
+	if (!S_ISBLK(inode->i_mode)) {
+		ret = -ENOTBLK;
+		goto out_close;
+	}
+
+	bdev = blkdev_get_by_dev(inode->i_rdev,
+				 FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (IS_ERR(bdev)) {
+		ret = PTR_ERR(bdev);
+		goto out_close;
+	}
+
+	nr_blocks = i_size_read(inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_blocks) * sizeof(long));
+	if (!nr_blocks || !bitmap) {
+		ret = nr_blocks ? -ENOMEM : -EINVAL;
+		vfree(bitmap);
+		goto out_put;
+	}
+
+	zram_reset_backing_dev(zram);
+
+	zram->backing_dev = file;
+	zram->bdev = bdev;
+	zram->nr_blocks = nr_blocks;
+	zram->bitmap = bitmap;
+
+	pr_info("Using %s as backing device (%lu pages)\n", path, nr_blocks);
+	return 0;
+
+out_put:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out_close:
+	filp_close(file, NULL);
+	return ret;
+}
+
+/* Must only be called while no pages are stored on the backing device */
+void zram_reset_backing_dev(struct zram *zram)
+{
+	if (!zram->backing_dev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	filp_close(zram->backing_dev, NULL);
+	vfree(zram->bitmap);
+
+	zram->backing_dev = NULL;
+	zram->bdev = NULL;
+	zram->bitmap = NULL;
+	zram->nr_blocks = 0;
+}
+
+/*
+ * Move pages from memory to the backing device. Each page is copied
+ * out with zram->lock held and then written without it; the slot is
+ * switched over only if ZRAM_UNDER_WB survived, i.e. it was not freed
+ * or rewritten in the meantime.
+ *
+ * Returns the number of pages written back, or an error.
+ */
+int zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	int ret = 0, count = 0;
 	size_t index;
+	unsigned long block;
+	struct page *page;
+	struct zram_entry *entry;
+	unsigned long idle = zram->idle_threshold * HZ;
+
+	if (!zram_has_backing_dev(zram))
+		return -ENODEV;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		down_write(&zram->lock);
+		handle_pending_slot_free(zram);
+
+		entry = zram->table[index].entry;
+		if (!entry || zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_WB))
+			goto next;
+
+		if (mode == ZRAM_WB_HUGE &&
+		    !zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))
+			goto next;
+
+		if (mode == ZRAM_WB_IDLE && time_before(jiffies,
+					zram->table[index].ac_time + idle))
+			goto next;
+
+		if (zram_read_before_write(zram, page_address(page), index))
+			goto next;
+
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		up_write(&zram->lock);
+
+		block = zram_alloc_block(zram);
+		if (block == zram->nr_blocks)
+			ret = -ENOSPC;
+		else
+			ret = zram_bdev_rw_page(zram, page, block, WRITE);
+
+		down_write(&zram->lock);
+		handle_pending_slot_free(zram);
+		if (!ret && zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			zram_free_page(zram, index);
+			zram_set_wb_page(zram, index, block);
+			count++;
+		} else {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			if (block != zram->nr_blocks)
+				zram_free_block(zram, block);
+		}
+		up_write(&zram->lock);
+
+		if (ret)
+			break;
+
+		cond_resched();
+		continue;
+next:
+		up_write(&zram->lock);
+	}
+
+	__free_page(page);
+
+	return count ? count : ret;
+}
+#endif
+
+void zram_reset_device(struct zram *zram)
+{
+	size_t index, num_pages;
 
 	mutex_lock(&zram->init_lock);
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
+	/* Slots queued by swap_slot_free_notify still reference the table */
+	flush_work(&zram->free_work);
+	handle_pending_slot_free(zram);
 
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free all compression streams and transforms */
+	zram_strm_destroy_all(zram);
+	zram_dtfm_free(zram);
 
-	/* Free all pages that are still in this zram device */
-	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
+	/* No table if zram_init_device() failed before allocating it */
+	num_pages = zram->table ? zram->disksize >> PAGE_SHIFT : 0;
 
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
+	/* Free all pages that are still in this zram device */
+	for (index = 0; index < num_pages; index++) {
+		struct zram_entry *entry = zram->table[index].entry;
 
-		if (!page)
+		if (!entry || zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
+		zram_entry_put(zram, entry);
 	}
+	zram->entry_tree = RB_ROOT;
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	/* Not there yet if zram_init_device() failed */
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
+	/* The backing device stays attached, only its blocks are freed */
+	zram_free_all_blocks(zram);
+
 	zram->disksize = 0;
 	mutex_unlock(&zram->init_lock);
 }
@@ -634,26 +1642,28 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
+	ret = zram_dtfm_alloc(zram);
+	if (ret) {
+		pr_err("Error allocating %s decompression transforms\n",
+			zram->compressor);
 		goto fail;
 	}
 
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	/* Fewer streams than max_strm will do, but not none */
+	zram_strm_grow(zram);
+	if (!zram->avail_strm) {
+		pr_err("Error allocating %s compression stream\n",
+			zram->compressor);
 		ret = -ENOMEM;
 		goto fail;
 	}
 
+	zram->entry_tree = RB_ROOT;
+
 	num_pages = zram->disksize >> PAGE_SHIFT;
 	zram->table = vzalloc(num_pages * sizeof(*zram->table));
 	if (!zram->table) {
 		pr_err("Error allocating zram address table\n");
-		/* To prevent accessing table entries during cleanup */
-		zram->disksize = 0;
 		ret = -ENOMEM;
 		goto fail;
 	}
@@ -663,7 +1673,7 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(zram_obj_migrate, zram);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -687,9 +1697,31 @@ fail:
 void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 {
 	struct zram *zram;
+	struct zram_slot_free *free_rq;
 
 	zram = bdev->bd_disk->private_data;
-	zram_free_page(zram, index);
+
+	/*
+	 * Called under swap_lock, so we cannot sleep on zram->lock.
+	 * If it is contended, queue the slot to be freed later.
+	 */
+	if (down_write_trylock(&zram->lock)) {
+		handle_pending_slot_free(zram);
+		zram_free_page(zram, index);
+		up_write(&zram->lock);
+	} else {
+		free_rq = kmalloc(sizeof(*free_rq), GFP_ATOMIC);
+		if (!free_rq)
+			return;
+
+		free_rq->index = index;
+		spin_lock(&zram->slot_free_lock);
+		free_rq->next = zram->slot_free_rq;
+		zram->slot_free_rq = free_rq;
+		spin_unlock(&zram->slot_free_lock);
+		schedule_work(&zram->free_work);
+	}
+
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -703,9 +1735,26 @@ static int create_device(struct zram *zram, int device_id)
 	int ret = 0;
 
 	init_rwsem(&zram->lock);
+	mutex_init(&zram->rmw_lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
 
+	spin_lock_init(&zram->slot_free_lock);
+	INIT_WORK(&zram->free_work, zram_slot_free_work);
+
+	INIT_LIST_HEAD(&zram->idle_strm);
+	spin_lock_init(&zram->strm_lock);
+	init_waitqueue_head(&zram->strm_wait);
+	/* One stream per CPU lets every core compress concurrently */
+	zram->max_strm = num_possible_cpus();
+	strlcpy(zram->compressor, default_compressor,
+		sizeof(zram->compressor));
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bitmap_lock);
+	INIT_LIST_HEAD(&zram->inflight_reads);
+	zram->idle_threshold = ZRAM_DEFAULT_IDLE_THRESHOLD;
+#endif
+
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
 		pr_err("Error allocating disk queue for device %d\n",
@@ -787,11 +1836,19 @@ static int __init zram_init(void)
 		goto out;
 	}
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_bdev_wq = alloc_workqueue("zram_bdev", WQ_MEM_RECLAIM, 0);
+	if (!zram_bdev_wq) {
+		ret = -ENOMEM;
+		goto out;
+	}
+#endif
+
 	zram_major = register_blkdev(0, "zram");
 	if (zram_major <= 0) {
 		pr_warning("Unable to get major number\n");
 		ret = -EBUSY;
-		goto out;
+		goto free_wq;
 	}
 
 	if (!num_devices) {
@@ -821,6 +1878,10 @@ free_devices:
 	kfree(devices);
 unregister:
 	unregister_blkdev(zram_major, "zram");
+free_wq:
+#ifdef CONFIG_ZRAM_WRITEBACK
+	destroy_workqueue(zram_bdev_wq);
+#endif
 out:
 	return ret;
 }
@@ -836,11 +1897,15 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+		zram_reset_backing_dev(zram);
 	}
 
 	unregister_blkdev(zram_major, "zram");
 
 	kfree(devices);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	destroy_workqueue(zram_bdev_wq);
+#endif
 	pr_debug("Cleanup done!\n");
 }
 
@@ -15,10 +15,14 @@
 #ifndef _ZRAM_DRV_H_
 #define _ZRAM_DRV_H_
 
+#include <linux/crypto.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/rbtree.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,16 +30,16 @@
  */
 static const unsigned max_num_devices = 32;
 
+struct zram_entry;
+
 /*
  * Stored at beginning of each compressed object.
  *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
+ * It stores back-reference to the entry which points to this
+ * object. This is required to support memory compaction.
  */
 struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
+	struct zram_entry *entry;
 };
 
 /*-- Configurable parameters */
@@ -43,6 +47,13 @@ struct zobj_header {
 /* Default zram disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 
+/*
+ * Default compression backend. Any crypto API compression algorithm
+ * listed in zram_backends[] can be selected through sysfs before the
+ * device is initialized.
+ */
+static const char default_compressor[] = "lzo";
+
 /*
  * Pages that compress to size greater than this are stored
  * uncompressed in memory.
@@ -51,10 +62,16 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
+ * otherwise, zs_malloc() would always return failure.
  */
 
+/*
+ * Default age, in seconds, after which an untouched page is written
+ * to the backing device by "idle" writeback.
+ */
+#define ZRAM_DEFAULT_IDLE_THRESHOLD	3600
+
 /*-- End of configurable params */
 
 #define SECTOR_SHIFT		9
@@ -71,18 +88,51 @@ enum zram_pageflags {
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page consists entirely of one repeated word, kept in
+	 * table[page_no].element. Zero filled pages are the common case.
+	 */
+	ZRAM_SAME,
+
+	/*
+	 * Page is stored on the backing device, in the block kept in
+	 * table[page_no].element.
+	 */
+	ZRAM_WB,
+
+	/*
+	 * Page is being copied to the backing device by zram_writeback().
+	 * Cleared when the slot is freed or rewritten meanwhile.
+	 */
+	ZRAM_UNDER_WB,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/*
+ * A stored object, shared by all table entries holding identical
+ * data. Entries are indexed by checksum of their contents.
+ */
+struct zram_entry {
+	struct rb_node rb_node;
+	u32 checksum;
+	unsigned int size;	/* object size, excluding zobj_header */
+	unsigned int refcount;	/* no. of table entries using it */
+	unsigned long handle;	/* zsmalloc object */
+};
+
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	union {
+		struct zram_entry *entry;	/* NULL if none */
+		unsigned long element;		/* for ZRAM_SAME and
+						 * ZRAM_WB pages */
+	};
+#ifdef CONFIG_ZRAM_WRITEBACK
+	unsigned long ac_time;	/* jiffies of last access */
+#endif
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -95,20 +145,81 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
+	u64 pages_compacted;	/* no. of pages freed by compaction */
+	u64 dedup_hits;		/* no. of writes that reused a stored object */
+	u64 dup_data_size;	/* compressed bytes saved by deduplication */
+	u64 bd_reads;		/* no. of pages read from backing device */
+	u64 bd_writes;		/* no. of pages written to backing device */
 	u32 pages_zero;		/* no. of zero filled pages */
+	u32 pages_same;		/* no. of same filled pages, zero included */
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
+	u32 pages_wb;		/* no. of pages on backing device */
+};
+
+/* Swap slot whose free was deferred because zram->lock was contended */
+struct zram_slot_free {
+	unsigned long index;
+	struct zram_slot_free *next;
+};
+
+/*
+ * Tracks a bio whose pages are being read from the backing device.
+ * The bio is completed when the last reference is dropped.
+ */
+struct zram_read_ctx {
+	struct bio *parent;
+	atomic_t pending;
+	int error;
+};
+
+/*
+ * A full page read from the backing device, in flight after
+ * zram->lock has been dropped. Its block stays allocated until the
+ * read completes, even if the page is freed or rewritten meanwhile.
+ */
+struct zram_bd_read {
+	struct zram *zram;
+	struct zram_read_ctx *ctx;
+	unsigned long block;
+	bool freed;		/* block was freed during the read */
+	struct list_head list;	/* on zram->inflight_reads */
+};
+
+/*
+ * Compression stream: private compressor transform and output
+ * buffer used by one writer at a time.
+ */
+struct zram_strm {
+	struct crypto_comp *tfm;
+	void *buffer;
+	struct list_head list;
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	/* Idle compression streams, allocated up front, see max_strm */
+	struct list_head idle_strm;
+	spinlock_t strm_lock;	/* protect idle_strm and avail_strm */
+	wait_queue_head_t strm_wait;
+	int avail_strm;		/* no. of streams currently allocated */
+	int max_strm;		/* no. of streams wanted */
+	/* Per-cpu transforms for decompression, which keeps no state */
+	struct crypto_comp * __percpu *dtfm;
+	char compressor[CRYPTO_MAX_ALG_NAME];	/* crypto API algorithm */
 	struct table *table;
+	struct rb_root entry_tree;	/* stored objects by checksum */
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers and table
-				   * against concurrent read and writes */
+	struct rw_semaphore lock; /* protect table against concurrent
+				   * read and writes; always taken after
+				   * a compression stream */
+	/* Serialize partial writes, see zram_bvec_write() */
+	struct mutex rmw_lock;
+	/* Deferred swap slot frees, see zram_slot_free_notify() */
+	spinlock_t slot_free_lock;
+	struct zram_slot_free *slot_free_rq;
+	struct work_struct free_work;
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -120,6 +231,17 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Optional block device for incompressible and idle pages */
+	struct file *backing_dev;
+	struct block_device *bdev;
+	unsigned long nr_blocks;	/* backing device size in pages */
+	unsigned long *bitmap;		/* blocks in use */
+	struct list_head inflight_reads; /* struct zram_bd_read */
+	spinlock_t bitmap_lock;		/* protect bitmap, inflight_reads */
+	unsigned int idle_threshold;	/* seconds */
+#endif
+
 	struct zram_stats stats;
 };
 
@@ -131,5 +253,22 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern int zram_set_max_strm(struct zram *zram, int max_strm);
+extern unsigned long zram_compact(struct zram *zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+enum zram_wb_mode {
+	ZRAM_WB_HUGE,	/* pages stored uncompressed */
+	ZRAM_WB_IDLE,	/* pages not accessed within idle_threshold */
+};
+
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_reset_backing_dev(struct zram *zram);
+extern int zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+#else
+static inline void zram_reset_backing_dev(struct zram *zram)
+{
+}
+#endif
+extern const char * const zram_backends[];
 
 #endif
@@ -0,0 +1,496 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+/*
+ * Get index of size class serving objects of given size.
+ */
+static u32 get_size_class_index(u32 size)
+{
+	if (unlikely(size < ZS_MIN_ALLOC_SIZE))
+		size = ZS_MIN_ALLOC_SIZE;
+	size = ALIGN(size, ZS_SIZE_CLASS_DELTA);
+	return (size - ZS_MIN_ALLOC_SIZE) / ZS_SIZE_CLASS_DELTA;
+}
+
+/*
+ * Pick the span length (in pages) which wastes the least space at
+ * the tail of the span for objects of given size.
+ */
+static u16 get_pages_per_span(u32 size)
+{
+	int i, max_usedpc = 0;
+	u16 pages_per_span = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_SPAN; i++) {
+		u32 span_size = i * PAGE_SIZE;
+		u32 waste = span_size % size;
+		int usedpc = (span_size - waste) * 100 / span_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			pages_per_span = i;
+		}
+	}
+
+	return pages_per_span;
+}
+
+static unsigned long obj_location_to_handle(struct zs_span *span,
+					unsigned int obj_idx)
+{
+	return (page_to_pfn(span->pages[0]) << OBJ_INDEX_BITS) |
+		((obj_idx + 1) & OBJ_INDEX_MASK);
+}
+
+static struct zs_span *obj_handle_to_location(unsigned long handle,
+					unsigned int *obj_idx)
+{
+	struct page *page = pfn_to_page(handle >> OBJ_INDEX_BITS);
+
+	*obj_idx = (handle & OBJ_INDEX_MASK) - 1;
+	return (struct zs_span *)page_private(page);
+}
+
+/*
+ * Page within the span and offset within that page where object
+ * obj_idx starts.
+ */
+static struct page *obj_idx_to_page(struct size_class *class,
+			struct zs_span *span, unsigned int obj_idx, u32 *offset)
+{
+	unsigned long off = (unsigned long)obj_idx * class->size;
+
+	*offset = off & ~PAGE_MASK;
+	return span->pages[off >> PAGE_SHIFT];
+}
+
+/*
+ * Copy object between a linear buffer and the span. Objects are never
+ * larger than PAGE_SIZE, so they straddle at most two pages.
+ */
+static void obj_copy(struct size_class *class, struct zs_span *span,
+			unsigned int obj_idx, char *buf, int to_span)
+{
+	void *kaddr;
+	u32 offset, len;
+	struct page *page;
+
+	page = obj_idx_to_page(class, span, obj_idx, &offset);
+	len = min_t(u32, class->size, PAGE_SIZE - offset);
+
+	kaddr = kmap_atomic(page, KM_USER1);
+	if (to_span)
+		memcpy(kaddr + offset, buf, len);
+	else
+		memcpy(buf, kaddr + offset, len);
+	kunmap_atomic(kaddr, KM_USER1);
+
+	if (len == class->size)
+		return;
+
+	page = span->pages[page->index + 1];
+	kaddr = kmap_atomic(page, KM_USER1);
+	if (to_span)
+		memcpy(kaddr, buf + len, class->size - len);
+	else
+		memcpy(buf + len, kaddr, class->size - len);
+	kunmap_atomic(kaddr, KM_USER1);
+}
+
+static void free_span(struct zs_pool *pool, struct size_class *class,
+			struct zs_span *span)
+{
+	int i;
+
+	for (i = 0; i < class->pages_per_span; i++) {
+		set_page_private(span->pages[i], 0);
+		span->pages[i]->index = 0;
+		__free_page(span->pages[i]);
+	}
+	atomic_sub(class->pages_per_span, &pool->total_pages);
+	kfree(span);
+}
+
+/*
+ * Allocate a span of pages for given size class.
+ */
+static struct zs_span *alloc_span(struct zs_pool *pool,
+			struct size_class *class, gfp_t flags)
+{
+	int i;
+	struct zs_span *span;
+
+	span = kzalloc(sizeof(*span), flags & ~__GFP_HIGHMEM);
+	if (unlikely(!span))
+		return NULL;
+
+	span->class_idx = class - pool->size_class;
+
+	for (i = 0; i < class->pages_per_span; i++) {
+		struct page *page = alloc_page(flags);
+
+		if (unlikely(!page)) {
+			while (i--) {
+				set_page_private(span->pages[i], 0);
+				span->pages[i]->index = 0;
+				__free_page(span->pages[i]);
+			}
+			kfree(span);
+			return NULL;
+		}
+
+		/* Back-reference used to find the span from a handle */
+		set_page_private(page, (unsigned long)span);
+		page->index = i;
+		span->pages[i] = page;
+	}
+	atomic_add(class->pages_per_span, &pool->total_pages);
+
+	return span;
+}
+
+/*
+ * Create a memory pool. Allocates size classes and per-cpu mapping
+ * areas. @migrate may be NULL in which case the pool is never
+ * compacted.
+ */
+struct zs_pool *zs_create_pool(zs_migrate_fn migrate, void *priv)
+{
+	int i;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->map_area = alloc_percpu(struct zs_map_area);
+	if (!pool->map_area) {
+		kfree(pool);
+		return NULL;
+	}
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_span = get_pages_per_span(class->size);
+		class->objs_per_span = class->pages_per_span * PAGE_SIZE /
+					class->size;
+		spin_lock_init(&class->lock);
+		INIT_LIST_HEAD(&class->partial);
+		INIT_LIST_HEAD(&class->full);
+	}
+
+	pool->migrate = migrate;
+	pool->priv = priv;
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+/*
+ * Free all spans still owned by the pool, then the pool itself.
+ */
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+	struct zs_span *span, *tmp;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		list_for_each_entry_safe(span, tmp, &class->partial, list)
+			free_span(pool, class, span);
+		list_for_each_entry_safe(span, tmp, &class->full, list)
+			free_span(pool, class, span);
+	}
+
+	free_percpu(pool->map_area);
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate object of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of object to allocate
+ * @handle: handle identifying the object
+ *
+ * On success, 0 is returned and @handle identifies the object; use
+ * zs_map_object() to access it. On failure, @handle is set to 0 and
+ * -ENOMEM is returned.
+ *
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE will fail.
+ */
+int zs_malloc(struct zs_pool *pool, u32 size, unsigned long *handle,
+		gfp_t flags)
+{
+	unsigned int obj_idx;
+	struct zs_span *span;
+	struct size_class *class;
+
+	*handle = 0;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return -ENOMEM;
+
+	class = &pool->size_class[get_size_class_index(size)];
+
+	spin_lock(&class->lock);
+
+	if (list_empty(&class->partial)) {
+		spin_unlock(&class->lock);
+		span = alloc_span(pool, class, flags);
+		if (unlikely(!span))
+			return -ENOMEM;
+
+		spin_lock(&class->lock);
+		list_add(&span->list, &class->partial);
+	}
+
+	span = list_first_entry(&class->partial, struct zs_span, list);
+	obj_idx = find_first_zero_bit(span->obj_map, class->objs_per_span);
+	__set_bit(obj_idx, span->obj_map);
+	if (++span->inuse == class->objs_per_span)
+		list_move(&span->list, &class->full);
+
+	spin_unlock(&class->lock);
+
+	*handle = obj_location_to_handle(span, obj_idx);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+/*
+ * Free object identified with handle. The span holding it is
+ * released as soon as its last object is freed.
+ */
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned int obj_idx;
+	struct zs_span *span;
+	struct size_class *class;
+
+	span = obj_handle_to_location(handle, &obj_idx);
+	class = &pool->size_class[span->class_idx];
+
+	spin_lock(&class->lock);
+
+	/* Catch double free bugs */
+	BUG_ON(!test_bit(obj_idx, span->obj_map));
+
+	__clear_bit(obj_idx, span->obj_map);
+	if (span->inuse-- == class->objs_per_span)
+		list_move(&span->list, &class->partial);
+
+	if (!span->inuse) {
+		list_del(&span->list);
+		spin_unlock(&class->lock);
+		free_span(pool, class, span);
+		return;
+	}
+
+	spin_unlock(&class->lock);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ *
+ * Objects lying within a single page are mapped directly; objects
+ * which straddle two pages are copied into a per-cpu buffer and
+ * written back by zs_unmap_object(). Preemption is disabled until
+ * zs_unmap_object() is called, so the caller must not sleep, and
+ * mappings must be released in the reverse order they were taken.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle)
+{
+	u32 offset;
+	unsigned int obj_idx;
+	struct page *page;
+	struct zs_span *span;
+	struct size_class *class;
+	struct zs_map_area *area;
+
+	span = obj_handle_to_location(handle, &obj_idx);
+	class = &pool->size_class[span->class_idx];
+	page = obj_idx_to_page(class, span, obj_idx, &offset);
+
+	area = per_cpu_ptr(pool->map_area, get_cpu());
+
+	if (offset + class->size <= PAGE_SIZE) {
+		area->kaddr = kmap_atomic(page, KM_USER1);
+		return area->kaddr + offset;
+	}
+
+	area->kaddr = NULL;
+	obj_copy(class, span, obj_idx, area->buf, 0);
+
+	return area->buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned int obj_idx;
+	struct zs_span *span;
+	struct size_class *class;
+	struct zs_map_area *area;
+
+	area = this_cpu_ptr(pool->map_area);
+
+	if (area->kaddr) {
+		kunmap_atomic(area->kaddr, KM_USER1);
+	} else {
+		span = obj_handle_to_location(handle, &obj_idx);
+		class = &pool->size_class[span->class_idx];
+		obj_copy(class, span, obj_idx, area->buf, 1);
+	}
+
+	put_cpu();
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * Move objects out of the emptiest partial spans of a class into the
+ * fullest ones, freeing spans that become empty. Returns the number
+ * of pages freed.
+ */
+static unsigned long compact_class(struct zs_pool *pool,
+			struct size_class *class, char *buf)
+{
+	unsigned long freed = 0;
+	unsigned int free_objs, src_idx, dst_idx;
+	struct zs_span *span, *src, *dst;
+
+	spin_lock(&class->lock);
+
+	while (1) {
+		src = dst = NULL;
+		free_objs = 0;
+
+		list_for_each_entry(span, &class->partial, list) {
+			free_objs += class->objs_per_span - span->inuse;
+			if (!src || span->inuse < src->inuse)
+				src = span;
+		}
+
+		list_for_each_entry(span, &class->partial, list) {
+			if (span != src && (!dst || span->inuse > dst->inuse))
+				dst = span;
+		}
+
+		/* Not enough free slots to empty even a single span */
+		if (!dst || free_objs - (class->objs_per_span - src->inuse) <
+		    src->inuse)
+			break;
+
+		while (src->inuse && dst->inuse < class->objs_per_span) {
+			src_idx = find_first_bit(src->obj_map,
+						class->objs_per_span);
+			dst_idx = find_first_zero_bit(dst->obj_map,
+						class->objs_per_span);
+
+			obj_copy(class, src, src_idx, buf, 0);
+			obj_copy(class, dst, dst_idx, buf, 1);
+
+			__set_bit(dst_idx, dst->obj_map);
+			dst->inuse++;
+			__clear_bit(src_idx, src->obj_map);
+			src->inuse--;
+
+			pool->migrate(pool->priv, buf,
+				obj_location_to_handle(dst, dst_idx));
+		}
+
+		if (dst->inuse == class->objs_per_span)
+			list_move(&dst->list, &class->full);
+
+		if (!src->inuse) {
+			list_del(&src->list);
+			free_span(pool, class, src);
+			freed += class->pages_per_span;
+		}
+	}
+
+	spin_unlock(&class->lock);
+
+	return freed;
+}
+
+/**
+ * zs_compact - release sparsely used spans
+ * @pool: pool to compact
+ *
+ * Objects are moved between spans of the same size class and the
+ * pool's migrate callback is invoked for each, with the class lock
+ * held, so that the owner can update its reference to the object.
+ * The caller must ensure no object of the pool is mapped, allocated
+ * or freed concurrently. Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	char *buf;
+	unsigned long freed = 0;
+
+	if (!pool->migrate)
+		return 0;
+
+	buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+	if (!buf)
+		return 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		/* Spans holding a single object are never partial */
+		if (class->objs_per_span > 1)
+			freed += compact_class(pool, class, buf);
+	}
+
+	kfree(buf);
+
+	return freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/*
+ * Returns total memory used by allocator (userdata only; span
+ * descriptors are not counted)
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_read(&pool->total_pages) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
@@ -0,0 +1,87 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mmzone.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/* User configurable params */
+
+/*
+ * Objects are carved out of spans of up to this many 0-order pages.
+ * Objects may straddle page boundaries within a span, so size classes
+ * that do not divide PAGE_SIZE waste at most one object per span.
+ */
+#define ZS_MAX_PAGES_PER_SPAN	4
+
+/* Size classes are separated by ZS_SIZE_CLASS_DELTA bytes */
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) / \
+					ZS_SIZE_CLASS_DELTA + 1)
+
+#define ZS_MAX_OBJS_PER_SPAN	(ZS_MAX_PAGES_PER_SPAN * PAGE_SIZE / \
+					ZS_MIN_ALLOC_SIZE)
+
+/* End of user params */
+
+/*
+ * A handle encodes <PFN of first span page, object index + 1>. The
+ * index is biased so that a valid handle is never zero.
+ */
+#ifdef MAX_PHYSMEM_BITS
+#define _PFN_BITS		(MAX_PHYSMEM_BITS - PAGE_SHIFT)
+#else
+#define _PFN_BITS		(BITS_PER_LONG - PAGE_SHIFT)
+#endif
+#define OBJ_INDEX_BITS		(BITS_PER_LONG - _PFN_BITS)
+#define OBJ_INDEX_MASK		((1UL << OBJ_INDEX_BITS) - 1)
+
+/* Group of pages holding objects of a single size class */
+struct zs_span {
+	struct list_head list;	/* in size_class partial or full list */
+	struct page *pages[ZS_MAX_PAGES_PER_SPAN];
+	u16 class_idx;
+	u16 inuse;		/* no. of allocated objects */
+	unsigned long obj_map[BITS_TO_LONGS(ZS_MAX_OBJS_PER_SPAN)];
+};
+
+struct size_class {
+	spinlock_t lock;
+	u32 size;		/* object size served by this class */
+	u16 pages_per_span;
+	u16 objs_per_span;
+	struct list_head partial;	/* spans with free objects */
+	struct list_head full;
+};
+
+/* Bounce buffer for objects that straddle two pages */
+struct zs_map_area {
+	char buf[ZS_MAX_ALLOC_SIZE];
+	void *kaddr;		/* set if the object is within one page */
+};
+
+struct zs_pool {
+	struct size_class size_class[ZS_SIZE_CLASSES];
+	struct zs_map_area __percpu *map_area;
+	zs_migrate_fn migrate;
+	void *priv;
+	atomic_t total_pages;	/* stats */
+};
+
+#endif
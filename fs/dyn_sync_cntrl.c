@@ -22,9 +22,28 @@
 #include <linux/notifier.h>
 #include <linux/reboot.h>
 #include <linux/writeback.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/mm.h>
+#include "internal.h"
 
-#define DYN_FSYNC_VERSION_MAJOR 1
-#define DYN_FSYNC_VERSION_MINOR 2
+#define DYN_FSYNC_VERSION_MAJOR 2
+#define DYN_FSYNC_VERSION_MINOR 0
+
+/*
+ * While the screen is on, fsync() is not dropped but deferred: the file
+ * is queued and all queued files are synced together once the oldest
+ * has waited dyn_fsync_staleness_ms. Repeated fsyncs of the same file
+ * coalesce into one. Once more than dyn_fsync_byte_budget bytes have
+ * been dirtied since the last group sync, the group is synced right away
+ * and fsync is honored until it has been, which bounds both how old and
+ * how much data can be lost. Processes that set PR_SET_STRICT_FSYNC are never
+ * deferred.
+ */
+#define DYN_FSYNC_MAX_PENDING 128
 
 /*
  * fsync_mutex protects dyn_fsync_active during early suspend / late resume
@@ -35,6 +54,153 @@ static DEFINE_MUTEX(fsync_mutex);
 bool early_suspend_active __read_mostly = false;
 bool dyn_fsync_active __read_mostly = true;
 
+static unsigned int dyn_fsync_staleness_ms __read_mostly = 1000;
+static unsigned long dyn_fsync_byte_budget __read_mostly = 4 << 20;
+
+struct dyn_fsync_entry {
+	struct list_head list;
+	struct file *file;
+	int datasync;
+};
+
+/* dyn_fsync_lock protects the pending list and the dirtied baseline */
+static DEFINE_SPINLOCK(dyn_fsync_lock);
+static LIST_HEAD(dyn_fsync_pending);
+static unsigned int dyn_fsync_nr_pending;
+static unsigned long dyn_fsync_dirtied_base;
+
+/* serializes group syncs, so that a sync returns only once all are done */
+static DEFINE_MUTEX(dyn_fsync_flush_mutex);
+
+static struct {
+	unsigned long deferred;
+	unsigned long coalesced;
+	unsigned long groups;
+	unsigned long budget_flushes;
+} dyn_fsync_stats;
+
+static void dyn_fsync_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(dyn_fsync_work, dyn_fsync_work_fn);
+
+/* Caller must hold dyn_fsync_flush_mutex */
+static void dyn_fsync_sync_list(struct list_head *list)
+{
+	struct dyn_fsync_entry *e, *tmp;
+
+	list_for_each_entry_safe(e, tmp, list, list) {
+		e->file->f_op->fsync(e->file, 0, LLONG_MAX, e->datasync);
+		fput(e->file);
+		kfree(e);
+	}
+}
+
+static void dyn_fsync_flush_pending(void)
+{
+	LIST_HEAD(list);
+
+	mutex_lock(&dyn_fsync_flush_mutex);
+	cancel_delayed_work(&dyn_fsync_work);
+
+	spin_lock(&dyn_fsync_lock);
+	list_splice_init(&dyn_fsync_pending, &list);
+	dyn_fsync_nr_pending = 0;
+	dyn_fsync_dirtied_base = global_page_state(NR_DIRTIED);
+	spin_unlock(&dyn_fsync_lock);
+
+	if (!list_empty(&list))
+		dyn_fsync_stats.groups++;
+
+	dyn_fsync_sync_list(&list);
+	mutex_unlock(&dyn_fsync_flush_mutex);
+}
+
+/*
+ * Called by do_umount() and by do_remount_sb() going read-only. Queued
+ * files hold references to their mount and are open for writing, so
+ * sync and release those of @sb now rather than fail with -EBUSY.
+ */
+void dyn_fsync_flush_sb(struct super_block *sb)
+{
+	struct dyn_fsync_entry *e, *tmp;
+	LIST_HEAD(list);
+
+	mutex_lock(&dyn_fsync_flush_mutex);
+	spin_lock(&dyn_fsync_lock);
+	list_for_each_entry_safe(e, tmp, &dyn_fsync_pending, list) {
+		if (e->file->f_path.dentry->d_sb != sb)
+			continue;
+		list_move_tail(&e->list, &list);
+		dyn_fsync_nr_pending--;
+	}
+	spin_unlock(&dyn_fsync_lock);
+
+	dyn_fsync_sync_list(&list);
+	mutex_unlock(&dyn_fsync_flush_mutex);
+}
+
+static void dyn_fsync_work_fn(struct work_struct *work)
+{
+	dyn_fsync_flush_pending();
+}
+
+/*
+ * Called by vfs_fsync_range() while fsync is dynamic. Returns true if
+ * the sync of @file was queued, false if the caller must sync it now.
+ */
+bool dyn_fsync_defer(struct file *file, int datasync)
+{
+	struct dyn_fsync_entry *e, *new;
+	unsigned long dirtied;
+
+	if (current->strict_fsync || !dyn_fsync_staleness_ms)
+		return false;
+
+	dirtied = global_page_state(NR_DIRTIED) - dyn_fsync_dirtied_base;
+	if (dyn_fsync_byte_budget &&
+	    dirtied > dyn_fsync_byte_budget >> PAGE_SHIFT) {
+		/*
+		 * The caller may hold locks the group sync needs, so leave
+		 * that to the worker.
+		 */
+		dyn_fsync_stats.budget_flushes++;
+		cancel_delayed_work(&dyn_fsync_work);
+		queue_delayed_work(system_long_wq, &dyn_fsync_work, 0);
+		return false;
+	}
+
+	new = kmalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return false;
+
+	spin_lock(&dyn_fsync_lock);
+	list_for_each_entry(e, &dyn_fsync_pending, list) {
+		if (e->file->f_mapping == file->f_mapping) {
+			e->datasync &= datasync;
+			dyn_fsync_stats.coalesced++;
+			spin_unlock(&dyn_fsync_lock);
+			kfree(new);
+			return true;
+		}
+	}
+	if (dyn_fsync_nr_pending >= DYN_FSYNC_MAX_PENDING) {
+		spin_unlock(&dyn_fsync_lock);
+		kfree(new);
+		return false;
+	}
+
+	get_file(file);
+	new->file = file;
+	new->datasync = datasync;
+	list_add_tail(&new->list, &dyn_fsync_pending);
+	dyn_fsync_stats.deferred++;
+	if (dyn_fsync_nr_pending++ == 0)
+		queue_delayed_work(system_long_wq, &dyn_fsync_work,
+			msecs_to_jiffies(dyn_fsync_staleness_ms));
+	spin_unlock(&dyn_fsync_lock);
+
+	return true;
+}
+
 static ssize_t dyn_fsync_active_show(struct kobject *kobj,
 		struct kobj_attribute *attr, char *buf)
 {
@@ -54,6 +220,7 @@ static ssize_t dyn_fsync_active_store(struct kobject *kobj,
 		else if (data == 0) {
 			pr_info("%s: dyanamic fsync disabled\n", __FUNCTION__);
 			dyn_fsync_active = false;
+			dyn_fsync_flush_pending();
 		}
 		else
 			pr_info("%s: bad value: %u\n", __FUNCTION__, data);
@@ -63,6 +230,56 @@ static ssize_t dyn_fsync_active_store(struct kobject *kobj,
 	return count;
 }
 
+static ssize_t dyn_fsync_staleness_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", dyn_fsync_staleness_ms);
+}
+
+static ssize_t dyn_fsync_staleness_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int data;
+
+	if (sscanf(buf, "%u\n", &data) == 1) {
+		dyn_fsync_staleness_ms = data;
+		if (!data)
+			dyn_fsync_flush_pending();
+	} else
+		pr_info("%s: unknown input!\n", __FUNCTION__);
+
+	return count;
+}
+
+static ssize_t dyn_fsync_byte_budget_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", dyn_fsync_byte_budget);
+}
+
+static ssize_t dyn_fsync_byte_budget_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned long data;
+
+	if (sscanf(buf, "%lu\n", &data) == 1)
+		dyn_fsync_byte_budget = data;
+	else
+		pr_info("%s: unknown input!\n", __FUNCTION__);
+
+	return count;
+}
+
+static ssize_t dyn_fsync_stats_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "deferred: %lu\ncoalesced: %lu\n"
+			"group syncs: %lu\nbudget syncs: %lu\npending: %u\n",
+		dyn_fsync_stats.deferred, dyn_fsync_stats.coalesced,
+		dyn_fsync_stats.groups, dyn_fsync_stats.budget_flushes,
+		dyn_fsync_nr_pending);
+}
+
 static ssize_t dyn_fsync_version_show(struct kobject *kobj,
 		struct kobj_attribute *attr, char *buf)
 {
@@ -82,6 +299,19 @@ static struct kobj_attribute dyn_fsync_active_attribute =
 		dyn_fsync_active_show,
 		dyn_fsync_active_store);
 
+static struct kobj_attribute dyn_fsync_staleness_attribute =
+	__ATTR(Dyn_fsync_staleness_ms, 0644,
+		dyn_fsync_staleness_show,
+		dyn_fsync_staleness_store);
+
+static struct kobj_attribute dyn_fsync_byte_budget_attribute =
+	__ATTR(Dyn_fsync_byte_budget, 0644,
+		dyn_fsync_byte_budget_show,
+		dyn_fsync_byte_budget_store);
+
+static struct kobj_attribute dyn_fsync_stats_attribute =
+	__ATTR(Dyn_fsync_stats, 0444, dyn_fsync_stats_show, NULL);
+
 static struct kobj_attribute dyn_fsync_version_attribute = 
 	__ATTR(Dyn_fsync_version, 0444, dyn_fsync_version_show, NULL);
 
@@ -91,6 +321,9 @@ static struct kobj_attribute dyn_fsync_earlysuspend_attribute =
 static struct attribute *dyn_fsync_active_attrs[] =
 	{
 		&dyn_fsync_active_attribute.attr,
+		&dyn_fsync_staleness_attribute.attr,
+		&dyn_fsync_byte_budget_attribute.attr,
+		&dyn_fsync_stats_attribute.attr,
 		&dyn_fsync_version_attribute.attr,
 		&dyn_fsync_earlysuspend_attribute.attr,
 		NULL,
@@ -116,6 +349,7 @@ static void dyn_fsync_early_suspend(struct early_suspend *h)
 	mutex_lock(&fsync_mutex);
 	if (dyn_fsync_active) {
 		early_suspend_active = true;
+		dyn_fsync_flush_pending();
 		dyn_fsync_force_flush();
 	}
 	mutex_unlock(&fsync_mutex);
@@ -155,6 +389,7 @@ static int dyn_fsync_notify_sys(struct notifier_block *this, unsigned long code,
 {
 	if (code == SYS_DOWN || code == SYS_HALT) {
 		early_suspend_active = true;
+		dyn_fsync_flush_pending();
 		dyn_fsync_force_flush();
 		//pr_warn("dyn fsync: reboot: force flush!\n");
 	}
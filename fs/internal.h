@@ -141,3 +141,10 @@ extern int invalidate_inodes(struct super_block *, bool);
  * dcache.c
  */
 extern struct dentry *__d_alloc(struct super_block *, const struct qstr *);
+
+/*
+ * dyn_sync_cntrl.c
+ */
+#ifdef CONFIG_DYNAMIC_FSYNC
+extern void dyn_fsync_flush_sb(struct super_block *);
+#endif
@@ -1268,6 +1268,11 @@ static int do_umount(struct vfsmount *mnt, int flags)
 	if (retval)
 		return retval;
 
+#ifdef CONFIG_DYNAMIC_FSYNC
+	/* deferred fsyncs pin their files, and with them the mount */
+	dyn_fsync_flush_sb(sb);
+#endif
+
 	/*
 	 * Allow userspace to request a mountpoint be expired rather than
 	 * unmounting unconditionally. Unmount only happens if:
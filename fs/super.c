@@ -719,6 +719,10 @@ int do_remount_sb(struct super_block *sb, int flags, void *data, int force)
 	/* If we are remounting RDONLY and current sb is read/write,
 	   make sure there are no rw files opened */
 	if (remount_ro) {
+#ifdef CONFIG_DYNAMIC_FSYNC
+		/* deferred fsyncs hold their files open for writing */
+		dyn_fsync_flush_sb(sb);
+#endif
 		if (force)
 			mark_files_ro(sb);
 		else if (!fs_may_remount_ro(sb))
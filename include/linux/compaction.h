@@ -18,6 +18,20 @@ extern int sysctl_compaction_handler(struct ctl_table *table, int write,
 extern int sysctl_extfrag_threshold;
 extern int sysctl_extfrag_handler(struct ctl_table *table, int write,
 			void __user *buffer, size_t *length, loff_t *ppos);
+extern int sysctl_compaction_proactive_order;
+extern int sysctl_compaction_proactive_threshold;
+extern int sysctl_compaction_proactive_interval_ms;
+extern int sysctl_compaction_proactive_budget_ms;
+extern int sysctl_compaction_proactive_handler(struct ctl_table *table,
+			int write, void __user *buffer, size_t *length,
+			loff_t *ppos);
+
+/* Orders whose average free block counts /proc/vmstat shows */
+#define KCOMPACTD_AVG_ORDERS	11
+
+extern int kcompactd_run(int nid);
+extern void kcompactd_stop(int nid);
+extern void kcompactd_free_avg(unsigned long *avg);
 
 extern int fragmentation_index(struct zone *zone, unsigned int order);
 extern unsigned long try_to_compact_pages(struct zonelist *zonelist,
@@ -84,6 +98,15 @@ static inline bool compaction_deferred(struct zone *zone)
 	return 1;
 }
 
+static inline int kcompactd_run(int nid)
+{
+	return 0;
+}
+
+static inline void kcompactd_stop(int nid)
+{
+}
+
 #endif /* CONFIG_COMPACTION */
 
 #if defined(CONFIG_COMPACTION) && defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
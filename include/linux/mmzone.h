@@ -15,6 +15,7 @@
 #include <linux/seqlock.h>
 #include <linux/nodemask.h>
 #include <linux/pageblock-flags.h>
+#include <linux/shrinker.h>
 #include <generated/bounds.h>
 #include <linux/atomic.h>
 #include <asm/page.h>
@@ -175,6 +176,12 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * Highest order kept on the per-cpu lists, besides order 0. Orders up to
+ * PAGE_ALLOC_COSTLY_ORDER are those the allocator tries hard to satisfy.
+ */
+#define PCP_MAX_ORDER	PAGE_ALLOC_COSTLY_ORDER
+
 struct per_cpu_pages {
 	int count;		/* number of pages in the list */
 	int high;		/* high watermark, emptying needed */
@@ -182,8 +189,22 @@ struct per_cpu_pages {
 
 	/* Lists of pages, one per migrate type stored on the pcp-lists */
 	struct list_head lists[MIGRATE_PCPTYPES];
+
+	/* Blocks of order 1 to PCP_MAX_ORDER, sized from batch */
+	int order_count[PCP_MAX_ORDER];
+	struct list_head order_lists[PCP_MAX_ORDER][MIGRATE_PCPTYPES];
 };
 
+/* Number of blocks of order 1 and higher on the per-cpu lists */
+static inline int pcp_order_blocks(struct per_cpu_pages *pcp)
+{
+	int i, blocks = 0;
+
+	for (i = 0; i < PCP_MAX_ORDER; i++)
+		blocks += pcp->order_count[i];
+	return blocks;
+}
+
 struct per_cpu_pageset {
 	struct per_cpu_pages pcp;
 #ifdef CONFIG_NUMA
@@ -340,6 +361,15 @@ struct zone {
 	 */
 	unsigned int		compact_considered;
 	unsigned int		compact_defer_shift;
+
+	/*
+	 * Where kcompactd's last run in this zone stopped, and how many
+	 * of its intervals to skip the zone for after a failed full pass.
+	 */
+	unsigned long		compact_resume_migrate_pfn;
+	unsigned long		compact_resume_free_pfn;
+	unsigned int		kcompactd_skip;
+	unsigned int		kcompactd_defer_shift;
 #endif
 
 	ZONE_PADDING(_pad1_)
@@ -420,6 +450,9 @@ struct zone {
 	 * rarely used fields:
 	 */
 	const char		*name;
+
+	/* time spent in shrink_zone() by direct reclaim, per cpu */
+	struct reclaim_lat __percpu *direct_reclaim_lat;
 } ____cacheline_internodealigned_in_smp;
 
 typedef enum {
@@ -642,6 +675,13 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+	bool kcompactd_wake;
+	/* free blocks of each order, averaged over kcompactd's intervals */
+	unsigned long kcompactd_free_avg[MAX_ORDER];
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
@@ -779,6 +819,8 @@ int lowmem_reserve_ratio_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
 int percpu_pagelist_fraction_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
+int percpu_pagelist_max_order_sysctl_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
 int sysctl_min_unmapped_ratio_sysctl_handler(struct ctl_table *, int,
 			void __user *, size_t *, loff_t *);
 int sysctl_min_slab_ratio_sysctl_handler(struct ctl_table *, int,
@@ -66,6 +66,32 @@ static inline void oom_killer_enable(void)
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+#ifdef CONFIG_OOM_ADJ_INDEX
+#define OOM_ADJ_INDEX_SIZE	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+extern struct hlist_head oom_adj_index[OOM_ADJ_INDEX_SIZE];
+extern spinlock_t oom_adj_index_lock;
+
+/* Thread group leaders with signal->oom_adj == @oom_adj */
+static inline struct hlist_head *oom_adj_index_head(int oom_adj)
+{
+	return &oom_adj_index[clamp(oom_adj, OOM_DISABLE, OOM_ADJUST_MAX) -
+			      OOM_DISABLE];
+}
+
+extern void oom_adj_index_add(struct task_struct *p);
+extern void oom_adj_index_del(struct task_struct *p);
+extern void oom_adj_index_replace(struct task_struct *old,
+				  struct task_struct *new);
+extern void oom_adj_index_update(struct task_struct *p);
+#else
+static inline void oom_adj_index_add(struct task_struct *p) {}
+static inline void oom_adj_index_del(struct task_struct *p) {}
+static inline void oom_adj_index_replace(struct task_struct *old,
+					 struct task_struct *new) {}
+static inline void oom_adj_index_update(struct task_struct *p) {}
+#endif
+
 /* sysctls */
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
@@ -108,4 +108,11 @@
  */
 #define PR_GET_EFFECTIVE_TIMERSLACK 35
 
+/*
+ * Exempt the calling process and its children from fsync deferral by
+ * CONFIG_DYNAMIC_FSYNC, for databases that need strict durability.
+ */
+#define PR_SET_STRICT_FSYNC	0x53465359	/* 'SFSY' */
+#define PR_GET_STRICT_FSYNC	0x47465359	/* 'GFSY' */
+
 #endif /* _LINUX_PRCTL_H */
@@ -140,6 +140,7 @@ extern unsigned long nr_running(void);
 extern unsigned long nr_uninterruptible(void);
 extern unsigned long nr_iowait(void);
 extern unsigned long avg_nr_running(void);
+extern unsigned long avg_nr_running_cpu(int cpu);
 extern unsigned long nr_iowait_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
 
@@ -1278,6 +1279,9 @@ struct task_struct {
 #endif
 
 	struct list_head tasks;
+#ifdef CONFIG_OOM_ADJ_INDEX
+	struct hlist_node oom_adj_node;	/* group leaders only */
+#endif
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
 #endif
@@ -1300,6 +1304,7 @@ struct task_struct {
 	unsigned in_execve:1;	/* Tell the LSMs that the process is doing an
 				 * execve */
 	unsigned in_iowait:1;
+	unsigned strict_fsync:1;	/* fsync is never deferred */
 
 
 	/* Revert to default priority/policy when forking */
@@ -1,6 +1,8 @@
 #ifndef _LINUX_SHRINKER_H
 #define _LINUX_SHRINKER_H
 
+#include <linux/types.h>
+
 /*
  * This struct is used to pass information from page reclaim to the shrinkers.
  * We consolidate the values for easier extention later.
@@ -12,6 +14,23 @@ struct shrink_control {
 	unsigned long nr_to_scan;
 };
 
+/*
+ * Reclaim latency histogram: bucket i counts calls that took less than
+ * 2^i microseconds, the last bucket all longer ones. nr_scanned and
+ * nr_reclaimed count pages for zones and direct reclaim, and objects for
+ * shrinkers. Kept by mm/vmscan.c and shown in /proc/reclaimstat.
+ */
+#define RECLAIM_LAT_BUCKETS 20
+
+struct reclaim_lat {
+	u32 bucket[RECLAIM_LAT_BUCKETS];
+	u32 count;
+	u32 max_us;
+	u64 total_us;
+	unsigned long nr_scanned;
+	unsigned long nr_reclaimed;
+};
+
 /*
  * A callback you can register to apply pressure to ageable caches.
  *
@@ -36,6 +55,7 @@ struct shrinker {
 	/* These are for internal use */
 	struct list_head list;
 	long nr;	/* objs pending delete */
+	struct reclaim_lat __percpu *lat; /* time spent in shrink_slab() */
 };
 #define DEFAULT_SEEKS 2 /* A good number if you don't know better. */
 extern void register_shrinker(struct shrinker *);
@@ -0,0 +1,38 @@
+#ifndef __LINUX_VMPRESSURE_H
+#define __LINUX_VMPRESSURE_H
+
+#include <linux/gfp.h>
+#include <linux/notifier.h>
+
+enum vmpressure_levels {
+	VMPRESSURE_LOW = 0,
+	VMPRESSURE_MEDIUM,
+	VMPRESSURE_CRITICAL,
+	VMPRESSURE_NUM_LEVELS,
+};
+
+/*
+ * Notifiers are called from process context with the new level as the
+ * action and a pointer to the pressure in percent (unsigned int) as data.
+ */
+#ifdef CONFIG_VMPRESSURE
+extern void vmpressure(gfp_t gfp, unsigned long scanned,
+		       unsigned long reclaimed);
+extern void vmpressure_prio(gfp_t gfp, int prio);
+extern int vmpressure_register_notifier(struct notifier_block *nb);
+extern int vmpressure_unregister_notifier(struct notifier_block *nb);
+#else
+static inline void vmpressure(gfp_t gfp, unsigned long scanned,
+			      unsigned long reclaimed) {}
+static inline void vmpressure_prio(gfp_t gfp, int prio) {}
+static inline int vmpressure_register_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+static inline int vmpressure_unregister_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+#endif /* CONFIG_VMPRESSURE */
+
+#endif /* __LINUX_VMPRESSURE_H */
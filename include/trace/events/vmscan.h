@@ -179,6 +179,68 @@ DEFINE_EVENT(mm_vmscan_direct_reclaim_end_template, mm_vmscan_memcg_softlimit_re
 	TP_ARGS(nr_reclaimed)
 );
 
+TRACE_EVENT(mm_vmscan_direct_reclaim_latency,
+
+	TP_PROTO(int order, unsigned long nr_scanned,
+		unsigned long nr_reclaimed, u32 delta_us),
+
+	TP_ARGS(order, nr_scanned, nr_reclaimed, delta_us),
+
+	TP_STRUCT__entry(
+		__field(	int,		order		)
+		__field(	unsigned long,	nr_scanned	)
+		__field(	unsigned long,	nr_reclaimed	)
+		__field(	u32,		delta_us	)
+	),
+
+	TP_fast_assign(
+		__entry->order		= order;
+		__entry->nr_scanned	= nr_scanned;
+		__entry->nr_reclaimed	= nr_reclaimed;
+		__entry->delta_us	= delta_us;
+	),
+
+	TP_printk("order=%d nr_scanned=%lu nr_reclaimed=%lu delta_us=%u",
+		__entry->order,
+		__entry->nr_scanned,
+		__entry->nr_reclaimed,
+		__entry->delta_us)
+);
+
+TRACE_EVENT(mm_vmscan_direct_shrink_zone,
+
+	TP_PROTO(int nid, int zid, int priority, unsigned long nr_scanned,
+		unsigned long nr_reclaimed, u32 delta_us),
+
+	TP_ARGS(nid, zid, priority, nr_scanned, nr_reclaimed, delta_us),
+
+	TP_STRUCT__entry(
+		__field(	int,		nid		)
+		__field(	int,		zid		)
+		__field(	int,		priority	)
+		__field(	unsigned long,	nr_scanned	)
+		__field(	unsigned long,	nr_reclaimed	)
+		__field(	u32,		delta_us	)
+	),
+
+	TP_fast_assign(
+		__entry->nid		= nid;
+		__entry->zid		= zid;
+		__entry->priority	= priority;
+		__entry->nr_scanned	= nr_scanned;
+		__entry->nr_reclaimed	= nr_reclaimed;
+		__entry->delta_us	= delta_us;
+	),
+
+	TP_printk("nid=%d zid=%d priority=%d nr_scanned=%lu nr_reclaimed=%lu delta_us=%u",
+		__entry->nid,
+		__entry->zid,
+		__entry->priority,
+		__entry->nr_scanned,
+		__entry->nr_reclaimed,
+		__entry->delta_us)
+);
+
 TRACE_EVENT(mm_shrink_slab_start,
 	TP_PROTO(struct shrinker *shr, struct shrink_control *sc,
 		long nr_objects_to_shrink, unsigned long pgs_scanned,
@@ -226,9 +288,11 @@ TRACE_EVENT(mm_shrink_slab_start,
 
 TRACE_EVENT(mm_shrink_slab_end,
 	TP_PROTO(struct shrinker *shr, int shrinker_retval,
-		long unused_scan_cnt, long new_scan_cnt),
+		long unused_scan_cnt, long new_scan_cnt,
+		unsigned long freed, u32 delta_us),
 
-	TP_ARGS(shr, shrinker_retval, unused_scan_cnt, new_scan_cnt),
+	TP_ARGS(shr, shrinker_retval, unused_scan_cnt, new_scan_cnt,
+		freed, delta_us),
 
 	TP_STRUCT__entry(
 		__field(struct shrinker *, shr)
@@ -237,6 +301,8 @@ TRACE_EVENT(mm_shrink_slab_end,
 		__field(long, new_scan)
 		__field(int, retval)
 		__field(long, total_scan)
+		__field(unsigned long, freed)
+		__field(u32, delta_us)
 	),
 
 	TP_fast_assign(
@@ -246,15 +312,19 @@ TRACE_EVENT(mm_shrink_slab_end,
 		__entry->new_scan = new_scan_cnt;
 		__entry->retval = shrinker_retval;
 		__entry->total_scan = new_scan_cnt - unused_scan_cnt;
+		__entry->freed = freed;
+		__entry->delta_us = delta_us;
 	),
 
-	TP_printk("%pF %p: unused scan count %ld new scan count %ld total_scan %ld last shrinker return val %d",
+	TP_printk("%pF %p: unused scan count %ld new scan count %ld total_scan %ld last shrinker return val %d freed %lu delta_us %u",
 		__entry->shrink,
 		__entry->shr,
 		__entry->unused_scan,
 		__entry->new_scan,
 		__entry->total_scan,
-		__entry->retval)
+		__entry->retval,
+		__entry->freed,
+		__entry->delta_us)
 );
 
 DECLARE_EVENT_CLASS(mm_vmscan_lru_isolate_template,
@@ -34,15 +34,18 @@
 #include <linux/bug.h>
 #include <linux/smp.h>
 #include <linux/slab.h>
+#include <linux/log2.h>
 #include <linux/ctype.h>
 #include <linux/sched.h>
 #include <linux/types.h>
+#include <linux/ktime.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/percpu.h>
 #include <linux/stddef.h>
 #include <linux/string.h>
 #include <linux/preempt.h>
+#include <linux/hardirq.h>
 #include <linux/uaccess.h>
 #include <linux/compiler.h>
 #include <linux/irqflags.h>
@@ -112,6 +115,7 @@ struct rcu_data {
        struct rcu_list cblist[2]; /* current & previous callback lists */
 		raw_spinlock_t lock;	/* protects the above callback lists */
        s64 nqueued;            /* #callbacks queued (stats-n-debug) */
+       int maxqueued;          /* deepest current list seen (stats) */
 } ____cacheline_aligned_in_smp;
 
 static struct rcu_data rcu_data[NR_CPUS];
@@ -126,8 +130,40 @@ static struct rcu_stats {
        atomic_t nsyncs;        /* #rcu syncs processed */
        s64 ninvoked;           /* #invoked (ie, finished) callbacks */
        unsigned nforced;       /* #forced eobs (should be zero) */
+       unsigned nfloods;       /* #times flood mode was entered */
 } rcu_stats;
 
+/*
+ * Grace period (end-of-batch to end-of-batch) and synchronize_sched()
+ * latency histograms.  Bucket n counts durations of [2^n, 2^(n+1)) usecs,
+ * the last bucket everything longer.
+ */
+#define RCU_HIST_BUCKETS       24
+
+static unsigned rcu_gp_hist[RCU_HIST_BUCKETS];
+static unsigned rcu_gp_max_us;
+static ktime_t rcu_gp_start;
+static atomic_t rcu_sync_hist[RCU_HIST_BUCKETS];
+
+static inline int rcu_hist_bucket(s64 us)
+{
+       if (us <= 1)
+               return 0;
+       return min_t(int, ilog2(us), RCU_HIST_BUCKETS - 1);
+}
+
+/*
+ * Callback floods (mass close(), dentry teardown) are absorbed by flood
+ * mode: once any cpu has more than rcu_flood_thresh callbacks queued,
+ * batches are delimited every rcu_flood_period_us instead of every
+ * RCU_HZ period, and the daemon yields the cpu while invoking them.
+ * Flood mode ends at the first end-of-batch that finds every cpu below
+ * half the threshold.
+ */
+static int rcu_flood_thresh = 1000;
+static int rcu_flood_period_us = 1000;
+static int rcu_flood __read_mostly;
+
 #define RCU_HZ                 (20)
 #define RCU_HZ_PERIOD_US       (USEC_PER_SEC / RCU_HZ)
 #define RCU_HZ_DELTA_US                (USEC_PER_SEC / HZ)
@@ -137,6 +173,11 @@ static int rcu_hz_delta_us = RCU_HZ_DELTA_US;
 
 static int rcu_hz_precise;
 
+static inline int rcu_period_us(void)
+{
+       return rcu_flood ? rcu_flood_period_us : rcu_hz_period_us;
+}
+
 int rcu_scheduler_active __read_mostly;
 int rcu_nmi_seen __read_mostly;
 
@@ -204,15 +245,18 @@ EXPORT_SYMBOL(rcu_note_might_resched);
 void synchronize_sched(void)
 {
        struct rcu_synchronize rcu;
+       ktime_t start;
 
        if (!rcu_scheduler_active)
                return;
 
+       start = ktime_get();
        init_completion(&rcu.completion);
        call_rcu(&rcu.head, wakeme_after_rcu);
        wait_for_completion(&rcu.completion);
        atomic_inc(&rcu_stats.nsyncs);
-
+       atomic_inc(&rcu_sync_hist[rcu_hist_bucket(
+               ktime_us_delta(ktime_get(), start))]);
 }
 EXPORT_SYMBOL_GPL(synchronize_sched);
 
@@ -229,6 +273,12 @@ void rcu_force_quiescent_state(void)
 }
 EXPORT_SYMBOL_GPL(rcu_force_quiescent_state);
 
+long rcu_batches_completed(void)
+{
+       return rcu_stats.nbatches;
+}
+EXPORT_SYMBOL_GPL(rcu_batches_completed);
+
 
 /*
  * Insert an RCU callback onto the calling CPUs list of 'current batch'
@@ -255,7 +305,15 @@ void call_rcu_sched(struct rcu_head *cb, void (*func)(struct rcu_head *rcu))
         * cannot be invoked under NMI. */
        rcu_list_add(cblist, cb);
        rd->nqueued++;
+       if (unlikely(cblist->count > rd->maxqueued))
+               rd->maxqueued = cblist->count;
 	raw_spin_unlock(&rd->lock);
+
+       /* Picked up by the next pass; waking anyone here is not safe. */
+       if (unlikely(cblist->count > rcu_flood_thresh) && !rcu_flood) {
+               rcu_flood = 1;
+               rcu_stats.nfloods++;
+       }
        raw_local_irq_restore(flags);
 }
 EXPORT_SYMBOL_GPL(call_rcu_sched);
@@ -266,6 +324,8 @@ EXPORT_SYMBOL_GPL(call_rcu_sched);
 static void rcu_invoke_callbacks(struct rcu_list *pending)
 {
        struct rcu_head *curr, *next;
+       int yield = rcu_flood && !in_interrupt();
+       unsigned n = 0;
 
        for (curr = pending->head; curr;) {
                unsigned long offset = (unsigned long)curr->func;
@@ -276,6 +336,8 @@ static void rcu_invoke_callbacks(struct rcu_list *pending)
                        curr->func(curr);
                curr = next;
                rcu_stats.ninvoked++;
+               if (yield && !(++n & 63))
+                       cond_resched();
        }
 }
 
@@ -295,7 +357,9 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
 {
        struct rcu_data *rd;
        struct rcu_list *plist;
-       int cpu, eob, prev;
+       int cpu, eob, prev, depth;
+       ktime_t now;
+       s64 gp_us;
 
        if (!rcu_scheduler_active)
                return;
@@ -340,7 +404,7 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
                                        force_cpu_resched(cpu);
                        }
                }
-               rcu_wdog_ctr += rcu_hz_period_us;
+               rcu_wdog_ctr += rcu_period_us();
                return;
        }
 
@@ -357,10 +421,12 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
         * however, cannot exceed one RCU_HZ period.
         */
        prev = ACCESS_ONCE(rcu_which) ^ 1;
+       depth = 0;
 
        for_each_present_cpu(cpu) {
                rd = &rcu_data[cpu];
                plist = &rd->cblist[prev];
+               depth = max(depth, rd->cblist[prev ^ 1].count);
 		raw_spin_lock(&rd->lock);
                /* Chain previous batch of callbacks, if any, to the pending list */
                if (plist->head) {
@@ -386,6 +452,18 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
        rcu_stats.nbatches++;
        rcu_stats.nlast = 0;
        rcu_wdog_ctr = 0;
+
+       now = ktime_get();
+       if (rcu_gp_start.tv64) {
+               gp_us = ktime_us_delta(now, rcu_gp_start);
+               rcu_gp_hist[rcu_hist_bucket(gp_us)]++;
+               if (gp_us > rcu_gp_max_us)
+                       rcu_gp_max_us = min_t(s64, gp_us, UINT_MAX);
+       }
+       rcu_gp_start = now;
+
+       if (rcu_flood && depth <= rcu_flood_thresh / 2)
+               rcu_flood = 0;
 }
 
 static void rcu_delimit_batches(void)
@@ -417,7 +495,7 @@ static void rcu_delimit_batches(void)
 #include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 
-#define rcu_hz_period_ns       (rcu_hz_period_us * NSEC_PER_USEC)
+#define rcu_hz_period_ns       (rcu_period_us() * NSEC_PER_USEC)
 #define rcu_hz_delta_ns                (rcu_hz_delta_us * NSEC_PER_USEC)
 
 static struct hrtimer rcu_timer;
@@ -523,12 +601,13 @@ static int jrcud_func(void *arg)
        pr_info("JRCU: callback processing via daemon started.\n");
 
        while (!kthread_should_stop()) {
+               int period_us = rcu_period_us();
+
                if (rcu_hz_precise) {
-                       usleep_range(rcu_hz_period_us,
-                               rcu_hz_period_us);
+                       usleep_range(period_us, period_us);
                } else {
-                       usleep_range(rcu_hz_period_us,
-                               rcu_hz_period_us + rcu_hz_delta_us);
+                       usleep_range(period_us,
+                               period_us + rcu_hz_delta_us);
                }
                rcu_delimit_batches();
        }
@@ -566,6 +645,27 @@ subsys_initcall_sync(rcu_start_callback_processing);
 
 /* ------------------ debug and statistics section -------------- */
 
+/*
+ * Summary for rcutorture's periodic stats line.  Only the upper end of
+ * the histograms is interesting there.
+ */
+int jrcu_torture_stats(char *page)
+{
+       int cnt, b, top = 0;
+
+       for (b = 0; b < RCU_HIST_BUCKETS; b++)
+               if (atomic_read(&rcu_sync_hist[b]))
+                       top = b;
+
+       cnt = sprintf(page, "jrcu: batches: %u max gp: %uus floods: %u%s "
+               "syncs: %u slowest sync: <%luus ",
+               rcu_stats.nbatches, rcu_gp_max_us, rcu_stats.nfloods,
+               rcu_flood ? " (flooded)" : "",
+               atomic_read(&rcu_stats.nsyncs), 2UL << top);
+       return cnt;
+}
+EXPORT_SYMBOL_GPL(jrcu_torture_stats);
+
 #ifdef CONFIG_DEBUG_FS
 
 #include <linux/debugfs.h>
@@ -621,6 +721,28 @@ static int rcu_debugfs_show(struct seq_file *m, void *unused)
        seq_printf(m, "%14d: #callbacks left to invoke\n",
                (int)(nqueued - rcu_stats.ninvoked));
        seq_printf(m, "\n");
+       seq_printf(m, "%14d: flood threshold (callbacks/cpu)\n",
+               rcu_flood_thresh);
+       seq_printf(m, "%14d: flood period (usecs)\n",
+               rcu_flood_period_us);
+       seq_printf(m, "%14u: #floods%s\n",
+               rcu_stats.nfloods, rcu_flood ? ", flooded now" : "");
+       seq_printf(m, "%14u: longest grace period (usecs)\n",
+               rcu_gp_max_us);
+       seq_printf(m, "\n");
+
+       seq_printf(m, "%14s  %10s %10s\n", "usecs", "gp", "sync");
+       for (q = 0; q < RCU_HIST_BUCKETS; q++) {
+               unsigned gp = rcu_gp_hist[q];
+               unsigned sync = atomic_read(&rcu_sync_hist[q]);
+
+               if (!gp && !sync)
+                       continue;
+               seq_printf(m, "%13lu%c  %10u %10u\n",
+                       1UL << q, q == RCU_HIST_BUCKETS - 1 ? '+' : ' ',
+                       gp, sync);
+       }
+       seq_printf(m, "\n");
 
        for_each_online_cpu(cpu)
                seq_printf(m, "%4d ", cpu);
@@ -643,9 +765,13 @@ static int rcu_debugfs_show(struct seq_file *m, void *unused)
                }
                seq_printf(m, "  Q%d%c\n", q, " *"[q == w]);
        }
+       for_each_online_cpu(cpu)
+               seq_printf(m, "%4d ", rcu_data[cpu].maxqueued);
+       seq_printf(m, "  MAXQ\n");
        seq_printf(m, "\nFLAGS:\n");
        seq_printf(m, "  I - cpu idle, W - cpu waiting for end-of-batch,\n");
        seq_printf(m, "  * - the current Q, other is the previous Q.\n");
+       seq_printf(m, "  MAXQ - deepest Q seen since boot or last reset.\n");
 
        return 0;
 }
@@ -704,6 +830,28 @@ next:
                if (wdog < 3 || wdog > 1000)
                        return -EINVAL;
                rcu_wdog_lim = wdog * USEC_PER_SEC;
+       } else if (!strncmp(token, "flood=", 6)) {
+               int thresh = -1;
+               sscanf(&token[6], "%d", &thresh);
+               if (thresh < 2)
+                       return -EINVAL;
+               rcu_flood_thresh = thresh;
+       } else if (!strncmp(token, "fperiod=", 8)) {
+               int period = -1;
+               sscanf(&token[8], "%d", &period);
+               if (period < 100 || period > rcu_hz_period_us)
+                       return -EINVAL;
+               rcu_flood_period_us = period;
+       } else if (!strcmp(token, "reset")) {
+               int cpu;
+               for_each_present_cpu(cpu)
+                       rcu_data[cpu].maxqueued = 0;
+               for (j = 0; j < RCU_HIST_BUCKETS; j++) {
+                       rcu_gp_hist[j] = 0;
+                       atomic_set(&rcu_sync_hist[j], 0);
+               }
+               rcu_gp_max_us = 0;
+               rcu_stats.nfloods = 0;
        } else
                return -EINVAL;
        goto next;
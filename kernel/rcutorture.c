@@ -341,6 +341,12 @@ static void rcu_torture_read_unlock(int idx) __releases(RCU)
 	rcu_read_unlock();
 }
 
+#ifdef CONFIG_JRCU
+#define rcu_flavor_torture_stats	jrcu_torture_stats
+#else
+#define rcu_flavor_torture_stats	NULL
+#endif
+
 static int rcu_torture_completed(void)
 {
 	return rcu_batches_completed();
@@ -389,7 +395,7 @@ static struct rcu_torture_ops rcu_ops = {
 	.sync		= synchronize_rcu,
 	.cb_barrier	= rcu_barrier,
 	.fqs		= rcu_force_quiescent_state,
-	.stats		= NULL,
+	.stats		= rcu_flavor_torture_stats,
 	.irq_capable	= 1,
 	.can_boost	= rcu_can_boost(),
 	.name		= "rcu"
@@ -432,7 +438,7 @@ static struct rcu_torture_ops rcu_sync_ops = {
 	.sync		= synchronize_rcu,
 	.cb_barrier	= NULL,
 	.fqs		= rcu_force_quiescent_state,
-	.stats		= NULL,
+	.stats		= rcu_flavor_torture_stats,
 	.irq_capable	= 1,
 	.can_boost	= rcu_can_boost(),
 	.name		= "rcu_sync"
@@ -449,7 +455,7 @@ static struct rcu_torture_ops rcu_expedited_ops = {
 	.sync		= synchronize_rcu_expedited,
 	.cb_barrier	= NULL,
 	.fqs		= rcu_force_quiescent_state,
-	.stats		= NULL,
+	.stats		= rcu_flavor_torture_stats,
 	.irq_capable	= 1,
 	.can_boost	= rcu_can_boost(),
 	.name		= "rcu_expedited"
@@ -515,7 +521,7 @@ static struct rcu_torture_ops rcu_bh_ops = {
 	.sync		= rcu_bh_torture_synchronize,
 	.cb_barrier	= rcu_barrier_bh,
 	.fqs		= rcu_bh_force_quiescent_state,
-	.stats		= NULL,
+	.stats		= rcu_flavor_torture_stats,
 	.irq_capable	= 1,
 	.name		= "rcu_bh"
 };
@@ -531,7 +537,7 @@ static struct rcu_torture_ops rcu_bh_sync_ops = {
 	.sync		= rcu_bh_torture_synchronize,
 	.cb_barrier	= NULL,
 	.fqs		= rcu_bh_force_quiescent_state,
-	.stats		= NULL,
+	.stats		= rcu_flavor_torture_stats,
 	.irq_capable	= 1,
 	.name		= "rcu_bh_sync"
 };
@@ -675,7 +681,7 @@ static struct rcu_torture_ops sched_ops = {
 	.sync		= sched_torture_synchronize,
 	.cb_barrier	= rcu_barrier_sched,
 	.fqs		= rcu_sched_force_quiescent_state,
-	.stats		= NULL,
+	.stats		= rcu_flavor_torture_stats,
 	.irq_capable	= 1,
 	.name		= "sched"
 };
@@ -691,7 +697,7 @@ static struct rcu_torture_ops sched_sync_ops = {
 	.sync		= sched_torture_synchronize,
 	.cb_barrier	= NULL,
 	.fqs		= rcu_sched_force_quiescent_state,
-	.stats		= NULL,
+	.stats		= rcu_flavor_torture_stats,
 	.name		= "sched_sync"
 };
 
@@ -706,7 +712,7 @@ static struct rcu_torture_ops sched_expedited_ops = {
 	.sync		= synchronize_sched_expedited,
 	.cb_barrier	= NULL,
 	.fqs		= rcu_sched_force_quiescent_state,
-	.stats		= NULL,
+	.stats		= rcu_flavor_torture_stats,
 	.irq_capable	= 1,
 	.name		= "sched_expedited"
 };
@@ -1842,6 +1842,17 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			else
 				error = PR_MCE_KILL_DEFAULT;
 			break;
+		case PR_SET_STRICT_FSYNC:
+			if (arg2 > 1 || arg3 | arg4 | arg5)
+				return -EINVAL;
+			current->strict_fsync = arg2;
+			error = 0;
+			break;
+		case PR_GET_STRICT_FSYNC:
+			if (arg2 | arg3 | arg4 | arg5)
+				return -EINVAL;
+			error = current->strict_fsync;
+			break;
 		default:
 			error = -EINVAL;
 			break;
@@ -100,6 +100,7 @@ extern int min_free_order_shift;
 extern int pid_max_min, pid_max_max;
 extern int sysctl_drop_caches;
 extern int percpu_pagelist_fraction;
+extern int percpu_pagelist_max_order;
 extern int compat_log;
 extern int latencytop_enabled;
 extern int sysctl_nr_open_min, sysctl_nr_open_max;
@@ -270,8 +271,11 @@ static int max_sched_tunable_scaling = SCHED_TUNABLESCALING_END-1;
 #ifdef CONFIG_COMPACTION
 static int min_extfrag_threshold;
 static int max_extfrag_threshold = 1000;
+static int max_compaction_order = MAX_ORDER - 1;
 #endif
 
+static int max_percpu_pagelist_order = PCP_MAX_ORDER;
+
 static struct ctl_table kern_table[] = {
 	{
 		.procname	= "sched_child_runs_first",
@@ -1179,6 +1183,40 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &min_extfrag_threshold,
 		.extra2		= &max_extfrag_threshold,
 	},
+	{
+		.procname	= "compaction_proactive_order",
+		.data		= &sysctl_compaction_proactive_order,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= sysctl_compaction_proactive_handler,
+		.extra1		= &one,
+		.extra2		= &max_compaction_order,
+	},
+	{
+		.procname	= "compaction_proactive_threshold",
+		.data		= &sysctl_compaction_proactive_threshold,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= sysctl_compaction_proactive_handler,
+		.extra1		= &min_extfrag_threshold,
+		.extra2		= &max_extfrag_threshold,
+	},
+	{
+		.procname	= "compaction_proactive_interval_ms",
+		.data		= &sysctl_compaction_proactive_interval_ms,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= sysctl_compaction_proactive_handler,
+		.extra1		= &zero,
+	},
+	{
+		.procname	= "compaction_proactive_budget_ms",
+		.data		= &sysctl_compaction_proactive_budget_ms,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= sysctl_compaction_proactive_handler,
+		.extra1		= &one,
+	},
 
 #endif /* CONFIG_COMPACTION */
 	{
@@ -1204,6 +1242,15 @@ static struct ctl_table vm_table[] = {
 		.proc_handler	= percpu_pagelist_fraction_sysctl_handler,
 		.extra1		= &min_percpu_pagelist_fract,
 	},
+	{
+		.procname	= "percpu_pagelist_max_order",
+		.data		= &percpu_pagelist_max_order,
+		.maxlen		= sizeof(percpu_pagelist_max_order),
+		.mode		= 0644,
+		.proc_handler	= percpu_pagelist_max_order_sysctl_handler,
+		.extra1		= &zero,
+		.extra2		= &max_percpu_pagelist_order,
+	},
 #ifdef CONFIG_MMU
 	{
 		.procname	= "max_map_count",
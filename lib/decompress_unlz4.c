@@ -0,0 +1,163 @@
+/*
+ * LZ4 decompressor for the Linux kernel.
+ *
+ * Reads the legacy LZ4 stream format written by "lz4 -l" and "lz4c -l":
+ * a little endian magic number, then blocks each preceded by their
+ * compressed size as a little endian 32-bit number. Every block but
+ * the last decompresses to exactly 8MB. There is no end marker; the
+ * stream ends with the input, or after a block shorter than 8MB, so
+ * that the size appended to compressed kernel images is not taken for
+ * another block. A repeated magic number starts a new stream.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifdef STATIC
+#include "lz4/lz4_decompress.c"
+#else
+#include <linux/decompress/unlz4.h>
+#endif
+
+#include <linux/types.h>
+#include <linux/lz4.h>
+#include <linux/decompress/mm.h>
+
+#include <linux/compiler.h>
+#include <asm/unaligned.h>
+
+#define LZ4_LEGACY_MAGIC	0x184c2102
+#define LZ4_BLOCK_SIZE		(8 << 20)
+
+STATIC inline int INIT unlz4(u8 *input, int in_len,
+				int (*fill) (void *, unsigned int),
+				int (*flush) (void *, unsigned int),
+				u8 *output, int *posp,
+				void (*error) (char *x))
+{
+	u32 src_len;
+	size_t dst_len = LZ4_BLOCK_SIZE;
+	u8 *in_buf, *out_buf;
+	int ret = -1, r;
+
+	if (output) {
+		out_buf = output;
+	} else if (!flush) {
+		error("NULL output pointer and no flush function provided");
+		goto exit;
+	} else {
+		out_buf = large_malloc(LZ4_BLOCK_SIZE);
+		if (!out_buf) {
+			error("Could not allocate output buffer");
+			goto exit;
+		}
+	}
+
+	if (input && fill) {
+		error("Both input pointer and fill function provided, don't know what to do");
+		goto exit_1;
+	} else if (input) {
+		in_buf = input;
+	} else if (!fill) {
+		error("NULL input pointer and missing fill function");
+		goto exit_1;
+	} else {
+		in_buf = large_malloc(lz4_compressbound(LZ4_BLOCK_SIZE));
+		if (!in_buf) {
+			error("Could not allocate input buffer");
+			goto exit_1;
+		}
+	}
+
+	if (posp)
+		*posp = 0;
+
+	if (fill)
+		in_len = fill(in_buf, 4);
+	if (in_len < 4 || get_unaligned_le32(in_buf) != LZ4_LEGACY_MAGIC) {
+		error("invalid header");
+		goto exit_2;
+	}
+	if (!fill) {
+		in_buf += 4;
+		in_len -= 4;
+	}
+	if (posp)
+		*posp += 4;
+
+	for (;;) {
+		/* the previous block was the last one */
+		if (dst_len < LZ4_BLOCK_SIZE)
+			break;
+
+		/* read compressed block size */
+		if (fill)
+			in_len = fill(in_buf, 4);
+		if (in_len < 4)
+			break;
+		src_len = get_unaligned_le32(in_buf);
+
+		if (src_len == LZ4_LEGACY_MAGIC) {
+			if (!fill) {
+				in_buf += 4;
+				in_len -= 4;
+			}
+			if (posp)
+				*posp += 4;
+			continue;
+		}
+
+		/* after a full block, what follows may not be another one */
+		if (!fill && src_len > in_len - 4)
+			break;
+
+		if (src_len > lz4_compressbound(LZ4_BLOCK_SIZE)) {
+			error("block size larger than any block");
+			goto exit_2;
+		}
+
+		if (fill) {
+			in_len = fill(in_buf, src_len);
+			if (in_len < (int)src_len) {
+				error("file corrupted");
+				goto exit_2;
+			}
+		} else {
+			in_buf += 4;
+			in_len -= 4;
+		}
+
+		/* decompress */
+		dst_len = LZ4_BLOCK_SIZE;
+		r = lz4_decompress_safe(in_buf, src_len, out_buf, &dst_len);
+		if (r != LZ4_E_OK) {
+			error("Compressed data violation");
+			goto exit_2;
+		}
+
+		if (flush && flush(out_buf, dst_len) != dst_len)
+			goto exit_2;
+		if (output)
+			out_buf += dst_len;
+		if (posp)
+			*posp += src_len + 4;
+
+		if (!fill) {
+			in_buf += src_len;
+			in_len -= src_len;
+		}
+	}
+
+	ret = 0;
+exit_2:
+	if (!input)
+		large_free(in_buf);
+exit_1:
+	if (!output)
+		large_free(out_buf);
+exit:
+	return ret;
+}
+
+#define decompress unlz4
@@ -0,0 +1,182 @@
+/*
+ *  LZ4 Compressor
+ *
+ *  Single pass greedy compressor for the LZ4 block format, with a hash
+ *  table of the last position each four byte sequence was seen at and
+ *  a search that speeds up over data that does not compress.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static __always_inline u32 lz4_hash(const unsigned char *p)
+{
+	return (lz4_read32(p) * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+/* Number of leading bytes, in memory order, that are zero in v != 0 */
+static __always_inline size_t lz4_zero_bytes(unsigned long v)
+{
+#ifdef __LITTLE_ENDIAN
+	return __ffs(v) >> 3;
+#else
+	return (BITS_PER_LONG - 1 - __fls(v)) >> 3;
+#endif
+}
+
+/* Length of the common prefix of ip and m, not reading past limit */
+static __always_inline size_t lz4_count(const unsigned char *ip,
+		const unsigned char *m, const unsigned char *limit)
+{
+	const unsigned char * const start = ip;
+	unsigned long v;
+
+	while (ip + LZ4_WORD <= limit) {
+		v = lz4_read_word(m) ^ lz4_read_word(ip);
+		if (v)
+			return ip - start + lz4_zero_bytes(v);
+		ip += LZ4_WORD;
+		m += LZ4_WORD;
+	}
+	while (ip < limit && *m == *ip) {
+		ip++;
+		m++;
+	}
+	return ip - start;
+}
+
+static __always_inline unsigned char *lz4_put_len(unsigned char *op,
+		size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - MFLIMIT;
+	const unsigned char * const matchlimit = iend - LASTLITERALS;
+	unsigned char * const oend = dst + *dst_len;
+	const unsigned char *ip = src, *anchor = src, *ref;
+	unsigned char *op = dst, *token;
+	u32 *table = wrkmem;
+	size_t len;
+	u32 h;
+
+	if (src_len < MFLIMIT + 1)
+		goto last_literals;
+
+	memset(table, 0, LZ4_MEM_COMPRESS);
+	table[lz4_hash(ip)] = 0;
+	ip++;
+
+	for (;;) {
+		const unsigned char *next = ip;
+		unsigned int search = 1 << LZ4_SKIP;
+		size_t step = 1;
+
+		/* find a match, stepping further the longer there is none */
+		do {
+			ip = next;
+			next += step;
+			step = search++ >> LZ4_SKIP;
+			if (unlikely(next > mflimit))
+				goto last_literals;
+
+			h = lz4_hash(ip);
+			ref = src + table[h];
+			table[h] = ip - src;
+		} while (ip - ref > MAX_DISTANCE ||
+			 lz4_read32(ref) != lz4_read32(ip));
+
+		/* and extend it backwards over the pending literals */
+		while (ip > anchor && ref > src && unlikely(ip[-1] == ref[-1])) {
+			ip--;
+			ref--;
+		}
+
+		len = ip - anchor;
+		if (unlikely(len + len / 255 + 4 > (size_t)(oend - op)))
+			goto output_overrun;
+		token = op++;
+		if (len >= RUN_MASK) {
+			*token = RUN_MASK << ML_BITS;
+			op = lz4_put_len(op, len - RUN_MASK);
+		} else {
+			*token = len << ML_BITS;
+		}
+		memcpy(op, anchor, len);
+		op += len;
+
+next_match:
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		len = lz4_count(ip + MINMATCH, ref + MINMATCH, matchlimit);
+		ip += MINMATCH + len;
+		if (len >= ML_MASK) {
+			if (unlikely(len / 255 + 1 > (size_t)(oend - op)))
+				goto output_overrun;
+			*token |= ML_MASK;
+			op = lz4_put_len(op, len - ML_MASK);
+		} else {
+			*token |= len;
+		}
+
+		anchor = ip;
+		if (ip > mflimit)
+			break;
+
+		table[lz4_hash(ip - 2)] = ip - 2 - src;
+
+		/* a match right away needs no literals */
+		h = lz4_hash(ip);
+		ref = src + table[h];
+		table[h] = ip - src;
+		if (ip - ref <= MAX_DISTANCE &&
+		    lz4_read32(ref) == lz4_read32(ip)) {
+			if (unlikely(oend - op < 3))
+				goto output_overrun;
+			token = op++;
+			*token = 0;
+			goto next_match;
+		}
+		ip++;
+	}
+
+last_literals:
+	len = iend - anchor;
+	if (unlikely(len + len / 255 + 2 > (size_t)(oend - op)))
+		goto output_overrun;
+	if (len >= RUN_MASK) {
+		*op++ = RUN_MASK << ML_BITS;
+		op = lz4_put_len(op, len - RUN_MASK);
+	} else {
+		*op++ = len << ML_BITS;
+	}
+	memcpy(op, anchor, len);
+	op += len;
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+
+output_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_OUTPUT_OVERRUN;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
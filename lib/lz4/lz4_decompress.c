@@ -0,0 +1,182 @@
+/*
+ *  LZ4 Decompressor
+ *
+ *  Every length is checked against both buffers before it is used, so
+ *  corrupt input fails with an error instead of reading or writing out
+ *  of bounds. Copies go eight bytes at a time wherever both buffers
+ *  have room for the over-copy.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#endif
+
+#include <asm/unaligned.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+static const unsigned char lz4_inc32[8] = { 0, 1, 2, 1, 0, 4, 4, 4 };
+static const signed char lz4_dec64[8] = { 0, 0, 0, -1, -4, 1, 2, 3 };
+
+/*
+ * Reads the continuation bytes of a length field that started out as
+ * len. Returns false on running out of input or on a length longer than
+ * limit, which no valid stream has.
+ */
+static __always_inline bool lz4_get_len(const unsigned char **ipp,
+		const unsigned char *ip_end, size_t *len, size_t limit)
+{
+	const unsigned char *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= ip_end))
+			return false;
+		s = *ip++;
+		*len += s;
+		if (unlikely(*len > limit))
+			return false;
+	} while (s == 255);
+
+	*ipp = ip;
+	return true;
+}
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len)
+{
+	const unsigned char * const ip_end = src + src_len;
+	unsigned char * const op_end = dst + *dst_len;
+	const unsigned char *ip = src, *ref;
+	unsigned char *op = dst, *end, *copy_end;
+	unsigned int token, offset;
+	size_t len;
+
+	for (;;) {
+		if (unlikely(ip >= ip_end))
+			goto input_overrun;
+		token = *ip++;
+		len = token >> ML_BITS;
+
+		/*
+		 * Most sequences have fewer than 15 literals and a match
+		 * shorter than 19 bytes. Away from the ends of both buffers
+		 * they can be copied in fixed size chunks.
+		 */
+		if (len < RUN_MASK && (token & ML_MASK) < ML_MASK &&
+		    ip_end - ip >= 16 && op_end - op >= 40) {
+			lz4_copy8(op, ip);
+			lz4_copy8(op + 8, ip + 8);
+			op += len;
+			ip += len;
+
+			offset = get_unaligned_le16(ip);
+			ip += 2;
+			if (unlikely(!offset || offset > (size_t)(op - dst)))
+				goto lookbehind_overrun;
+			ref = op - offset;
+
+			len = (token & ML_MASK) + MINMATCH;
+			if (offset < 8)
+				goto copy_match;
+			lz4_copy8(op, ref);
+			lz4_copy8(op + 8, ref + 8);
+			lz4_copy8(op + 16, ref + 16);
+			op += len;
+			continue;
+		}
+
+		/* literals */
+		if (len == RUN_MASK &&
+		    unlikely(!lz4_get_len(&ip, ip_end, &len, src_len)))
+			goto input_overrun;
+		if (unlikely(len > (size_t)(ip_end - ip)))
+			goto input_overrun;
+		if (unlikely(len > (size_t)(op_end - op)))
+			goto output_overrun;
+
+		if (len + 8 <= (size_t)(ip_end - ip) &&
+		    len + 8 <= (size_t)(op_end - op))
+			lz4_wild_copy(op, ip, len);
+		else
+			memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* the last sequence has no match */
+		if (ip == ip_end)
+			break;
+
+		if (unlikely(ip_end - ip < 2))
+			goto input_overrun;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > (size_t)(op - dst)))
+			goto lookbehind_overrun;
+		ref = op - offset;
+
+		/* match */
+		len = token & ML_MASK;
+		if (len == ML_MASK &&
+		    unlikely(!lz4_get_len(&ip, ip_end, &len, *dst_len)))
+			goto input_overrun;
+		len += MINMATCH;
+		if (unlikely(len > (size_t)(op_end - op)))
+			goto output_overrun;
+
+copy_match:
+		/* over-copying has to stop eight bytes short of op_end */
+		end = op + len;
+		copy_end = len + 8 <= (size_t)(op_end - op) ? end : op_end - 8;
+
+		if (offset < 8 && copy_end - op >= 8) {
+			/*
+			 * A short period, e.g. a run of zeroes: write the first
+			 * eight bytes, leaving ref a multiple of the period
+			 * eight or more back, and copy the rest from there.
+			 */
+			op[0] = ref[0];
+			op[1] = ref[1];
+			op[2] = ref[2];
+			op[3] = ref[3];
+			ref += lz4_inc32[offset];
+			lz4_write32(op + 4, lz4_read32(ref));
+			ref -= lz4_dec64[offset];
+			op += 8;
+		}
+		if ((op - ref >= 8) && op < copy_end) {
+			lz4_wild_copy(op, ref, copy_end - op);
+			ref += copy_end - op;
+			op = copy_end;
+		}
+		while (op < end)
+			*op++ = *ref++;
+	}
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+
+input_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_INPUT_OVERRUN;
+
+output_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_OUTPUT_OVERRUN;
+
+lookbehind_overrun:
+	*dst_len = op - dst;
+	return LZ4_E_LOOKBEHIND_OVERRUN;
+}
+#ifndef STATIC
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+#endif
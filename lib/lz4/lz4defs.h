@@ -0,0 +1,97 @@
+/*
+ *  lz4defs.h -- LZ4 block format constants and copy helpers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+/*
+ * A sequence is a token, the literal run, a 16-bit little endian match
+ * offset and the match. The high nibble of the token is the literal
+ * length and the low nibble the match length less MINMATCH; either
+ * continues in following bytes when the nibble is all ones. The last
+ * sequence is literals only, and its last LASTLITERALS bytes are never
+ * part of a match, and no match starts in the last MFLIMIT bytes.
+ */
+#define MINMATCH	4
+#define LASTLITERALS	5
+#define MFLIMIT		12
+#define MAX_DISTANCE	65535
+
+#define ML_BITS		4
+#define ML_MASK		((1u << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1u << RUN_BITS) - 1)
+
+#define LZ4_HASH_LOG	12
+#define LZ4_SKIP	6
+
+/*
+ * Word accesses follow lib/lzo: direct where unaligned loads and stores
+ * are cheap, except in the pre-boot decompressor, which may run with the
+ * MMU off; get_unaligned() otherwise.
+ */
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) || \
+	(defined(__LINUX_ARM_ARCH__) && __LINUX_ARM_ARCH__ >= 6 && \
+	 !defined(STATIC))
+#define LZ4_FAST_UNALIGNED	1
+#else
+#define LZ4_FAST_UNALIGNED	0
+#endif
+
+#define LZ4_WORD	sizeof(unsigned long)
+
+struct lz4_una_u32 {
+	u32 x;
+} __packed;
+
+struct lz4_una_word {
+	unsigned long x;
+} __packed;
+
+static __always_inline u32 lz4_read32(const void *p)
+{
+	if (LZ4_FAST_UNALIGNED)
+		return ((const struct lz4_una_u32 *)p)->x;
+	return get_unaligned((const u32 *)p);
+}
+
+static __always_inline void lz4_write32(void *p, u32 v)
+{
+	if (LZ4_FAST_UNALIGNED)
+		((struct lz4_una_u32 *)p)->x = v;
+	else
+		put_unaligned(v, (u32 *)p);
+}
+
+static __always_inline unsigned long lz4_read_word(const void *p)
+{
+	if (LZ4_FAST_UNALIGNED)
+		return ((const struct lz4_una_word *)p)->x;
+	return get_unaligned((const unsigned long *)p);
+}
+
+static __always_inline void lz4_copy8(unsigned char *dst,
+		const unsigned char *src)
+{
+	lz4_write32(dst, lz4_read32(src));
+	lz4_write32(dst + 4, lz4_read32(src + 4));
+}
+
+/*
+ * Copies len > 0 bytes eight at a time. May read and write up to 7
+ * bytes beyond the end of both buffers, and needs dst - src >= 8 if
+ * they overlap.
+ */
+static __always_inline void lz4_wild_copy(unsigned char *dst,
+		const unsigned char *src, size_t len)
+{
+	unsigned char * const end = dst + len;
+
+	do {
+		lz4_copy8(dst, src);
+		dst += 8;
+		src += 8;
+	} while (dst < end);
+}
@@ -17,9 +17,24 @@
 #include <asm/unaligned.h>
 #include "lzodefs.h"
 
-static noinline size_t
-_lzo1x_1_do_compress(const unsigned char *in, size_t in_len,
-		unsigned char *out, size_t *out_len, void *wrkmem)
+static bool lzo1x_fast_compress = LZO_FAST_UNALIGNED;
+module_param_named(fast, lzo1x_fast_compress, bool, 0644);
+MODULE_PARM_DESC(fast, "Copy literals and extend matches a word at a time");
+
+/* Number of leading bytes, in memory order, that are zero in v != 0 */
+static __always_inline size_t lzo_zero_bytes(unsigned long v)
+{
+#ifdef __LITTLE_ENDIAN
+	return __ffs(v) >> 3;
+#else
+	return (BITS_PER_LONG - 1 - __fls(v)) >> 3;
+#endif
+}
+
+static __always_inline size_t
+lzo1x_1_do_compress(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len, void *wrkmem,
+		const bool fast)
 {
 	const unsigned char * const in_end = in + in_len;
 	const unsigned char * const ip_end = in + in_len - M2_MAX_LEN - 5;
@@ -93,9 +108,16 @@ match:
 				}
 				*op++ = tt;
 			}
-			do {
-				*op++ = *ii++;
-			} while (--t > 0);
+			if (fast) {
+				/* ip is well before in_end, see ip_end */
+				lzo_copy_words(op, ii, t);
+				op += t;
+				ii += t;
+			} else {
+				do {
+					*op++ = *ii++;
+				} while (--t > 0);
+			}
 		}
 
 		ip += 3;
@@ -125,6 +147,19 @@ match:
 			end = in_end;
 			m = m_pos + M2_MAX_LEN + 1;
 
+			while (fast && ip + LZO_WORD <= end) {
+				unsigned long v = lzo_load_word(m) ^
+						  lzo_load_word(ip);
+
+				if (v) {
+					v = lzo_zero_bytes(v);
+					m += v;
+					ip += v;
+					break;
+				}
+				m += LZO_WORD;
+				ip += LZO_WORD;
+			}
 			while (ip < end && *m == *ip) {
 				m++;
 				ip++;
@@ -173,6 +208,20 @@ m3_m4_offset:
 	return in_end - ii;
 }
 
+static noinline size_t
+_lzo1x_1_do_compress(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len, void *wrkmem)
+{
+	return lzo1x_1_do_compress(in, in_len, out, out_len, wrkmem, false);
+}
+
+static noinline size_t
+_lzo1x_1_do_compress_fast(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len, void *wrkmem)
+{
+	return lzo1x_1_do_compress(in, in_len, out, out_len, wrkmem, true);
+}
+
 int lzo1x_1_compress(const unsigned char *in, size_t in_len, unsigned char *out,
 			size_t *out_len, void *wrkmem)
 {
@@ -182,6 +231,9 @@ int lzo1x_1_compress(const unsigned char *in, size_t in_len, unsigned char *out,
 
 	if (unlikely(in_len <= M2_MAX_LEN + 5)) {
 		t = in_len;
+	} else if (LZO_FAST_UNALIGNED && lzo1x_fast_compress) {
+		t = _lzo1x_1_do_compress_fast(in, in_len, op, out_len, wrkmem);
+		op += *out_len;
 	} else {
 		t = _lzo1x_1_do_compress(in, in_len, op, out_len, wrkmem);
 		op += *out_len;
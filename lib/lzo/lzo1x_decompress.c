@@ -27,8 +27,9 @@
 #define COPY4(dst, src)	\
 		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
 
-int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
-			unsigned char *out, size_t *out_len)
+static __always_inline int
+lzo1x_decompress(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len, const bool fast)
 {
 	const unsigned char * const ip_end = in + in_len;
 	unsigned char * const op_end = out + *out_len;
@@ -72,6 +73,14 @@ int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
 		if (HAVE_IP(t + 4, ip_end, ip))
 			goto input_overrun;
 
+		if (fast && !HAVE_OP(t + 3 + LZO_WORD - 1, op_end, op) &&
+		    !HAVE_IP(t + 3 + LZO_WORD - 1, ip_end, ip)) {
+			lzo_copy_words(op, ip, t + 3);
+			op += t + 3;
+			ip += t + 3;
+			goto first_literal_run;
+		}
+
 		COPY4(op, ip);
 		op += 4;
 		ip += 4;
@@ -183,7 +192,11 @@ match:
 			if (HAVE_OP(t + 3 - 1, op_end, op))
 				goto output_overrun;
 
-			if (t >= 2 * 4 - (3 - 1) && (op - m_pos) >= 4) {
+			if (fast && (size_t)(op - m_pos) >= LZO_WORD &&
+			    !HAVE_OP(t + 2 + LZO_WORD - 1, op_end, op)) {
+				lzo_copy_words(op, m_pos, t + 2);
+				op += t + 2;
+			} else if (t >= 2 * 4 - (3 - 1) && (op - m_pos) >= 4) {
 				COPY4(op, m_pos);
 				op += 4;
 				m_pos += 4;
@@ -246,6 +259,40 @@ lookbehind_overrun:
 	*out_len = op - out;
 	return LZO_E_LOOKBEHIND_OVERRUN;
 }
+
+static noinline int
+_lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len)
+{
+	return lzo1x_decompress(in, in_len, out, out_len, false);
+}
+
+/*
+ * The pre-boot decompressors may run with the MMU off, where unaligned
+ * accesses fault even on ARMv6 and later, so they stay byte-wise.
+ */
+#ifndef STATIC
+static bool lzo1x_fast_decompress = LZO_FAST_UNALIGNED;
+module_param_named(fast, lzo1x_fast_decompress, bool, 0644);
+MODULE_PARM_DESC(fast, "Copy literals and matches a word at a time");
+
+static noinline int
+_lzo1x_decompress_safe_fast(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len)
+{
+	return lzo1x_decompress(in, in_len, out, out_len, true);
+}
+#endif
+
+int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
+			unsigned char *out, size_t *out_len)
+{
+#ifndef STATIC
+	if (LZO_FAST_UNALIGNED && lzo1x_fast_decompress)
+		return _lzo1x_decompress_safe_fast(in, in_len, out, out_len);
+#endif
+	return _lzo1x_decompress_safe(in, in_len, out, out_len);
+}
 #ifndef STATIC
 EXPORT_SYMBOL_GPL(lzo1x_decompress_safe);
 
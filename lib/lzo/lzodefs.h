@@ -41,3 +41,51 @@
 #define DX2(p, s1, s2)	(((((size_t)((p)[2]) << (s2)) ^ (p)[1]) \
 							<< (s1)) ^ (p)[0])
 #define DX3(p, s1, s2, s3)	((DX2((p)+1, s2, s3) << (s1)) ^ (p)[0])
+
+/*
+ * Literal runs and match extension can go a word at a time where loads
+ * and stores that may be unaligned are cheap: on ARMv6 and later, as
+ * long as the compiler emits them as single ldr/str, and wherever the
+ * architecture says so. The byte-wise code stays selectable at run time
+ * and both produce the same stream.
+ */
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) || \
+	(defined(__LINUX_ARM_ARCH__) && __LINUX_ARM_ARCH__ >= 6)
+#define LZO_FAST_UNALIGNED	1
+#else
+#define LZO_FAST_UNALIGNED	0
+#endif
+
+#define LZO_WORD	sizeof(unsigned long)
+
+struct lzo_una_word {
+	unsigned long x;
+} __packed;
+
+static __always_inline unsigned long lzo_load_word(const void *p)
+{
+	return ((const struct lzo_una_word *)p)->x;
+}
+
+static __always_inline void lzo_store_word(void *p, unsigned long v)
+{
+	((struct lzo_una_word *)p)->x = v;
+}
+
+/*
+ * Copies len > 0 bytes a word at a time. May read and write up to
+ * LZO_WORD - 1 bytes beyond the end of both buffers, and needs
+ * dst - src >= LZO_WORD if they overlap.
+ */
+static __always_inline void lzo_copy_words(unsigned char *dst,
+		const unsigned char *src, size_t len)
+{
+	for (;;) {
+		lzo_store_word(dst, lzo_load_word(src));
+		if (len <= LZO_WORD)
+			break;
+		dst += LZO_WORD;
+		src += LZO_WORD;
+		len -= LZO_WORD;
+	}
+}
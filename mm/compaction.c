@@ -14,6 +14,9 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/timer.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -42,6 +45,14 @@ struct compact_control {
 	unsigned int order;		/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
+
+	/*
+	 * kcompactd runs until the fragmentation index for order drops to
+	 * sysctl_compaction_proactive_threshold or until the deadline, and
+	 * resumes where the previous run in the zone stopped.
+	 */
+	bool proactive;
+	unsigned long deadline;		/* in jiffies */
 };
 
 static unsigned long release_freepages(struct list_head *freelist)
@@ -442,6 +453,15 @@ static int compact_finished(struct zone *zone,
 	if (cc->free_pfn <= cc->migrate_pfn)
 		return COMPACT_COMPLETE;
 
+	if (cc->proactive) {
+		if (time_after_eq(jiffies, cc->deadline))
+			return COMPACT_PARTIAL;
+		if (fragmentation_index(zone, cc->order) <=
+		    sysctl_compaction_proactive_threshold)
+			return COMPACT_PARTIAL;
+		return COMPACT_CONTINUE;
+	}
+
 	/*
 	 * order == -1 is expected when compacting via
 	 * /proc/sys/vm/compact_memory
@@ -477,6 +497,16 @@ static int compact_finished(struct zone *zone,
  *   COMPACT_PARTIAL  - If the allocation would succeed without compaction
  *   COMPACT_CONTINUE - If compaction should run now
  */
+/*
+ * Watermarks for order-0 must be met for compaction. Note the 2UL.
+ * This is because during migration, copies of pages need to be
+ * allocated and for a short time, the footprint is higher
+ */
+static unsigned long compaction_watermark(struct zone *zone, int order)
+{
+	return low_wmark_pages(zone) + (2UL << order);
+}
+
 unsigned long compaction_suitable(struct zone *zone, int order)
 {
 	int fragindex;
@@ -489,12 +519,7 @@ unsigned long compaction_suitable(struct zone *zone, int order)
 	if (order == -1)
 		return COMPACT_CONTINUE;
 
-	/*
-	 * Watermarks for order-0 must be met for compaction. Note the 2UL.
-	 * This is because during migration, copies of pages need to be
-	 * allocated and for a short time, the footprint is higher
-	 */
-	watermark = low_wmark_pages(zone) + (2UL << order);
+	watermark = compaction_watermark(zone, order);
 	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
 		return COMPACT_SKIPPED;
 
@@ -524,7 +549,17 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 {
 	int ret;
 
-	ret = compaction_suitable(zone, cc->order);
+	/*
+	 * kcompactd picked the zone by its own threshold, which may be
+	 * below sysctl_extfrag_threshold, so it only needs the free pages
+	 * that migration takes.
+	 */
+	if (cc->proactive)
+		ret = zone_watermark_ok(zone, 0,
+				compaction_watermark(zone, cc->order), 0, 0) ?
+			COMPACT_CONTINUE : COMPACT_SKIPPED;
+	else
+		ret = compaction_suitable(zone, cc->order);
 	switch (ret) {
 	case COMPACT_PARTIAL:
 	case COMPACT_SKIPPED:
@@ -540,6 +575,14 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 	cc->free_pfn = cc->migrate_pfn + zone->spanned_pages;
 	cc->free_pfn &= ~(pageblock_nr_pages-1);
 
+	if (cc->proactive &&
+	    zone->compact_resume_migrate_pfn >= cc->migrate_pfn &&
+	    zone->compact_resume_migrate_pfn < zone->compact_resume_free_pfn &&
+	    zone->compact_resume_free_pfn <= cc->free_pfn) {
+		cc->migrate_pfn = zone->compact_resume_migrate_pfn;
+		cc->free_pfn = zone->compact_resume_free_pfn;
+	}
+
 	migrate_prep_local();
 
 	while ((ret = compact_finished(zone, cc)) == COMPACT_CONTINUE) {
@@ -583,6 +626,16 @@ out:
 	cc->nr_freepages -= release_freepages(&cc->freepages);
 	VM_BUG_ON(cc->nr_freepages != 0);
 
+	if (cc->proactive) {
+		if (ret == COMPACT_COMPLETE) {
+			zone->compact_resume_migrate_pfn = 0;
+			zone->compact_resume_free_pfn = 0;
+		} else {
+			zone->compact_resume_migrate_pfn = cc->migrate_pfn;
+			zone->compact_resume_free_pfn = cc->free_pfn;
+		}
+	}
+
 	return ret;
 }
 
@@ -724,6 +777,232 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * kcompactd: proactive compaction
+ *
+ * Every compaction_proactive_interval_ms, each node's kcompactd looks at
+ * the fragmentation index of its zones for compaction_proactive_order.
+ * Zones above compaction_proactive_threshold are compacted with async
+ * migration until the index drops to the threshold or the node has
+ * spent compaction_proactive_budget_ms, whichever comes first, so that
+ * high-order allocations find free blocks instead of stalling in direct
+ * compaction. A zone in which a full pass did not help is skipped for
+ * an exponentially growing number of intervals.
+ */
+int sysctl_compaction_proactive_order = PAGE_ALLOC_COSTLY_ORDER;
+int sysctl_compaction_proactive_threshold = 500;
+int sysctl_compaction_proactive_interval_ms = 1000;
+int sysctl_compaction_proactive_budget_ms = 20;
+
+/* kcompactd_free_avg[] is eight times the average */
+#define KCOMPACTD_AVG_SHIFT	3
+
+static void kcompactd_wakeup(pg_data_t *pgdat)
+{
+	pgdat->kcompactd_wake = true;
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+static void kcompactd_timer_fn(unsigned long data)
+{
+	kcompactd_wakeup((pg_data_t *)data);
+}
+
+/* Fold the node's current free block counts into the running averages */
+static void kcompactd_sample(pg_data_t *pgdat)
+{
+	unsigned long nr_free[MAX_ORDER] = { 0 };
+	int zoneid, order;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		for (order = 0; order < MAX_ORDER; order++)
+			nr_free[order] += zone->free_area[order].nr_free;
+	}
+
+	for (order = 0; order < MAX_ORDER; order++)
+		pgdat->kcompactd_free_avg[order] += nr_free[order] -
+			(pgdat->kcompactd_free_avg[order] >> KCOMPACTD_AVG_SHIFT);
+}
+
+static void kcompactd_compact_zone(struct zone *zone, int order,
+				   unsigned long deadline)
+{
+	struct compact_control cc = {
+		.nr_freepages = 0,
+		.nr_migratepages = 0,
+		.order = order,
+		.zone = zone,
+		.sync = false,
+		.proactive = true,
+		.deadline = deadline,
+	};
+	int ret;
+
+	INIT_LIST_HEAD(&cc.freepages);
+	INIT_LIST_HEAD(&cc.migratepages);
+
+	ret = compact_zone(zone, &cc);
+
+	VM_BUG_ON(!list_empty(&cc.freepages));
+	VM_BUG_ON(!list_empty(&cc.migratepages));
+
+	if (fragmentation_index(zone, order) <=
+	    sysctl_compaction_proactive_threshold) {
+		count_vm_event(KCOMPACTD_SUCCESS);
+		zone->kcompactd_defer_shift = 0;
+	} else if (ret == COMPACT_COMPLETE || ret == COMPACT_SKIPPED) {
+		count_vm_event(KCOMPACTD_FAIL);
+		if (zone->kcompactd_defer_shift < COMPACT_MAX_DEFER_SHIFT)
+			zone->kcompactd_defer_shift++;
+		zone->kcompactd_skip = 1U << zone->kcompactd_defer_shift;
+	} else {
+		/* out of time, pick up from here next interval */
+		count_vm_event(KCOMPACTD_TIMEOUT);
+	}
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = sysctl_compaction_proactive_order;
+	unsigned long deadline = jiffies +
+		msecs_to_jiffies(sysctl_compaction_proactive_budget_ms);
+	int zoneid;
+
+	count_vm_event(KCOMPACTD_WAKE);
+	kcompactd_sample(pgdat);
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		if (zone->kcompactd_skip) {
+			zone->kcompactd_skip--;
+			continue;
+		}
+		if (fragmentation_index(zone, order) <=
+		    sysctl_compaction_proactive_threshold)
+			continue;
+		if (time_after_eq(jiffies, deadline))
+			break;
+
+		kcompactd_compact_zone(zone, order, deadline);
+	}
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	struct timer_list timer;
+	int interval;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+
+	/* A deferrable timer does not wake an idle cpu just for this */
+	setup_deferrable_timer_on_stack(&timer, kcompactd_timer_fn,
+					(unsigned long)pgdat);
+
+	while (!kthread_should_stop()) {
+		interval = sysctl_compaction_proactive_interval_ms;
+		if (interval)
+			mod_timer(&timer, jiffies + msecs_to_jiffies(interval));
+
+		wait_event_freezable(pgdat->kcompactd_wait,
+				     pgdat->kcompactd_wake ||
+				     kthread_should_stop());
+		pgdat->kcompactd_wake = false;
+
+		if (sysctl_compaction_proactive_interval_ms &&
+		    !kthread_should_stop())
+			kcompactd_do_work(pgdat);
+	}
+
+	del_timer_sync(&timer);
+	destroy_timer_on_stack(&timer);
+	return 0;
+}
+
+/*
+ * Like kswapd_run(), called at boot for every node with memory and by
+ * memory hotplug when a node gains some.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		pr_err("Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+/* Sum of the per-node averages, for /proc/vmstat */
+void kcompactd_free_avg(unsigned long *avg)
+{
+	int nid, order;
+
+	for (order = 0; order < KCOMPACTD_AVG_ORDERS; order++)
+		avg[order] = 0;
+
+	for_each_online_node(nid) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		for (order = 0; order < min(MAX_ORDER, KCOMPACTD_AVG_ORDERS);
+		     order++)
+			avg[order] += pgdat->kcompactd_free_avg[order] >>
+					KCOMPACTD_AVG_SHIFT;
+	}
+}
+
+/* Any change to the proactive compaction tunables takes effect now */
+int sysctl_compaction_proactive_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret, nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		if (NODE_DATA(nid)->kcompactd)
+			kcompactd_wakeup(NODE_DATA(nid));
+	return 0;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
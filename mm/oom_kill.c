@@ -571,6 +571,57 @@ out:
 }
 #endif
 
+#ifdef CONFIG_OOM_ADJ_INDEX
+/*
+ * Thread group leaders hashed by signal->oom_adj, so that a caller that
+ * only wants the processes with the highest oom_adj does not have to walk
+ * the whole task list. Fork, exit and exec add and remove leaders with
+ * tasklist_lock write-locked. An oom_adj write only moves its leader
+ * between buckets, so it takes tasklist_lock read-locked to keep the
+ * leader in the index, and oom_adj_index_lock. Walkers hold both.
+ */
+struct hlist_head oom_adj_index[OOM_ADJ_INDEX_SIZE];
+DEFINE_SPINLOCK(oom_adj_index_lock);
+
+void oom_adj_index_add(struct task_struct *p)
+{
+	hlist_add_head(&p->oom_adj_node, oom_adj_index_head(p->signal->oom_adj));
+}
+
+void oom_adj_index_del(struct task_struct *p)
+{
+	hlist_del_init(&p->oom_adj_node);
+}
+
+/* A non-leader thread execs and takes over from the old leader */
+void oom_adj_index_replace(struct task_struct *old, struct task_struct *new)
+{
+	hlist_add_before(&new->oom_adj_node, &old->oom_adj_node);
+	hlist_del_init(&old->oom_adj_node);
+}
+
+/*
+ * Rehash @p's thread group after its oom_adj changed. Must be called
+ * without task_lock or the sighand lock held.
+ */
+void oom_adj_index_update(struct task_struct *p)
+{
+	struct task_struct *leader;
+
+	read_lock(&tasklist_lock);
+	if (pid_alive(p)) {
+		leader = p->group_leader;
+		spin_lock(&oom_adj_index_lock);
+		if (!hlist_unhashed(&leader->oom_adj_node)) {
+			hlist_del(&leader->oom_adj_node);
+			oom_adj_index_add(leader);
+		}
+		spin_unlock(&oom_adj_index_lock);
+	}
+	read_unlock(&tasklist_lock);
+}
+#endif
+
 static BLOCKING_NOTIFIER_HEAD(oom_notify_list);
 
 int register_oom_notifier(struct notifier_block *nb)
@@ -97,6 +97,7 @@ EXPORT_SYMBOL(node_states);
 unsigned long totalram_pages __read_mostly;
 unsigned long totalreserve_pages __read_mostly;
 int percpu_pagelist_fraction;
+int percpu_pagelist_max_order = PCP_MAX_ORDER;
 gfp_t gfp_allowed_mask __read_mostly = GFP_BOOT_MASK;
 
 #ifdef CONFIG_PM_SLEEP
@@ -595,9 +596,9 @@ static inline int free_pages_check(struct page *page)
 }
 
 /*
- * Frees a number of pages from the PCP lists
+ * Frees a number of blocks of the given order from the PCP lists
  * Assumes all pages on list are in same zone, and of same order.
- * count is the number of pages to free.
+ * count is the number of blocks to free.
  *
  * If the zone was previously in an "all pages pinned" state then look to
  * see if this freeing clears that state.
@@ -605,8 +606,8 @@ static inline int free_pages_check(struct page *page)
  * And clear the zone's pages_scanned counter, to hold off the "all pages are
  * pinned" detection logic.
  */
-static void free_pcppages_bulk(struct zone *zone, int count,
-					struct per_cpu_pages *pcp)
+static void __free_pcppages_bulk(struct zone *zone, int count,
+					struct list_head *lists, int order)
 {
 	int migratetype = 0;
 	int batch_free = 0;
@@ -631,7 +632,7 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			batch_free++;
 			if (++migratetype == MIGRATE_PCPTYPES)
 				migratetype = 0;
-			list = &pcp->lists[migratetype];
+			list = &lists[migratetype];
 		} while (list_empty(list));
 
 		/* This is the only non-empty list. Free them all. */
@@ -643,14 +644,20 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			/* must delete as __free_one_page list manipulates */
 			list_del(&page->lru);
 			/* MIGRATE_MOVABLE list may include MIGRATE_RESERVEs */
-			__free_one_page(page, zone, 0, page_private(page));
-			trace_mm_page_pcpu_drain(page, 0, page_private(page));
+			__free_one_page(page, zone, order, page_private(page));
+			trace_mm_page_pcpu_drain(page, order, page_private(page));
 		} while (--to_free && --batch_free && !list_empty(list));
 	}
-	__mod_zone_page_state(zone, NR_FREE_PAGES, count);
+	__mod_zone_page_state(zone, NR_FREE_PAGES, count << order);
 	spin_unlock(&zone->lock);
 }
 
+static void free_pcppages_bulk(struct zone *zone, int count,
+					struct per_cpu_pages *pcp)
+{
+	__free_pcppages_bulk(zone, count, pcp->lists, 0);
+}
+
 static void free_one_page(struct zone *zone, struct page *page, int order,
 				int migratetype)
 {
@@ -663,6 +670,78 @@ static void free_one_page(struct zone *zone, struct page *page, int order,
 	spin_unlock(&zone->lock);
 }
 
+/*
+ * Blocks of order 1 to percpu_pagelist_max_order are kept on per-cpu
+ * lists too, for kernel stacks, slab caches and network buffers that
+ * are freed and allocated again at a rate where zone->lock shows up.
+ * Each order moves pcp->batch >> order blocks, but at least two, to and
+ * from the buddy lists at a time, and holds up to four of those batches
+ * within the pages pcp->high allows. With the default batch of 31 that
+ * is 15, 7 and 3 blocks per batch for orders 1, 2 and 3.
+ */
+static inline int pcp_order_batch(struct per_cpu_pages *pcp, int order)
+{
+	return max(2, pcp->batch >> order);
+}
+
+static inline int pcp_order_high(struct per_cpu_pages *pcp, int order)
+{
+	/* the boot pagesets, shared by all zones, have pcp->high == 0 */
+	return min(4 * pcp_order_batch(pcp, order), pcp->high >> order);
+}
+
+/* Returns all blocks on the order lists of pcp to the buddy lists */
+static void drain_pcp_orders(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	int order;
+
+	for (order = 1; order <= PCP_MAX_ORDER; order++) {
+		int *count = &pcp->order_count[order - 1];
+
+		if (*count) {
+			__free_pcppages_bulk(zone, *count,
+					pcp->order_lists[order - 1], order);
+			*count = 0;
+		}
+	}
+}
+
+/*
+ * Frees a block to this cpu's order lists. Called with interrupts
+ * disabled.
+ */
+static void free_pcp_order(struct zone *zone, struct page *page, int order,
+				int migratetype)
+{
+	struct per_cpu_pages *pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	int *count = &pcp->order_count[order - 1];
+
+	/*
+	 * Below the low watermark a block is more use merging in the
+	 * buddy lists than cached here, and so are those already cached.
+	 */
+	if (unlikely(migratetype == MIGRATE_ISOLATE ||
+		     zone_page_state(zone, NR_FREE_PAGES) <
+		     low_wmark_pages(zone))) {
+		free_one_page(zone, page, order, migratetype);
+		drain_pcp_orders(zone, pcp);
+		return;
+	}
+
+	/* As for order 0, MIGRATE_RESERVE blocks go on the movable list */
+	set_page_private(page, migratetype);
+	if (migratetype >= MIGRATE_PCPTYPES)
+		migratetype = MIGRATE_MOVABLE;
+	list_add(&page->lru, &pcp->order_lists[order - 1][migratetype]);
+	if (++*count >= pcp_order_high(pcp, order)) {
+		int batch = min(*count, pcp_order_batch(pcp, order));
+
+		__free_pcppages_bulk(zone, batch,
+				pcp->order_lists[order - 1], order);
+		*count -= batch;
+	}
+}
+
 static bool free_pages_prepare(struct page *page, unsigned int order)
 {
 	int i;
@@ -701,7 +780,12 @@ static void __free_pages_ok(struct page *page, unsigned int order)
 	if (unlikely(wasMlocked))
 		free_page_mlock(page);
 	__count_vm_events(PGFREE, 1 << order);
-	free_one_page(page_zone(page), page, order,
+	/* the sysctl can change under us; one read decides */
+	if (order && order <= ACCESS_ONCE(percpu_pagelist_max_order))
+		free_pcp_order(page_zone(page), page, order,
+					get_pageblock_migratetype(page));
+	else
+		free_one_page(page_zone(page), page, order,
 					get_pageblock_migratetype(page));
 	local_irq_restore(flags);
 }
@@ -1086,8 +1170,11 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 		to_drain = pcp->batch;
 	else
 		to_drain = pcp->count;
-	free_pcppages_bulk(zone, to_drain, pcp);
-	pcp->count -= to_drain;
+	if (to_drain) {
+		free_pcppages_bulk(zone, to_drain, pcp);
+		pcp->count -= to_drain;
+	}
+	drain_pcp_orders(zone, pcp);
 	local_irq_restore(flags);
 }
 #endif
@@ -1116,6 +1203,7 @@ static void drain_pages(unsigned int cpu)
 			free_pcppages_bulk(zone, pcp->count, pcp);
 			pcp->count = 0;
 		}
+		drain_pcp_orders(zone, pcp);
 		local_irq_restore(flags);
 	}
 }
@@ -1334,6 +1422,30 @@ again:
 
 		list_del(&page->lru);
 		pcp->count--;
+	} else if (order <= ACCESS_ONCE(percpu_pagelist_max_order)) {
+		struct per_cpu_pages *pcp;
+		struct list_head *list;
+
+		WARN_ON_ONCE((gfp_flags & __GFP_NOFAIL) && order > 1);
+
+		local_irq_save(flags);
+		pcp = &this_cpu_ptr(zone->pageset)->pcp;
+		list = &pcp->order_lists[order - 1][migratetype];
+		if (list_empty(list)) {
+			pcp->order_count[order - 1] += rmqueue_bulk(zone, order,
+					pcp_order_batch(pcp, order), list,
+					migratetype, cold);
+			if (unlikely(list_empty(list)))
+				goto failed;
+		}
+
+		if (cold)
+			page = list_entry(list->prev, struct page, lru);
+		else
+			page = list_entry(list->next, struct page, lru);
+
+		list_del(&page->lru);
+		pcp->order_count[order - 1]--;
 	} else {
 		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
 			/*
@@ -3585,7 +3697,7 @@ static int zone_batchsize(struct zone *zone)
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int migratetype, order;
 
 	memset(p, 0, sizeof(*p));
 
@@ -3595,6 +3707,10 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->batch = max(1UL, 1 * batch);
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	for (order = 0; order < PCP_MAX_ORDER; order++)
+		for (migratetype = 0; migratetype < MIGRATE_PCPTYPES;
+							migratetype++)
+			INIT_LIST_HEAD(&pcp->order_lists[order][migratetype]);
 }
 
 /*
@@ -3702,6 +3818,7 @@ static int __zone_pcp_update(void *data)
 
 		local_irq_save(flags);
 		free_pcppages_bulk(zone, pcp->count, pcp);
+		drain_pcp_orders(zone, pcp);
 		setup_pageset(pset, batch);
 		local_irq_restore(flags);
 	}
@@ -4306,6 +4423,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat_resize_init(pgdat);
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat->kswapd_max_order = 0;
 	pgdat_page_cgroup_init(pgdat);
 	
@@ -5382,6 +5502,23 @@ int percpu_pagelist_fraction_sysctl_handler(ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * percpu_pagelist_max_order - the highest order, besides order 0, that is
+ * kept on the per cpu pagelists. 0 frees all higher orders straight to
+ * the buddy allocator. Blocks already cached are returned on every change.
+ */
+int percpu_pagelist_max_order_sysctl_handler(ctl_table *table, int write,
+	void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (!write || ret)
+		return ret;
+	drain_all_pages();
+	return 0;
+}
+
 int hashdist = HASHDIST_DEFAULT;
 
 #ifdef CONFIG_NUMA
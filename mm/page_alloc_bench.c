@@ -0,0 +1,184 @@
+/*
+ * Page allocator throughput benchmark
+ *
+ * For each order from min_order to max_order, a thread bound to every
+ * online cpu allocates batch blocks of that order and frees them again,
+ * iterations times over, all threads starting together. The time per
+ * allocation and free, and the throughput of all cpus together, go to
+ * the kernel log. The module then fails to load with -EAGAIN, so that
+ * it can be loaded again straight away, for instance to compare
+ *
+ *	echo 0 > /proc/sys/vm/percpu_pagelist_max_order
+ *	insmod page_alloc_bench.ko max_order=3
+ *	echo 3 > /proc/sys/vm/percpu_pagelist_max_order
+ *	insmod page_alloc_bench.ko max_order=3
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/cpu.h>
+#include <linux/wait.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+static unsigned int min_order;
+module_param(min_order, uint, 0444);
+MODULE_PARM_DESC(min_order, "Lowest order to measure (default 0)");
+
+static unsigned int max_order = PAGE_ALLOC_COSTLY_ORDER;
+module_param(max_order, uint, 0444);
+MODULE_PARM_DESC(max_order, "Highest order to measure (default 3)");
+
+static unsigned int iterations = 10000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Rounds of allocation per cpu (default 10000)");
+
+static unsigned int batch = 16;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "Blocks allocated before freeing them (default 16)");
+
+struct bench_thread {
+	struct task_struct *task;
+	struct completion done;
+	struct page **pages;
+	unsigned int order;
+	unsigned long failed;
+	u64 ns;
+};
+
+static DECLARE_WAIT_QUEUE_HEAD(bench_wait);
+static bool bench_go;
+
+static int bench_thread_fn(void *data)
+{
+	struct bench_thread *t = data;
+	unsigned int i, j;
+	ktime_t start;
+
+	wait_event(bench_wait, bench_go);
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < batch; j++)
+			t->pages[j] = alloc_pages(GFP_KERNEL | __GFP_NOWARN,
+						  t->order);
+		for (j = 0; j < batch; j++) {
+			if (t->pages[j])
+				__free_pages(t->pages[j], t->order);
+			else
+				t->failed++;
+		}
+		cond_resched();
+	}
+	t->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	/* the module text may be gone as soon as the last thread is done */
+	complete_and_exit(&t->done, 0);
+}
+
+static int bench_order(unsigned int order)
+{
+	struct bench_thread *threads;
+	unsigned int cpu, i, nr = 0;
+	u64 ops, total_ns = 0, wall_ns = 0;
+	unsigned long failed = 0;
+	int ret = 0;
+
+	get_online_cpus();
+	threads = kcalloc(num_online_cpus(), sizeof(*threads), GFP_KERNEL);
+	if (!threads) {
+		put_online_cpus();
+		return -ENOMEM;
+	}
+
+	bench_go = false;
+	for_each_online_cpu(cpu) {
+		struct bench_thread *t = &threads[nr];
+
+		t->order = order;
+		t->pages = kcalloc(batch, sizeof(*t->pages), GFP_KERNEL);
+		if (!t->pages) {
+			ret = -ENOMEM;
+			break;
+		}
+		init_completion(&t->done);
+		t->task = kthread_create(bench_thread_fn, t,
+					 "page_alloc_bench/%u", cpu);
+		if (IS_ERR(t->task)) {
+			ret = PTR_ERR(t->task);
+			kfree(t->pages);
+			break;
+		}
+		kthread_bind(t->task, cpu);
+		nr++;
+	}
+
+	/* threads stopped before they are first woken never run */
+	for (i = 0; i < nr; i++) {
+		if (ret)
+			kthread_stop(threads[i].task);
+		else
+			wake_up_process(threads[i].task);
+	}
+
+	if (!ret) {
+		bench_go = true;
+		wake_up_all(&bench_wait);
+
+		for (i = 0; i < nr; i++) {
+			wait_for_completion(&threads[i].done);
+			total_ns += threads[i].ns;
+			wall_ns = max(wall_ns, threads[i].ns);
+			failed += threads[i].failed;
+		}
+	}
+	put_online_cpus();
+
+	for (i = 0; i < nr; i++)
+		kfree(threads[i].pages);
+	kfree(threads);
+
+	if (ret)
+		return ret;
+
+	ops = (u64)iterations * batch;
+	pr_info("page_alloc_bench: order %u: %u cpus, %llu ns per block, "
+		"%llu blocks/s in total, %lu failed\n", order, nr,
+		div64_u64(total_ns, ops * nr),
+		div64_u64(ops * nr * NSEC_PER_SEC, max_t(u64, wall_ns, 1)),
+		failed);
+	return 0;
+}
+
+static int __init page_alloc_bench_init(void)
+{
+	unsigned int order;
+	int ret;
+
+	if (min_order > max_order || max_order >= MAX_ORDER ||
+	    !iterations || !batch)
+		return -EINVAL;
+
+	for (order = min_order; order <= max_order; order++) {
+		ret = bench_order(order);
+		if (ret)
+			return ret;
+	}
+	return -EAGAIN;
+}
+module_init(page_alloc_bench_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Page allocator throughput benchmark");
@@ -0,0 +1,277 @@
+/*
+ * VM pressure
+ *
+ * Turns the reclaim efficiency of the page scanner into a pressure level.
+ * Every time reclaim has scanned a window's worth of LRU pages, the share
+ * of them it could not reclaim becomes the current pressure, in percent.
+ * Userspace can poll() /sys/kernel/mm/vmpressure/level for level changes
+ * and in-kernel users such as the Android low memory killer can register
+ * a notifier.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/log2.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/swap.h>
+#include <linux/vmpressure.h>
+
+/*
+ * Number of scanned pages after which the pressure is recomputed. Smaller
+ * windows react faster but are noisier.
+ */
+static unsigned long vmpressure_win = SWAP_CLUSTER_MAX * 16;
+
+/* Pressure, in percent, at which the medium and critical levels start */
+static unsigned int vmpressure_level_med = 60;
+static unsigned int vmpressure_level_critical = 95;
+
+/*
+ * Reclaim that has had to drop to this scan priority is struggling no
+ * matter what the last window said; it is reported as critical.
+ */
+static const int vmpressure_level_critical_prio = ilog2(100 / 10);
+
+static DEFINE_SPINLOCK(vmpressure_lock);
+static unsigned long vmpressure_scanned;
+static unsigned long vmpressure_reclaimed;
+
+/* Outcome of the last complete window */
+static unsigned int vmpressure_last;
+static enum vmpressure_levels vmpressure_last_level;
+
+static const char * const vmpressure_str_levels[] = {
+	[VMPRESSURE_LOW] = "low",
+	[VMPRESSURE_MEDIUM] = "medium",
+	[VMPRESSURE_CRITICAL] = "critical",
+};
+
+static BLOCKING_NOTIFIER_HEAD(vmpressure_notify_list);
+static struct kobject *vmpressure_kobj;
+
+static unsigned int vmpressure_calc(unsigned long scanned,
+				    unsigned long reclaimed)
+{
+	/* reclaim can free more than it scanned, e.g. compound pages */
+	if (reclaimed >= scanned)
+		return 0;
+	return 100 - reclaimed * 100 / scanned;
+}
+
+static enum vmpressure_levels vmpressure_level(unsigned int pressure)
+{
+	if (pressure >= vmpressure_level_critical)
+		return VMPRESSURE_CRITICAL;
+	else if (pressure >= vmpressure_level_med)
+		return VMPRESSURE_MEDIUM;
+	return VMPRESSURE_LOW;
+}
+
+static void vmpressure_work_fn(struct work_struct *work)
+{
+	unsigned long scanned, reclaimed;
+	enum vmpressure_levels level, old;
+	unsigned int pressure;
+
+	spin_lock(&vmpressure_lock);
+	scanned = vmpressure_scanned;
+	reclaimed = vmpressure_reclaimed;
+	vmpressure_scanned = 0;
+	vmpressure_reclaimed = 0;
+	spin_unlock(&vmpressure_lock);
+
+	if (!scanned)
+		return;
+
+	pressure = vmpressure_calc(scanned, reclaimed);
+	level = vmpressure_level(pressure);
+	old = vmpressure_last_level;
+	vmpressure_last = pressure;
+	vmpressure_last_level = level;
+
+	blocking_notifier_call_chain(&vmpressure_notify_list, level, &pressure);
+
+	/* wake up pollers on every change and while under pressure */
+	if (vmpressure_kobj && (level != old || level != VMPRESSURE_LOW))
+		sysfs_notify(vmpressure_kobj, NULL, "level");
+}
+
+static DECLARE_WORK(vmpressure_work, vmpressure_work_fn);
+
+/**
+ * vmpressure() - account reclaim efficiency
+ * @gfp:	reclaimer's gfp mask
+ * @scanned:	number of pages scanned
+ * @reclaimed:	number of pages reclaimed
+ *
+ * Called from the global reclaim paths of vmscan after each zone has been
+ * shrunk. Allocations that can neither do I/O nor use highmem or movable
+ * pages tell us little about the state of the system and are ignored.
+ */
+void vmpressure(gfp_t gfp, unsigned long scanned, unsigned long reclaimed)
+{
+	if (!(gfp & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_IO | __GFP_FS)))
+		return;
+	if (!scanned)
+		return;
+
+	spin_lock(&vmpressure_lock);
+	vmpressure_scanned += scanned;
+	vmpressure_reclaimed += reclaimed;
+	scanned = vmpressure_scanned;
+	spin_unlock(&vmpressure_lock);
+
+	if (scanned >= vmpressure_win)
+		schedule_work(&vmpressure_work);
+}
+
+/**
+ * vmpressure_prio() - account reclaim priority
+ * @gfp:	reclaimer's gfp mask
+ * @prio:	reclaimer's scan priority
+ *
+ * Reports a window with nothing reclaimed once the reclaimer has lowered
+ * its priority far enough, so that a stream of reclaim passes that each
+ * free a little but never enough still shows up as critical.
+ */
+void vmpressure_prio(gfp_t gfp, int prio)
+{
+	if (prio > vmpressure_level_critical_prio)
+		return;
+
+	vmpressure(gfp, vmpressure_win, 0);
+}
+
+int vmpressure_register_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&vmpressure_notify_list, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_register_notifier);
+
+int vmpressure_unregister_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&vmpressure_notify_list, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_unregister_notifier);
+
+#define VMPRESSURE_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+#define VMPRESSURE_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static ssize_t level_show(struct kobject *kobj, struct kobj_attribute *attr,
+			  char *buf)
+{
+	return sprintf(buf, "%s\n",
+		       vmpressure_str_levels[vmpressure_last_level]);
+}
+VMPRESSURE_ATTR_RO(level);
+
+static ssize_t pressure_show(struct kobject *kobj,
+			     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", vmpressure_last);
+}
+VMPRESSURE_ATTR_RO(pressure);
+
+static ssize_t window_show(struct kobject *kobj, struct kobj_attribute *attr,
+			   char *buf)
+{
+	return sprintf(buf, "%lu\n", vmpressure_win);
+}
+
+static ssize_t window_store(struct kobject *kobj, struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	unsigned long win;
+	int err;
+
+	err = strict_strtoul(buf, 10, &win);
+	if (err || !win)
+		return -EINVAL;
+
+	vmpressure_win = win;
+	return count;
+}
+VMPRESSURE_ATTR(window);
+
+static ssize_t medium_show(struct kobject *kobj, struct kobj_attribute *attr,
+			   char *buf)
+{
+	return sprintf(buf, "%u\n", vmpressure_level_med);
+}
+
+static ssize_t medium_store(struct kobject *kobj, struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	unsigned long val;
+	int err;
+
+	err = strict_strtoul(buf, 10, &val);
+	if (err || val > vmpressure_level_critical)
+		return -EINVAL;
+
+	vmpressure_level_med = val;
+	return count;
+}
+VMPRESSURE_ATTR(medium);
+
+static ssize_t critical_show(struct kobject *kobj,
+			     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", vmpressure_level_critical);
+}
+
+static ssize_t critical_store(struct kobject *kobj,
+			      struct kobj_attribute *attr,
+			      const char *buf, size_t count)
+{
+	unsigned long val;
+	int err;
+
+	err = strict_strtoul(buf, 10, &val);
+	if (err || val > 100 || val < vmpressure_level_med)
+		return -EINVAL;
+
+	vmpressure_level_critical = val;
+	return count;
+}
+VMPRESSURE_ATTR(critical);
+
+static struct attribute *vmpressure_attrs[] = {
+	&level_attr.attr,
+	&pressure_attr.attr,
+	&window_attr.attr,
+	&medium_attr.attr,
+	&critical_attr.attr,
+	NULL,
+};
+
+static struct attribute_group vmpressure_attr_group = {
+	.attrs = vmpressure_attrs,
+};
+
+static int __init vmpressure_init(void)
+{
+	int err;
+
+	vmpressure_kobj = kobject_create_and_add("vmpressure", mm_kobj);
+	if (!vmpressure_kobj)
+		return -ENOMEM;
+
+	err = sysfs_create_group(vmpressure_kobj, &vmpressure_attr_group);
+	if (err) {
+		printk(KERN_ERR "vmpressure: register sysfs failed\n");
+		kobject_put(vmpressure_kobj);
+		vmpressure_kobj = NULL;
+	}
+	return err;
+}
+module_init(vmpressure_init);
@@ -43,11 +43,15 @@
 #include <linux/sysctl.h>
 #include <linux/oom.h>
 #include <linux/prefetch.h>
+#include <linux/ktime.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
 
 #include <linux/swapops.h>
+#include <linux/vmpressure.h>
 
 #include "internal.h"
 
@@ -76,6 +80,9 @@ struct scan_control {
 	/* Incremented by the number of inactive pages that were scanned */
 	unsigned long nr_scanned;
 
+	/* nr_scanned summed over all priorities of do_try_to_free_pages() */
+	unsigned long total_scanned;
+
 	/* Number of pages freed so far during a call to shrink_zones() */
 	unsigned long nr_reclaimed;
 
@@ -152,6 +159,45 @@ long vm_total_pages;	/* The total number of pages which the VM controls */
 static LIST_HEAD(shrinker_list);
 static DECLARE_RWSEM(shrinker_rwsem);
 
+/*
+ * Latency of direct reclaim as a whole, split into order-0 and higher
+ * order callers, of each zone's share of it, and of every shrinker call
+ * from any reclaimer. The counters are per cpu, so that reclaimers share
+ * neither a lock nor a cache line, and are summed up when read. Zones
+ * and shrinkers have none until reclaimstat_init() and
+ * register_shrinker() respectively have allocated them.
+ */
+static DEFINE_PER_CPU(struct reclaim_lat, direct_reclaim_lat[2]);
+
+static u32 reclaim_lat_us(ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+
+	if (us < 0)
+		return 0;
+	return min_t(s64, us, UINT_MAX);
+}
+
+static void reclaim_lat_add(struct reclaim_lat __percpu *pcp, u32 us,
+			    unsigned long nr_scanned,
+			    unsigned long nr_reclaimed)
+{
+	struct reclaim_lat *lat;
+
+	if (!pcp)
+		return;
+
+	lat = get_cpu_ptr(pcp);
+	lat->bucket[min(fls(us), RECLAIM_LAT_BUCKETS - 1)]++;
+	lat->count++;
+	lat->total_us += us;
+	if (us > lat->max_us)
+		lat->max_us = us;
+	lat->nr_scanned += nr_scanned;
+	lat->nr_reclaimed += nr_reclaimed;
+	put_cpu_ptr(pcp);
+}
+
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
 #define scanning_global_lru(sc)	(!(sc)->mem_cgroup)
 #else
@@ -184,6 +230,8 @@ static unsigned long zone_nr_lru_pages(struct zone *zone,
 void register_shrinker(struct shrinker *shrinker)
 {
 	shrinker->nr = 0;
+	/* without it the shrinker just goes unaccounted */
+	shrinker->lat = alloc_percpu(struct reclaim_lat);
 	down_write(&shrinker_rwsem);
 	list_add_tail(&shrinker->list, &shrinker_list);
 	up_write(&shrinker_rwsem);
@@ -198,6 +246,8 @@ void unregister_shrinker(struct shrinker *shrinker)
 	down_write(&shrinker_rwsem);
 	list_del(&shrinker->list);
 	up_write(&shrinker_rwsem);
+	free_percpu(shrinker->lat);
+	shrinker->lat = NULL;
 }
 EXPORT_SYMBOL(unregister_shrinker);
 
@@ -249,11 +299,14 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 		unsigned long long delta;
 		unsigned long total_scan;
 		unsigned long max_pass;
+		unsigned long scanned = 0, freed = 0;
 		int shrink_ret = 0;
 		long nr;
 		long new_nr;
 		long batch_size = shrinker->batch ? shrinker->batch
 						  : SHRINK_BATCH;
+		ktime_t start = ktime_get();
+		u32 lat_us;
 
 		/*
 		 * copy the current shrinker scan count into a local variable
@@ -313,7 +366,8 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 			if (shrink_ret == -1)
 				break;
 			if (shrink_ret < nr_before)
-				ret += nr_before - shrink_ret;
+				freed += nr_before - shrink_ret;
+			scanned += batch_size;
 			count_vm_events(SLABS_SCANNED, batch_size);
 			total_scan -= batch_size;
 
@@ -332,7 +386,11 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 				break;
 		} while (cmpxchg(&shrinker->nr, nr, new_nr) != nr);
 
-		trace_mm_shrink_slab_end(shrinker, shrink_ret, nr, new_nr);
+		ret += freed;
+		lat_us = reclaim_lat_us(start);
+		reclaim_lat_add(shrinker->lat, lat_us, scanned, freed);
+		trace_mm_shrink_slab_end(shrinker, shrink_ret, nr, new_nr,
+					 freed, lat_us);
 	}
 	up_read(&shrinker_rwsem);
 out:
@@ -2014,6 +2072,10 @@ restart:
 	}
 	sc->nr_reclaimed += nr_reclaimed;
 
+	if (scanning_global_lru(sc))
+		vmpressure(sc->gfp_mask, sc->nr_scanned - nr_scanned,
+			   nr_reclaimed);
+
 	/*
 	 * Even if we did not try to evict anon pages at all, we want to
 	 * rebalance the anon lru active/inactive ratio.
@@ -2052,6 +2114,9 @@ static void shrink_zones(int priority, struct zonelist *zonelist,
 	struct zone *zone;
 	unsigned long nr_soft_reclaimed;
 	unsigned long nr_soft_scanned;
+	unsigned long nr_scanned, nr_reclaimed;
+	ktime_t start;
+	u32 lat_us;
 
 	for_each_zone_zonelist_nodemask(zone, z, zonelist,
 					gfp_zone(sc->gfp_mask), sc->nodemask) {
@@ -2081,7 +2146,22 @@ static void shrink_zones(int priority, struct zonelist *zonelist,
 			/* need some check for avoid more shrink_zone() */
 		}
 
+		nr_scanned = sc->nr_scanned;
+		nr_reclaimed = sc->nr_reclaimed;
+		start = ktime_get();
+
 		shrink_zone(priority, zone, sc);
+
+		if (!scanning_global_lru(sc) || sc->hibernation_mode)
+			continue;
+		nr_scanned = sc->nr_scanned - nr_scanned;
+		nr_reclaimed = sc->nr_reclaimed - nr_reclaimed;
+		lat_us = reclaim_lat_us(start);
+		reclaim_lat_add(zone->direct_reclaim_lat, lat_us,
+				nr_scanned, nr_reclaimed);
+		trace_mm_vmscan_direct_shrink_zone(zone_to_nid(zone),
+				zone_idx(zone), priority, nr_scanned,
+				nr_reclaimed, lat_us);
 	}
 }
 
@@ -2131,7 +2211,6 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 					struct shrink_control *shrink)
 {
 	int priority;
-	unsigned long total_scanned = 0;
 	struct reclaim_state *reclaim_state = current->reclaim_state;
 	struct zoneref *z;
 	struct zone *zone;
@@ -2147,6 +2226,8 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		sc->nr_scanned = 0;
 		if (!priority)
 			disable_swap_token(sc->mem_cgroup);
+		if (scanning_global_lru(sc))
+			vmpressure_prio(sc->gfp_mask, priority);
 		shrink_zones(priority, zonelist, sc);
 		/*
 		 * Don't shrink slabs when reclaiming memory from
@@ -2168,7 +2249,7 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 				reclaim_state->reclaimed_slab = 0;
 			}
 		}
-		total_scanned += sc->nr_scanned;
+		sc->total_scanned += sc->nr_scanned;
 		if (sc->nr_reclaimed >= sc->nr_to_reclaim)
 			goto out;
 
@@ -2180,8 +2261,9 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		 * writeout.  So in laptop mode, write out the whole world.
 		 */
 		writeback_threshold = sc->nr_to_reclaim + sc->nr_to_reclaim / 2;
-		if (total_scanned > writeback_threshold) {
-			wakeup_flusher_threads(laptop_mode ? 0 : total_scanned);
+		if (sc->total_scanned > writeback_threshold) {
+			wakeup_flusher_threads(laptop_mode ? 0 :
+					       sc->total_scanned);
 			sc->may_writepage = 1;
 		}
 
@@ -2236,6 +2318,8 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 	struct shrink_control shrink = {
 		.gfp_mask = sc.gfp_mask,
 	};
+	ktime_t start = ktime_get();
+	u32 lat_us;
 
 	trace_mm_vmscan_direct_reclaim_begin(order,
 				sc.may_writepage,
@@ -2245,6 +2329,12 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 
 	trace_mm_vmscan_direct_reclaim_end(nr_reclaimed);
 
+	lat_us = reclaim_lat_us(start);
+	reclaim_lat_add(&direct_reclaim_lat[order > 0], lat_us,
+			sc.total_scanned, sc.nr_reclaimed);
+	trace_mm_vmscan_direct_reclaim_latency(order, sc.total_scanned,
+					       sc.nr_reclaimed, lat_us);
+
 	return nr_reclaimed;
 }
 
@@ -3015,6 +3105,133 @@ static int __init kswapd_init(void)
 
 module_init(kswapd_init)
 
+#ifdef CONFIG_PROC_FS
+static void reclaim_lat_show(struct seq_file *m, const char *unit,
+			     struct reclaim_lat __percpu *pcp)
+{
+	struct reclaim_lat lat;
+	int cpu, i;
+
+	memset(&lat, 0, sizeof(lat));
+	for_each_possible_cpu(cpu) {
+		struct reclaim_lat *src = per_cpu_ptr(pcp, cpu);
+
+		for (i = 0; i < RECLAIM_LAT_BUCKETS; i++)
+			lat.bucket[i] += src->bucket[i];
+		lat.count += src->count;
+		lat.total_us += src->total_us;
+		lat.max_us = max(lat.max_us, src->max_us);
+		lat.nr_scanned += src->nr_scanned;
+		lat.nr_reclaimed += src->nr_reclaimed;
+	}
+
+	seq_printf(m, "count %u avg %lluus max %uus %s scanned %lu reclaimed %lu\n",
+		   lat.count, lat.count ? div_u64(lat.total_us, lat.count) : 0,
+		   lat.max_us, unit, lat.nr_scanned, lat.nr_reclaimed);
+	for (i = 0; i < RECLAIM_LAT_BUCKETS; i++) {
+		if (!lat.bucket[i])
+			continue;
+		if (i == RECLAIM_LAT_BUCKETS - 1)
+			seq_printf(m, "  >= %uus: %u\n", 1U << (i - 1),
+				   lat.bucket[i]);
+		else
+			seq_printf(m, "  < %uus: %u\n", 1U << i,
+				   lat.bucket[i]);
+	}
+}
+
+static int reclaimstat_show(struct seq_file *m, void *v)
+{
+	struct shrinker *shrinker;
+	struct zone *zone;
+
+	seq_puts(m, "direct reclaim order 0: ");
+	reclaim_lat_show(m, "pages", &direct_reclaim_lat[0]);
+	seq_puts(m, "direct reclaim order > 0: ");
+	reclaim_lat_show(m, "pages", &direct_reclaim_lat[1]);
+
+	for_each_populated_zone(zone) {
+		if (!zone->direct_reclaim_lat)
+			continue;
+		seq_printf(m, "Node %d, zone %8s: ", zone_to_nid(zone),
+			   zone->name);
+		reclaim_lat_show(m, "pages", zone->direct_reclaim_lat);
+	}
+
+	down_read(&shrinker_rwsem);
+	list_for_each_entry(shrinker, &shrinker_list, list) {
+		if (!shrinker->lat)
+			continue;
+		seq_printf(m, "shrinker %pf: ", shrinker->shrink);
+		reclaim_lat_show(m, "objects", shrinker->lat);
+	}
+	up_read(&shrinker_rwsem);
+	return 0;
+}
+
+/* Racy against concurrent reclaim, which may lose a few samples */
+static void reclaim_lat_reset(struct reclaim_lat __percpu *pcp)
+{
+	int cpu;
+
+	if (!pcp)
+		return;
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(pcp, cpu), 0, sizeof(struct reclaim_lat));
+}
+
+static ssize_t reclaimstat_write(struct file *file, const char __user *ubuf,
+				 size_t count, loff_t *ppos)
+{
+	struct shrinker *shrinker;
+	struct zone *zone;
+	char buf[8];
+
+	if (count > sizeof(buf) - 1)
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+	if (strcmp(strim(buf), "reset"))
+		return -EINVAL;
+
+	reclaim_lat_reset(&direct_reclaim_lat[0]);
+	reclaim_lat_reset(&direct_reclaim_lat[1]);
+	for_each_populated_zone(zone)
+		reclaim_lat_reset(zone->direct_reclaim_lat);
+	down_read(&shrinker_rwsem);
+	list_for_each_entry(shrinker, &shrinker_list, list)
+		reclaim_lat_reset(shrinker->lat);
+	up_read(&shrinker_rwsem);
+	return count;
+}
+
+static int reclaimstat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, reclaimstat_show, NULL);
+}
+
+static const struct file_operations proc_reclaimstat_operations = {
+	.open		= reclaimstat_open,
+	.read		= seq_read,
+	.write		= reclaimstat_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init reclaimstat_init(void)
+{
+	struct zone *zone;
+
+	for_each_populated_zone(zone)
+		zone->direct_reclaim_lat = alloc_percpu(struct reclaim_lat);
+	proc_create("reclaimstat", S_IRUGO | S_IWUSR, NULL,
+		    &proc_reclaimstat_operations);
+	return 0;
+}
+module_init(reclaimstat_init)
+#endif
+
 #ifdef CONFIG_NUMA
 /*
  * Zone reclaim mode
@@ -470,7 +470,8 @@ void refresh_cpu_vm_stats(int cpu)
 		 * Check if there are pages remaining in this pageset
 		 * if not then there is nothing to expire.
 		 */
-		if (!p->expire || !p->pcp.count)
+		if (!p->expire ||
+		    (!p->pcp.count && !pcp_order_blocks(&p->pcp)))
 			continue;
 
 		/*
@@ -485,8 +486,7 @@ void refresh_cpu_vm_stats(int cpu)
 		if (p->expire)
 			continue;
 
-		if (p->pcp.count)
-			drain_zone_pages(zone, &p->pcp);
+		drain_zone_pages(zone, &p->pcp);
 #endif
 	}
 
@@ -721,6 +721,21 @@ const char * const vmstat_text[] = {
 	"nr_dirty_threshold",
 	"nr_dirty_background_threshold",
 
+#ifdef CONFIG_COMPACTION
+	/* KCOMPACTD_AVG_ORDERS of them */
+	"nr_free_order0_avg",
+	"nr_free_order1_avg",
+	"nr_free_order2_avg",
+	"nr_free_order3_avg",
+	"nr_free_order4_avg",
+	"nr_free_order5_avg",
+	"nr_free_order6_avg",
+	"nr_free_order7_avg",
+	"nr_free_order8_avg",
+	"nr_free_order9_avg",
+	"nr_free_order10_avg",
+#endif
+
 #ifdef CONFIG_VM_EVENT_COUNTERS
 	"pgpgin",
 	"pgpgout",
@@ -763,6 +778,10 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_daemon_wake",
+	"compact_daemon_success",
+	"compact_daemon_fail",
+	"compact_daemon_timeout",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -1070,6 +1089,10 @@ static void *vmstat_start(struct seq_file *m, loff_t *pos)
 	stat_items_size = NR_VM_ZONE_STAT_ITEMS * sizeof(unsigned long) +
 			  NR_VM_WRITEBACK_STAT_ITEMS * sizeof(unsigned long);
 
+#ifdef CONFIG_COMPACTION
+	stat_items_size += KCOMPACTD_AVG_ORDERS * sizeof(unsigned long);
+#endif
+
 #ifdef CONFIG_VM_EVENT_COUNTERS
 	stat_items_size += sizeof(struct vm_event_state);
 #endif
@@ -1086,6 +1109,11 @@ static void *vmstat_start(struct seq_file *m, loff_t *pos)
 			    v + NR_DIRTY_THRESHOLD);
 	v += NR_VM_WRITEBACK_STAT_ITEMS;
 
+#ifdef CONFIG_COMPACTION
+	kcompactd_free_avg(v);
+	v += KCOMPACTD_AVG_ORDERS;
+#endif
+
 #ifdef CONFIG_VM_EVENT_COUNTERS
 	all_vm_events(v);
 	v[PGPGIN] /= 2;		/* sectors -> kbytes */
@@ -0,0 +1,466 @@
+/*
+ * binder-bench.c -- measure binder transaction throughput against the
+ *                   number of independent client/server pairs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The program makes itself the binder context manager, so it cannot run
+ * next to servicemanager. See README.
+ */
+
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -I../../../drivers/staging/android -o binder-bench binder-bench.c */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "binder.h"
+
+#define MAP_SZ		(128 * 1024)
+#define MAX_PAIRS	64
+#define MAX_PAYLOAD	4096
+
+/******************** Little Helpers ********************/
+
+static void die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "binder-bench: ");
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	if (errno)
+		fprintf(stderr, ": %s", strerror(errno));
+	fputc('\n', stderr);
+	exit(1);
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/******************** Binder Protocol ********************/
+
+/*
+ * One connection per process. Commands are queued in out[] and go to
+ * the driver with the next read, the way libbinder batches them; what
+ * the driver returns is parsed from in[].
+ */
+struct binder {
+	int fd;
+	char out[512];
+	size_t out_len;
+	char in[512];
+	size_t in_pos, in_len;
+};
+
+static void binder_init(struct binder *b)
+{
+	struct binder_version vers;
+
+	memset(b, 0, sizeof(*b));
+	b->fd = open("/dev/binder", O_RDWR);
+	if (b->fd < 0)
+		die("/dev/binder");
+	if (ioctl(b->fd, BINDER_VERSION, &vers))
+		die("BINDER_VERSION");
+	if (vers.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		errno = 0;
+		die("protocol version %ld, expected %d",
+		    vers.protocol_version, BINDER_CURRENT_PROTOCOL_VERSION);
+	}
+	if (mmap(NULL, MAP_SZ, PROT_READ, MAP_PRIVATE, b->fd, 0) == MAP_FAILED)
+		die("mmap");
+}
+
+static void put(struct binder *b, const void *p, size_t len)
+{
+	if (b->out_len + len > sizeof(b->out)) {
+		errno = 0;
+		die("command buffer overflow");
+	}
+	memcpy(b->out + b->out_len, p, len);
+	b->out_len += len;
+}
+
+static void put_cmd(struct binder *b, uint32_t cmd)
+{
+	put(b, &cmd, sizeof(cmd));
+}
+
+static void get(struct binder *b, void *p, size_t len)
+{
+	if (b->in_pos + len > b->in_len) {
+		errno = 0;
+		die("short return command");
+	}
+	memcpy(p, b->in + b->in_pos, len);
+	b->in_pos += len;
+}
+
+/* Sends the queued commands and, if read is set, waits for returns */
+static void binder_io(struct binder *b, int read)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = b->out_len;
+	bwr.write_buffer = (unsigned long)b->out;
+	if (read) {
+		bwr.read_size = sizeof(b->in);
+		bwr.read_buffer = (unsigned long)b->in;
+	}
+	/* the driver updates the consumed counts before it fails */
+	while (ioctl(b->fd, BINDER_WRITE_READ, &bwr) < 0)
+		if (errno != EINTR)
+			die("BINDER_WRITE_READ");
+	b->out_len = 0;
+	b->in_pos = 0;
+	b->in_len = bwr.read_consumed;
+}
+
+/*
+ * Returns the next BR_TRANSACTION or BR_REPLY, answering reference
+ * count requests on the way.
+ */
+static uint32_t binder_next(struct binder *b,
+			    struct binder_transaction_data *txn)
+{
+	struct binder_ptr_cookie pc;
+	uint32_t cmd;
+
+	for (;;) {
+		if (b->in_pos == b->in_len) {
+			binder_io(b, 1);
+			continue;
+		}
+		get(b, &cmd, sizeof(cmd));
+		switch (cmd) {
+		case BR_NOOP:
+		case BR_OK:
+		case BR_SPAWN_LOOPER:
+		case BR_TRANSACTION_COMPLETE:
+			break;
+		case BR_INCREFS:
+		case BR_ACQUIRE:
+			get(b, &pc, sizeof(pc));
+			put_cmd(b, cmd == BR_INCREFS ? BC_INCREFS_DONE :
+				BC_ACQUIRE_DONE);
+			put(b, &pc, sizeof(pc));
+			break;
+		case BR_RELEASE:
+		case BR_DECREFS:
+			get(b, &pc, sizeof(pc));
+			break;
+		case BR_TRANSACTION:
+		case BR_REPLY:
+			get(b, txn, sizeof(*txn));
+			return cmd;
+		default:
+			errno = 0;
+			die("unexpected return command 0x%x", cmd);
+		}
+	}
+}
+
+static void binder_free_buffer(struct binder *b,
+			       struct binder_transaction_data *txn)
+{
+	put_cmd(b, BC_FREE_BUFFER);
+	put(b, &txn->data.ptr.buffer, sizeof(txn->data.ptr.buffer));
+}
+
+static void binder_handle_cmd(struct binder *b, uint32_t cmd, uint32_t handle)
+{
+	put_cmd(b, cmd);
+	put(b, &handle, sizeof(handle));
+}
+
+/* Queues a transaction or a reply carrying data and, if obj, one object */
+static void binder_send(struct binder *b, uint32_t cmd, uint32_t handle,
+			uint32_t code, const void *data, size_t size, int obj)
+{
+	static const size_t offsets[1];
+	struct binder_transaction_data txn;
+
+	memset(&txn, 0, sizeof(txn));
+	txn.target.handle = handle;
+	txn.code = code;
+	txn.data_size = size;
+	txn.data.ptr.buffer = data;
+	if (obj) {
+		txn.offsets_size = sizeof(offsets);
+		txn.data.ptr.offsets = offsets;
+	}
+	put_cmd(b, cmd);
+	put(b, &txn, sizeof(txn));
+}
+
+/* Sends a transaction and waits for its reply */
+static void binder_call(struct binder *b, uint32_t handle, uint32_t code,
+			const void *data, size_t size, int obj,
+			struct binder_transaction_data *reply)
+{
+	binder_send(b, BC_TRANSACTION, handle, code, data, size, obj);
+	if (binder_next(b, reply) != BR_REPLY) {
+		errno = 0;
+		die("transaction instead of reply");
+	}
+}
+
+/******************** Registry ********************/
+
+/*
+ * The parent is the context manager, handle 0. Servers register their
+ * object under their pair number, clients look it up, as with
+ * servicemanager but without names.
+ */
+enum { CODE_REGISTER = 1, CODE_LOOKUP, CODE_PING };
+
+struct reg_msg {
+	struct flat_binder_object obj;	/* at offset 0 */
+	uint32_t pair;
+};
+
+static uint32_t handles[MAX_PAIRS];
+
+static void registry_serve(struct binder *b)
+{
+	static struct flat_binder_object reply;
+	struct binder_transaction_data txn;
+	const struct reg_msg *reg;
+	uint32_t pair;
+
+	if (binder_next(b, &txn) != BR_TRANSACTION) {
+		errno = 0;
+		die("reply without a transaction");
+	}
+	memset(&reply, 0, sizeof(reply));
+	switch (txn.code) {
+	case CODE_REGISTER:
+		reg = txn.data.ptr.buffer;
+		handles[reg->pair] = reg->obj.handle;
+		/* the reference goes away with the buffer otherwise */
+		binder_handle_cmd(b, BC_ACQUIRE, reg->obj.handle);
+		binder_free_buffer(b, &txn);
+		binder_send(b, BC_REPLY, 0, 0, NULL, 0, 0);
+		break;
+	case CODE_LOOKUP:
+		memcpy(&pair, txn.data.ptr.buffer, sizeof(pair));
+		binder_free_buffer(b, &txn);
+		reply.type = BINDER_TYPE_HANDLE;
+		reply.handle = handles[pair];
+		binder_send(b, BC_REPLY, 0, 0, &reply, sizeof(reply), 1);
+		break;
+	default:
+		errno = 0;
+		die("registry got code %u", txn.code);
+	}
+	binder_io(b, 0);
+}
+
+/******************** Pairs ********************/
+
+struct shared {
+	volatile int start;
+	uint64_t deadline_us;
+	uint64_t calls[MAX_PAIRS];
+};
+
+static struct shared *shm;
+static char payload[MAX_PAYLOAD];
+static size_t payload_size = 64;
+
+static void server_main(uint32_t pair)
+{
+	static struct reg_msg reg;
+	struct binder_transaction_data txn;
+	struct binder b;
+
+	binder_init(&b);
+	reg.obj.type = BINDER_TYPE_BINDER;
+	reg.obj.binder = &reg;
+	reg.obj.cookie = &reg;
+	reg.pair = pair;
+	binder_call(&b, 0, CODE_REGISTER, &reg, sizeof(reg), 1, &txn);
+	binder_free_buffer(&b, &txn);
+
+	put_cmd(&b, BC_ENTER_LOOPER);
+	for (;;) {
+		if (binder_next(&b, &txn) != BR_TRANSACTION) {
+			errno = 0;
+			die("server got a reply");
+		}
+		binder_free_buffer(&b, &txn);
+		binder_send(&b, BC_REPLY, 0, 0, payload, txn.data_size, 0);
+	}
+}
+
+static void client_main(uint32_t pair)
+{
+	struct binder_transaction_data txn;
+	const struct flat_binder_object *obj;
+	uint64_t calls = 0;
+	uint32_t handle;
+	struct binder b;
+
+	binder_init(&b);
+	binder_call(&b, 0, CODE_LOOKUP, &pair, sizeof(pair), 0, &txn);
+	obj = txn.data.ptr.buffer;
+	handle = obj->handle;
+	binder_handle_cmd(&b, BC_ACQUIRE, handle);
+	binder_free_buffer(&b, &txn);
+	binder_io(&b, 0);
+
+	while (!shm->start)
+		sched_yield();
+
+	while (now_us() < shm->deadline_us) {
+		binder_call(&b, handle, CODE_PING, payload, payload_size, 0,
+			    &txn);
+		binder_free_buffer(&b, &txn);
+		calls++;
+	}
+	shm->calls[pair] = calls;
+	exit(0);
+}
+
+static pid_t spawn(void (*fn)(uint32_t), uint32_t pair)
+{
+	pid_t pid = fork();
+
+	if (pid < 0)
+		die("fork");
+	if (!pid)
+		fn(pair);
+	return pid;
+}
+
+/* Runs nr pairs for secs and returns transactions per second */
+static double run(struct binder *reg, int nr, int secs)
+{
+	pid_t servers[MAX_PAIRS], clients[MAX_PAIRS];
+	uint64_t calls = 0, start;
+	int i;
+
+	memset(shm, 0, sizeof(*shm));
+	for (i = 0; i < nr; i++)
+		servers[i] = spawn(server_main, i);
+	for (i = 0; i < nr; i++)
+		registry_serve(reg);
+	for (i = 0; i < nr; i++)
+		clients[i] = spawn(client_main, i);
+	for (i = 0; i < nr; i++)
+		registry_serve(reg);
+
+	start = now_us();
+	shm->deadline_us = start + secs * 1000000ULL;
+	__sync_synchronize();
+	shm->start = 1;
+	for (i = 0; i < nr; i++) {
+		if (waitpid(clients[i], NULL, 0) < 0)
+			die("waitpid");
+		calls += shm->calls[i];
+	}
+	start = now_us() - start;
+
+	for (i = 0; i < nr; i++) {
+		kill(servers[i], SIGKILL);
+		waitpid(servers[i], NULL, 0);
+		binder_handle_cmd(reg, BC_RELEASE, handles[i]);
+	}
+	binder_io(reg, 0);
+
+	return calls / (start / 1e6);
+}
+
+static int next_nr(int nr, int max)
+{
+	if (nr == max)
+		return 0;
+	return nr * 2 < max ? nr * 2 : max;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"options:\n"
+		"  -t secs   time per measurement (default 5)\n"
+		"  -j pairs  highest number of client/server pairs\n"
+		"            (default online cpus)\n"
+		"  -s bytes  payload per transaction and reply (default 64)\n",
+		argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, secs = 5, max_pairs, nr;
+	struct binder reg;
+	double tps;
+
+	max_pairs = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "t:j:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 'j':
+			max_pairs = atoi(optarg);
+			break;
+		case 's':
+			payload_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || secs <= 0 || max_pairs < 1 ||
+	    max_pairs > MAX_PAIRS || payload_size > MAX_PAYLOAD)
+		usage(argv[0]);
+
+	shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shm == MAP_FAILED)
+		die("mmap");
+
+	binder_init(&reg);
+	if (ioctl(reg.fd, BINDER_SET_CONTEXT_MGR, 0))
+		die("BINDER_SET_CONTEXT_MGR (is servicemanager running?)");
+	put_cmd(&reg, BC_ENTER_LOOPER);
+	binder_io(&reg, 0);
+
+	printf("# %zu byte payload, %d s per run\n", payload_size, secs);
+	printf("%-8s %14s %14s %10s\n", "pairs", "calls/s", "calls/s/pair",
+	       "us/call");
+	/* 1, 2, 4, ... pairs, ending with max_pairs */
+	for (nr = 1; nr; nr = next_nr(nr, max_pairs)) {
+		tps = run(&reg, nr, secs);
+		printf("%-8d %14.0f %14.0f %10.1f\n", nr, tps, tps / nr,
+		       tps ? 1e6 * nr / tps : 0);
+		fflush(stdout);
+	}
+
+	return 0;
+}
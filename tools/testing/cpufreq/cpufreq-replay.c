@@ -0,0 +1,855 @@
+/*
+ * cpufreq-replay.c -- replay recorded per-cpu load traces through the
+ *                     decision logic of the cpufreq governors and report
+ *                     frequency residency, ramp-up latency after input
+ *                     events and a modelled energy cost
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The governors are transcribed from drivers/cpufreq with the defaults
+ * they have on Tegra 3 in this tree; see README for what is modelled and
+ * what is not. Whenever a governor changes, its model here has to follow.
+ */
+
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o cpufreq-replay cpufreq-replay.c */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_CPUS	4
+#define MAX_OPPS	32
+#define TICK_US		1000
+#define RAMP_TIMEOUT_US	1000000
+
+/*
+ * Power model: dynamic power is DYN_MW_PER_MHZ_V2 * f * V^2 scaled by
+ * utilisation, leakage LEAK_MW_PER_V * V for every cpu of the trace.
+ * The constants only set the scale; compare governors against each
+ * other, not against a power meter.
+ */
+#define DYN_MW_PER_MHZ_V2	0.4
+#define LEAK_MW_PER_V		100.0
+
+/******************** Little Helpers ********************/
+
+static void die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "cpufreq-replay: ");
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	if (errno)
+		fprintf(stderr, ": %s", strerror(errno));
+	fputc('\n', stderr);
+	exit(1);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/******************** Frequency Table ********************/
+
+struct opp {
+	unsigned int khz;
+	unsigned int mv;
+};
+
+/* freq_table_1p75GHz with the TF201 (speedo 3, process 1) cpu_g rails */
+static struct opp opps[MAX_OPPS] = {
+	{   51000,  800 }, {  102000,  800 }, {  204000,  800 },
+	{  370000,  800 }, {  475000,  800 }, {  620000,  850 },
+	{  760000,  900 }, {  910000,  975 }, { 1000000, 1000 },
+	{ 1150000, 1050 }, { 1300000, 1100 }, { 1400000, 1150 },
+	{ 1500000, 1175 }, { 1600000, 1237 }, { 1700000, 1275 },
+	{ 1750000, 1387 },
+};
+static int nr_opps = 16;
+
+static void load_opps(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[128];
+
+	if (!f)
+		die("%s", path);
+	nr_opps = 0;
+	while (fgets(line, sizeof(line), f)) {
+		struct opp *o = &opps[nr_opps];
+
+		if (line[0] == '#' || sscanf(line, "%u %u", &o->khz, &o->mv) != 2)
+			continue;
+		if (nr_opps && o->khz <= opps[nr_opps - 1].khz)
+			die("%s: frequencies must be ascending", path);
+		if (++nr_opps == MAX_OPPS)
+			break;
+	}
+	fclose(f);
+	if (!nr_opps)
+		die("%s: no \"<kHz> <mV>\" lines", path);
+}
+
+static int opp_index(unsigned int khz)
+{
+	int i;
+
+	for (i = 0; i < nr_opps - 1; i++)
+		if (opps[i].khz >= khz)
+			break;
+	return i;
+}
+
+#define RELATION_L	0	/* lowest frequency at or above target */
+#define RELATION_H	1	/* highest frequency at or below target */
+
+/* cpufreq_frequency_table_target() followed by the policy limits */
+static unsigned int table_target(unsigned int target, int relation)
+{
+	int i;
+
+	if (relation == RELATION_L) {
+		for (i = 0; i < nr_opps - 1; i++)
+			if (opps[i].khz >= target)
+				break;
+	} else {
+		for (i = nr_opps - 1; i > 0; i--)
+			if (opps[i].khz <= target)
+				break;
+	}
+	return opps[i].khz;
+}
+
+/******************** Trace ********************/
+
+struct trace_ev {
+	uint64_t t_us;
+	int input;
+	unsigned int demand[MAX_CPUS];
+};
+
+static struct trace_ev *trace;
+static size_t nr_ev;
+static int nr_cpus;
+
+/*
+ * "<msec> <load cpu0> [<load cpu1> ...]" sets the demand of each cpu, in
+ * percent of one core running at the highest frequency, until the next
+ * such line. "<msec> input" marks an input event.
+ */
+static void load_trace(const char *path)
+{
+	FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	unsigned int cur[MAX_CPUS] = { 0 };
+	size_t alloc = 0;
+	char line[256];
+	int lineno = 0;
+
+	if (!f)
+		die("%s", path);
+	while (fgets(line, sizeof(line), f)) {
+		struct trace_ev *ev;
+		char *p, *end;
+		double ms;
+		int n;
+
+		lineno++;
+		ms = strtod(line, &end);
+		if (line[0] == '#' || end == line)
+			continue;
+		if (nr_ev == alloc) {
+			alloc = alloc ? alloc * 2 : 1024;
+			trace = realloc(trace, alloc * sizeof(*trace));
+			if (!trace)
+				die("realloc");
+		}
+		ev = &trace[nr_ev];
+		ev->t_us = ms * 1000;
+		if (nr_ev && ev->t_us < trace[nr_ev - 1].t_us)
+			die("%s:%d: time goes backwards", path, lineno);
+
+		p = end + strspn(end, " \t");
+		ev->input = !strncmp(p, "input", 5);
+		for (n = 0; !ev->input && n < MAX_CPUS; n++) {
+			unsigned long v = strtoul(p, &end, 10);
+
+			if (end == p)
+				break;
+			cur[n] = v > 100 ? 100 : v;
+			p = end;
+		}
+		if (!ev->input && !n) {
+			errno = 0;
+			die("%s:%d: cannot parse \"%s\"", path, lineno, line);
+		}
+		if (n > nr_cpus)
+			nr_cpus = n;
+		memcpy(ev->demand, cur, sizeof(cur));
+		nr_ev++;
+	}
+	if (f != stdin)
+		fclose(f);
+	if (!nr_cpus) {
+		errno = 0;
+		die("%s: no load samples", path);
+	}
+}
+
+/******************** Simulated CPU ********************/
+
+struct sim {
+	uint64_t now;
+	unsigned int cur, min, max;
+	unsigned int demand[MAX_CPUS];
+	double backlog[MAX_CPUS];	/* usecs of work at max, not run yet */
+	uint64_t busy_us[MAX_CPUS];	/* like get_cpu_idle_time_us() */
+	unsigned int nr_running;
+	unsigned int nr_online;		/* for the touch poke tables */
+
+	/* results */
+	uint64_t residency[MAX_OPPS];
+	unsigned int transitions;
+	double energy_nj;
+	uint64_t behind_us;
+	double max_backlog;
+	uint64_t ramp_start;		/* input time, 0 if none pending */
+	uint64_t *ramps;
+	size_t nr_ramps, nr_missed, nr_inputs;
+};
+
+/* A load measurement window, like the prev_cpu_idle/wall pairs */
+struct load_win {
+	uint64_t busy[MAX_CPUS];
+	uint64_t start;
+};
+
+static void win_reset(struct sim *s, struct load_win *w)
+{
+	memcpy(w->busy, s->busy_us, sizeof(w->busy));
+	w->start = s->now;
+}
+
+static unsigned int win_load(struct sim *s, struct load_win *w, int cpu)
+{
+	uint64_t wall = s->now - w->start;
+
+	if (!wall)
+		return 0;
+	return 100 * (s->busy_us[cpu] - w->busy[cpu]) / wall;
+}
+
+static unsigned int win_max_load(struct sim *s, struct load_win *w)
+{
+	unsigned int load = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (win_load(s, w, cpu) > load)
+			load = win_load(s, w, cpu);
+	return load;
+}
+
+static void set_freq(struct sim *s, unsigned int khz)
+{
+	if (khz < s->min)
+		khz = s->min;
+	if (khz > s->max)
+		khz = s->max;
+	if (khz != s->cur)
+		s->transitions++;
+	s->cur = khz;
+}
+
+/* Run one tick of every cpu's work at the current frequency */
+static void sim_tick(struct sim *s)
+{
+	const struct opp *o = &opps[opp_index(s->cur)];
+	double v = o->mv / 1000.0;
+	double cap = (double)TICK_US * s->cur / s->max;
+	int cpu, behind = 0;
+
+	s->nr_running = 0;
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		double served;
+
+		s->backlog[cpu] += s->demand[cpu] * TICK_US / 100.0;
+		served = s->backlog[cpu] < cap ? s->backlog[cpu] : cap;
+		s->backlog[cpu] -= served;
+		s->busy_us[cpu] += served * TICK_US / cap;
+
+		s->energy_nj += (DYN_MW_PER_MHZ_V2 * s->cur / 1000 * v * v *
+				 served / cap + LEAK_MW_PER_V * v) * TICK_US;
+
+		/* a busy cpu with work queued up has at least two threads */
+		s->nr_running += (s->demand[cpu] > 0) + (s->backlog[cpu] > 0);
+		if (s->backlog[cpu] > s->max_backlog)
+			s->max_backlog = s->backlog[cpu];
+		if (s->backlog[cpu] >= TICK_US)
+			behind = 1;
+	}
+	if (behind)
+		s->behind_us += TICK_US;
+	s->residency[opp_index(s->cur)] += TICK_US;
+	s->now += TICK_US;
+}
+
+/******************** Governors ********************/
+
+struct governor {
+	const char *name;
+	void (*init)(struct sim *s);
+	/* evaluate load, returns usecs until the next evaluation */
+	uint64_t (*sample)(struct sim *s);
+	void (*input)(struct sim *s);
+};
+
+/*
+ * ondemand and touchdemand share dbs_check_cpu(): max_load_freq is the
+ * busiest cpu's load times policy->cur (Tegra has no getavg), any load
+ * above up_threshold goes straight to max, anything below
+ * up_threshold - down_differential goes to the lowest frequency that
+ * brings the load back to that level.
+ */
+struct dbs_tuners {
+	unsigned int sampling_rate;
+	unsigned int up_threshold;
+	unsigned int down_differential;
+	unsigned int sampling_down_factor;
+	unsigned int poke[MAX_CPUS];	/* Touch_poke_attr */
+	unsigned int boost_ms;		/* touch boost duration */
+	unsigned int boost_floor;	/* minimum frequency while boosted */
+	unsigned int boost_factor;	/* down_differential multiplier */
+	unsigned int ui_sampling_rate;
+	unsigned int ui_counter;
+};
+
+static struct {
+	const struct dbs_tuners *t;
+	struct load_win win;
+	unsigned int rate_mult;
+	unsigned int sampling_rate;
+	unsigned int ui_counter;
+	uint64_t boost_till;
+} dbs;
+
+static void dbs_init(struct sim *s, const struct dbs_tuners *t)
+{
+	memset(&dbs, 0, sizeof(dbs));
+	dbs.t = t;
+	dbs.rate_mult = 1;
+	dbs.sampling_rate = t->sampling_rate;
+	win_reset(s, &dbs.win);
+}
+
+static uint64_t dbs_sample(struct sim *s)
+{
+	const struct dbs_tuners *t = dbs.t;
+	unsigned int max_load_freq = win_max_load(s, &dbs.win) * s->cur;
+	unsigned int down_diff = t->down_differential;
+	int boosted = s->now < dbs.boost_till;
+
+	win_reset(s, &dbs.win);
+
+	if (dbs.ui_counter && !--dbs.ui_counter)
+		dbs.sampling_rate = t->sampling_rate;
+
+	if (max_load_freq > t->up_threshold * s->cur) {
+		if (s->cur < s->max)
+			dbs.rate_mult = t->sampling_down_factor;
+		set_freq(s, s->max);
+	} else if (s->cur != s->min) {
+		if (boosted && t->boost_factor)
+			down_diff *= t->boost_factor;
+		if (max_load_freq < (t->up_threshold - down_diff) * s->cur) {
+			unsigned int next, floor;
+
+			next = max_load_freq / (t->up_threshold - down_diff);
+			dbs.rate_mult = 1;
+			floor = boosted ? t->boost_floor : s->min;
+			if (next < floor)
+				next = floor;
+			set_freq(s, table_target(next, RELATION_L));
+		}
+	}
+
+	return (uint64_t)dbs.sampling_rate * dbs.rate_mult;
+}
+
+static void dbs_input(struct sim *s)
+{
+	const struct dbs_tuners *t = dbs.t;
+	unsigned int poke = t->poke[s->nr_online - 1];
+
+	if (t->ui_counter) {
+		dbs.ui_counter = t->ui_counter;
+		dbs.sampling_rate = t->ui_sampling_rate;
+	}
+	if (t->boost_ms)
+		dbs.boost_till = s->now + t->boost_ms * 1000ULL;
+	if (!poke || s->cur >= poke)
+		return;
+	set_freq(s, table_target(poke, RELATION_L));
+	win_reset(s, &dbs.win);
+}
+
+static const struct dbs_tuners ondemand_tuners = {
+	.sampling_rate		= 60000,
+	.up_threshold		= 80,
+	.down_differential	= 10,
+	.sampling_down_factor	= 2,
+	.poke			= { 1500000, 1100000, 0, 0 },
+	.boost_ms		= 4000,
+	.boost_floor		= 860000,
+	.ui_sampling_rate	= 30000,
+	.ui_counter		= 5,
+};
+
+static void ondemand_init(struct sim *s)
+{
+	dbs_init(s, &ondemand_tuners);
+}
+
+static const struct dbs_tuners touchdemand_tuners = {
+	.sampling_rate		= 20000,
+	.up_threshold		= 90,
+	.down_differential	= 10,
+	.sampling_down_factor	= 4,
+	.poke			= { 1200000, 1200000, 0, 0 },
+	.boost_ms		= 1000,		/* touch_floor_time */
+	.boost_floor		= 475000,	/* touch_floor_freq */
+	.boost_factor		= 4,		/* touch_factor */
+};
+
+static void touchdemand_init(struct sim *s)
+{
+	dbs_init(s, &touchdemand_tuners);
+}
+
+/*
+ * conservative: steps of freq_step percent of max. Its sampling rate is
+ * transition_latency * LATENCY_MULTIPLIER, 300ms with Tegra's 300us.
+ */
+static struct {
+	struct load_win win;
+	unsigned int requested;
+} cs;
+
+#define CS_SAMPLING_RATE	300000
+#define CS_UP_THRESHOLD		80
+#define CS_DOWN_THRESHOLD	20
+#define CS_FREQ_STEP		5
+
+static void conservative_init(struct sim *s)
+{
+	cs.requested = s->cur;
+	win_reset(s, &cs.win);
+}
+
+static uint64_t conservative_sample(struct sim *s)
+{
+	unsigned int load = win_max_load(s, &cs.win);
+	unsigned int step = CS_FREQ_STEP * s->max / 100;
+
+	win_reset(s, &cs.win);
+
+	if (load > CS_UP_THRESHOLD) {
+		if (cs.requested == s->max)
+			return CS_SAMPLING_RATE;
+		cs.requested += step;
+		if (cs.requested > s->max)
+			cs.requested = s->max;
+		set_freq(s, table_target(cs.requested, RELATION_H));
+	} else if (load < CS_DOWN_THRESHOLD - 10) {
+		cs.requested = cs.requested > s->min + step ?
+			cs.requested - step : s->min;
+		if (s->cur != s->min)
+			set_freq(s, table_target(cs.requested, RELATION_H));
+	}
+	return CS_SAMPLING_RATE;
+}
+
+static void no_input(struct sim *s)
+{
+	(void)s;
+}
+
+/*
+ * interactive, as modified in this tree: every cpu keeps its own target,
+ * the policy runs at the highest one. Rising load is multiplied up by
+ * boost_factor in steps of at most max_boost; otherwise the target keeps
+ * the load at sustain_load. Input events jump cpu0 to max and freeze its
+ * target for min_sample_input_time.
+ */
+#define IA_TIMER_RATE		20000
+#define IA_MIN_SAMPLE_TIME	30000
+#define IA_GO_MAXSPEED_LOAD	90
+#define IA_BOOST_FACTOR		2
+#define IA_MAX_BOOST		175000
+#define IA_SUSTAIN_LOAD		46
+#define IA_HIGH_FREQ_MIN_DELAY	(5 * IA_MIN_SAMPLE_TIME)
+#define IA_MAX_NORMAL_FREQ	1400000
+#define IA_MIDRANGE_FREQ	620000
+#define IA_MIDRANGE_GO_MAXSPEED_LOAD 70
+#define IA_MIDRANGE_MAX_BOOST	175000
+#define IA_MIN_SAMPLE_INPUT_TIME 500000
+
+static struct {
+	struct load_win win[MAX_CPUS];		/* short term */
+	struct load_win change_win[MAX_CPUS];	/* since freq change */
+	unsigned int target[MAX_CPUS];
+	uint64_t freq_change_time[MAX_CPUS];
+	uint64_t last_high_freq_time[MAX_CPUS];
+	uint64_t input_time;
+	int input_seen;
+} ia;
+
+static void interactive_init(struct sim *s)
+{
+	int cpu;
+
+	memset(&ia, 0, sizeof(ia));
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		win_reset(s, &ia.win[cpu]);
+		win_reset(s, &ia.change_win[cpu]);
+		ia.target[cpu] = s->cur;
+	}
+}
+
+static unsigned int interactive_get_target(struct sim *s, unsigned int load)
+{
+	unsigned int maxspeed_load = IA_GO_MAXSPEED_LOAD;
+	unsigned int mboost = IA_MAX_BOOST;
+	unsigned int target;
+
+	if (IA_MIDRANGE_FREQ && s->cur > IA_MIDRANGE_FREQ) {
+		maxspeed_load = IA_MIDRANGE_GO_MAXSPEED_LOAD;
+		mboost = IA_MIDRANGE_MAX_BOOST;
+	}
+	if (load >= maxspeed_load) {
+		target = s->cur * IA_BOOST_FACTOR;
+		if (mboost && target > s->cur + mboost)
+			target = s->cur + mboost;
+	} else {
+		target = (uint64_t)s->cur * load / IA_SUSTAIN_LOAD;
+	}
+	return target < s->max ? target : s->max;
+}
+
+static void interactive_apply(struct sim *s)
+{
+	unsigned int khz = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (ia.target[cpu] > khz)
+			khz = ia.target[cpu];
+	khz = table_target(khz, RELATION_H);
+	if (khz == s->cur)
+		return;
+	set_freq(s, khz);
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		win_reset(s, &ia.change_win[cpu]);
+		ia.freq_change_time[cpu] = s->now;
+	}
+}
+
+static uint64_t interactive_sample(struct sim *s)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		unsigned int load = win_load(s, &ia.win[cpu], cpu);
+		unsigned int since = win_load(s, &ia.change_win[cpu], cpu);
+		unsigned int next;
+
+		win_reset(s, &ia.win[cpu]);
+		if (since > load)
+			load = since;
+		next = table_target(interactive_get_target(s, load),
+				    RELATION_H);
+		if (next == ia.target[cpu])
+			continue;
+		if (next < ia.target[cpu] &&
+		    s->now - ia.freq_change_time[cpu] < IA_MIN_SAMPLE_TIME)
+			continue;
+		if (IA_MAX_NORMAL_FREQ && next > IA_MAX_NORMAL_FREQ) {
+			if (s->now - ia.last_high_freq_time[cpu] <
+			    IA_HIGH_FREQ_MIN_DELAY)
+				next = IA_MAX_NORMAL_FREQ;
+			else
+				ia.last_high_freq_time[cpu] = s->now;
+		}
+		if (cpu != 0 || !ia.input_seen ||
+		    s->now - ia.input_time >= IA_MIN_SAMPLE_INPUT_TIME)
+			ia.target[cpu] = next;
+	}
+	interactive_apply(s);
+	return IA_TIMER_RATE;
+}
+
+static void interactive_input(struct sim *s)
+{
+	ia.input_time = s->now;
+	ia.input_seen = 1;
+	if (s->cur < s->max - 200000) {
+		ia.target[0] = s->max;
+		set_freq(s, s->max);
+		win_reset(s, &ia.change_win[0]);
+		ia.freq_change_time[0] = s->now;
+	}
+}
+
+/*
+ * smartass2 with the screen on: jump to the ideal frequency, then step
+ * by ramp_up/down_step, waiting up_rate/down_rate at or beyond the ideal
+ * frequency. The busiest cpu drives the shared policy.
+ */
+#define SA_SAMPLE_RATE		20000	/* 2 jiffies at HZ=100 */
+#define SA_IDEAL_FREQ		770000
+#define SA_RAMP_UP_STEP		245760
+#define SA_RAMP_DOWN_STEP	245760
+#define SA_MAX_CPU_LOAD		50
+#define SA_MIN_CPU_LOAD		25
+#define SA_UP_RATE		48000
+#define SA_DOWN_RATE		99000
+
+static struct {
+	struct load_win win;
+	uint64_t freq_change_time;
+} sa;
+
+static void smartass2_init(struct sim *s)
+{
+	memset(&sa, 0, sizeof(sa));
+	win_reset(s, &sa.win);
+}
+
+static void smartass2_target(struct sim *s, unsigned int khz, int relation)
+{
+	unsigned int old = s->cur, target;
+
+	target = table_target(khz, relation);
+	if (target == old && khz > old && relation == RELATION_H)
+		target = table_target(khz, RELATION_L);
+	else if (target == old && khz < old && relation == RELATION_L)
+		target = table_target(khz, RELATION_H);
+	set_freq(s, target);
+	if (s->cur != old)
+		sa.freq_change_time = s->now;
+}
+
+static uint64_t smartass2_sample(struct sim *s)
+{
+	unsigned int load = win_max_load(s, &sa.win);
+	int no_idle = load >= 100;
+
+	win_reset(s, &sa.win);
+
+	if (load > SA_MAX_CPU_LOAD || no_idle) {
+		if (s->cur < s->max && s->nr_running > 1 &&
+		    (s->cur < SA_IDEAL_FREQ || no_idle ||
+		     s->now - sa.freq_change_time >= SA_UP_RATE)) {
+			if (s->cur < SA_IDEAL_FREQ)
+				smartass2_target(s, SA_IDEAL_FREQ, RELATION_L);
+			else
+				smartass2_target(s, s->cur + SA_RAMP_UP_STEP,
+						 RELATION_H);
+		}
+	} else if (load < SA_MIN_CPU_LOAD && s->cur > s->min &&
+		   (s->cur > SA_IDEAL_FREQ ||
+		    s->now - sa.freq_change_time >= SA_DOWN_RATE)) {
+		if (s->cur > SA_IDEAL_FREQ)
+			smartass2_target(s, SA_IDEAL_FREQ, RELATION_H);
+		else
+			smartass2_target(s, s->cur > SA_RAMP_DOWN_STEP ?
+					 s->cur - SA_RAMP_DOWN_STEP : s->min,
+					 RELATION_L);
+	}
+	return SA_SAMPLE_RATE;
+}
+
+static const struct governor governors[] = {
+	{ "interactive", interactive_init, interactive_sample,
+	  interactive_input },
+	{ "ondemand", ondemand_init, dbs_sample, dbs_input },
+	{ "conservative", conservative_init, conservative_sample, no_input },
+	{ "smartass2", smartass2_init, smartass2_sample, no_input },
+	{ "touchdemand", touchdemand_init, dbs_sample, dbs_input },
+};
+
+/******************** Replay ********************/
+
+static unsigned int ramp_khz = 1000000;
+static int verbose;
+
+static void ramp_check(struct sim *s)
+{
+	if (!s->ramp_start)
+		return;
+	if (s->cur >= ramp_khz) {
+		s->ramps[s->nr_ramps++] = s->now - s->ramp_start;
+		s->ramp_start = 0;
+	} else if (s->now - s->ramp_start >= RAMP_TIMEOUT_US) {
+		s->nr_missed++;
+		s->ramp_start = 0;
+	}
+}
+
+static void replay(const struct governor *gov, struct sim *s)
+{
+	uint64_t end = trace[nr_ev - 1].t_us + TICK_US;
+	uint64_t next_sample;
+	size_t i = 0;
+	int cpu;
+
+	memset(s, 0, sizeof(*s));
+	s->min = opps[0].khz;
+	s->max = opps[nr_opps - 1].khz;
+	s->cur = s->max;
+	s->nr_online = nr_cpus;
+	s->ramps = calloc(nr_ev, sizeof(*s->ramps));
+	if (!s->ramps)
+		die("calloc");
+
+	gov->init(s);
+	next_sample = s->now + gov->sample(s);
+
+	while (s->now < end) {
+		for (; i < nr_ev && trace[i].t_us <= s->now; i++) {
+			for (cpu = 0; cpu < nr_cpus; cpu++)
+				s->demand[cpu] = trace[i].demand[cpu];
+			if (!trace[i].input)
+				continue;
+			s->nr_inputs++;
+			/* ramp latency counts from the first of a burst */
+			if (!s->ramp_start && s->cur < ramp_khz)
+				s->ramp_start = s->now ? s->now : 1;
+			gov->input(s);
+		}
+		ramp_check(s);
+
+		sim_tick(s);
+		if (s->now >= next_sample)
+			next_sample = s->now + gov->sample(s);
+		ramp_check(s);
+
+		if (verbose)
+			printf("%" PRIu64 " %s %u\n",
+			       s->now / 1000, gov->name, s->cur);
+	}
+	if (s->ramp_start)
+		s->nr_missed++;
+}
+
+static void report(const struct governor *gov, struct sim *s)
+{
+	uint64_t total = s->now, sum = 0;
+	size_t i;
+
+	qsort(s->ramps, s->nr_ramps, sizeof(*s->ramps), cmp_u64);
+	for (i = 0; i < s->nr_ramps; i++)
+		sum += s->ramps[i];
+
+	printf("%-12s energy %9.1f mJ  transitions %6u  behind %7.1f ms"
+	       "  max backlog %6.1f ms\n", gov->name, s->energy_nj / 1e6,
+	       s->transitions, s->behind_us / 1000.0, s->max_backlog / 1000);
+	if (s->nr_inputs)
+		printf("%-12s ramp to %u kHz: %zu of %zu input bursts, "
+		       "mean %.1f p50 %.1f max %.1f ms, %zu missed\n", "",
+		       ramp_khz, s->nr_ramps, s->nr_ramps + s->nr_missed,
+		       s->nr_ramps ? sum / 1000.0 / s->nr_ramps : 0.0,
+		       s->nr_ramps ? s->ramps[s->nr_ramps / 2] / 1000.0 : 0.0,
+		       s->nr_ramps ? s->ramps[s->nr_ramps - 1] / 1000.0 : 0.0,
+		       s->nr_missed);
+	printf("%-12s residency:", "");
+	for (i = 0; i < (size_t)nr_opps; i++)
+		if (s->residency[i])
+			printf(" %u:%.1f%%", opps[i].khz / 1000,
+			       100.0 * s->residency[i] / total);
+	printf("\n\n");
+	free(s->ramps);
+}
+
+static int selected(const char *list, const char *name)
+{
+	size_t len = strlen(name);
+
+	while (list && *list) {
+		if (!strncmp(list, name, len) &&
+		    (list[len] == ',' || list[len] == '\0'))
+			return 1;
+		list = strchr(list, ',');
+		if (list)
+			list++;
+	}
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+"usage: cpufreq-replay [options] <trace|->\n"
+"  -g gov[,gov]  governors to replay (default: all)\n"
+"                interactive ondemand conservative smartass2 touchdemand\n"
+"  -r kHz        frequency that counts as ramped up after input (%u)\n"
+"  -t file       frequency table, \"<kHz> <mV>\" lines (Tegra 3 TF201)\n"
+"  -v            print \"<msec> <governor> <kHz>\" every tick\n",
+		ramp_khz);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *only = NULL;
+	struct sim sim;
+	size_t g;
+	int c;
+
+	while ((c = getopt(argc, argv, "g:r:t:v")) != -1) {
+		switch (c) {
+		case 'g':
+			only = optarg;
+			break;
+		case 'r':
+			ramp_khz = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			load_opps(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1)
+		usage();
+
+	load_trace(argv[optind]);
+	printf("# %zu trace lines, %d cpus, %.1f s, %u-%u kHz\n\n",
+	       nr_ev, nr_cpus, trace[nr_ev - 1].t_us / 1e6,
+	       opps[0].khz, opps[nr_opps - 1].khz);
+
+	for (g = 0; g < sizeof(governors) / sizeof(governors[0]); g++) {
+		const struct governor *gov = &governors[g];
+
+		if (only && !selected(only, gov->name))
+			continue;
+		replay(gov, &sim);
+		report(gov, &sim);
+	}
+	return 0;
+}
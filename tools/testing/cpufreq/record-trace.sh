@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# record-trace.sh -- record a load trace for cpufreq-replay on the device
+#
+#	record-trace.sh [SECS] > my.trace
+#
+# Samples /proc/stat every PERIOD seconds (default 0.01) for SECS seconds
+# (default 30) and turns each cpu's busy time into demand at the highest
+# frequency using the frequency it ran at. Offline cpus record as 0.
+# Every sample in which the interrupt count of the lines of
+# /proc/interrupts matching INPUT_IRQ (default "touch") went up is also
+# recorded as an input event.
+#
+# Demand is capped by what the running governor let the cpu do: a cpu
+# that was saturated at a low frequency records as that much demand,
+# not more. Record under the performance governor to avoid this, at the
+# cost of the recorded workload seeing different timing.
+
+SECS=${1:-30}
+PERIOD=${PERIOD:-0.01}
+INPUT_IRQ=${INPUT_IRQ:-touch}
+CPUFREQ=${CPUFREQ:-/sys/devices/system/cpu/cpu0/cpufreq}
+
+max=$(cat $CPUFREQ/cpuinfo_max_freq)
+raw=$(mktemp /data/local/tmp/cpufreq-trace.XXXXXX 2>/dev/null ||
+      mktemp /tmp/cpufreq-trace.XXXXXX) || exit 1
+trap 'rm -f $raw' EXIT
+
+end=$(($(cut -d. -f1 /proc/uptime) + SECS))
+while [ $(cut -d. -f1 /proc/uptime) -lt $end ]; do
+	{
+		echo "T $(cut -d' ' -f1 /proc/uptime)"
+		echo "F $(cat $CPUFREQ/scaling_cur_freq)"
+		grep '^cpu[0-9]' /proc/stat
+		echo "I $(grep -i "$INPUT_IRQ" /proc/interrupts |
+			awk '{ for (i = 2; i <= NF && $i ~ /^[0-9]+$/; i++)
+				n += $i } END { print n + 0 }')"
+	} >> $raw
+	sleep $PERIOD
+done
+
+awk -v max=$max '
+/^T / {
+	t = int($2 * 1000)
+	if (!t0)
+		t0 = t
+	next
+}
+/^F / { freq = $2; next }
+/^cpu[0-9]/ {
+	cpu = substr($1, 4) + 0
+	total = 0
+	for (i = 2; i <= NF; i++)
+		total += $i
+	idle = $5 + $6
+	dt = total - ptotal[cpu]
+	if (cpu in ptotal && dt > 0)
+		load[cpu] = 100 - 100 * (idle - pidle[cpu]) / dt
+	ptotal[cpu] = total
+	pidle[cpu] = idle
+	seen[cpu] = 1
+	if (cpu + 1 > ncpu)
+		ncpu = cpu + 1
+	next
+}
+/^I / {
+	if (started) {
+		line = t - t0
+		for (c = 0; c < ncpu; c++)
+			line = line " " (seen[c] ? int(load[c] * freq / max) : 0)
+		print line
+		if ($2 > irqs)
+			print t - t0, "input"
+	}
+	irqs = $2
+	started = 1
+	delete seen
+}' $raw
@@ -0,0 +1,523 @@
+/*
+ * iosched-bench.c -- replay I/O workloads against a block device and
+ *                    report completion latency percentiles
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The device is used raw and its contents are destroyed by the write
+ * workloads. See README for how iosched-bench.sh drives this program
+ * over every elevator the device offers.
+ */
+
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o iosched-bench iosched-bench.c -lpthread */
+
+#define _GNU_SOURCE /* for O_DIRECT */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/fs.h>
+
+#define SECTOR_ALIGN	4096
+#define READ_SIZE	4096
+#define FSYNC_SIZE	4096
+#define BG_WRITE_SIZE	(128 * 1024)
+#define SEQ_WRITE_SIZE	(512 * 1024)
+#define MAX_IO_SIZE	(1024 * 1024)
+
+/******************** Little Helpers ********************/
+
+static void die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "iosched-bench: ");
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	if (errno)
+		fprintf(stderr, ": %s", strerror(errno));
+	fputc('\n', stderr);
+	exit(1);
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_until_us(uint64_t t)
+{
+	uint64_t now = now_us();
+	struct timespec ts;
+
+	if (t <= now)
+		return;
+	t -= now;
+	ts.tv_sec = t / 1000000;
+	ts.tv_nsec = (t % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+}
+
+static void *alloc_buf(size_t size)
+{
+	void *buf;
+
+	if (posix_memalign(&buf, SECTOR_ALIGN, size))
+		die("posix_memalign");
+	memset(buf, 0x5a, size);
+	return buf;
+}
+
+/******************** Statistics ********************/
+
+enum op_class {
+	OP_READ,
+	OP_WRITE,
+	OP_FSYNC,
+	OP_MAX,
+};
+
+static const char *const op_names[OP_MAX] = {
+	[OP_READ]	= "read",
+	[OP_WRITE]	= "write",
+	[OP_FSYNC]	= "fsync",
+};
+
+/* Completion latencies (usec) and bytes transferred per op class */
+struct op_stats {
+	pthread_mutex_t lock;
+	uint32_t *lat;
+	size_t nr, size;
+	uint64_t bytes;
+};
+
+static struct op_stats stats[OP_MAX];
+
+static void stats_add(enum op_class op, uint64_t lat_us, size_t bytes)
+{
+	struct op_stats *s = &stats[op];
+
+	pthread_mutex_lock(&s->lock);
+	if (s->nr == s->size) {
+		s->size = s->size ? s->size * 2 : 4096;
+		s->lat = realloc(s->lat, s->size * sizeof(*s->lat));
+		if (!s->lat)
+			die("realloc");
+	}
+	s->lat[s->nr++] = lat_us > UINT32_MAX ? UINT32_MAX : lat_us;
+	s->bytes += bytes;
+	pthread_mutex_unlock(&s->lock);
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* permille: 500 is the median, 999 the 99.9th percentile */
+static uint32_t percentile(const struct op_stats *s, unsigned permille)
+{
+	size_t idx = (s->nr * permille + 999) / 1000;
+
+	return s->lat[idx ? idx - 1 : 0];
+}
+
+static void stats_report(const char *label, const char *workload,
+			 double secs)
+{
+	int op;
+
+	for (op = 0; op < OP_MAX; op++) {
+		struct op_stats *s = &stats[op];
+
+		if (!s->nr)
+			continue;
+		qsort(s->lat, s->nr, sizeof(*s->lat), cmp_u32);
+		printf("%-10s %-10s %-6s ops=%zu iops=%.1f MB/s=%.2f "
+		       "p50=%" PRIu32 " p99=%" PRIu32 " p999=%" PRIu32
+		       " max=%" PRIu32 "\n",
+		       label, workload, op_names[op], s->nr, s->nr / secs,
+		       s->bytes / secs / (1024 * 1024),
+		       percentile(s, 500), percentile(s, 990),
+		       percentile(s, 999), s->lat[s->nr - 1]);
+	}
+}
+
+/******************** Workloads ********************/
+
+static const char *dev_path;
+static uint64_t dev_span;	/* bytes of the device we may touch */
+static uint64_t deadline_us;	/* end of the run */
+
+static int open_dev(int flags)
+{
+	int fd = open(dev_path, flags);
+
+	if (fd < 0)
+		die("%s", dev_path);
+	return fd;
+}
+
+/*
+ * The first half of the span is read, the second half written, so that
+ * reads are never served from data the writers just left in the page
+ * cache.
+ */
+static uint64_t random_offset(unsigned *seed, uint64_t base, uint64_t len,
+			      size_t size)
+{
+	uint64_t blocks = len / size;
+	uint64_t r = ((uint64_t)rand_r(seed) << 31) ^ rand_r(seed);
+
+	return base + (r % blocks) * size;
+}
+
+static void *random_reader(void *arg)
+{
+	unsigned seed = (unsigned)(uintptr_t)arg;
+	void *buf = alloc_buf(READ_SIZE);
+	int fd = open_dev(O_RDONLY | O_DIRECT);
+
+	while (now_us() < deadline_us) {
+		uint64_t off = random_offset(&seed, 0, dev_span / 2, READ_SIZE);
+		uint64_t t = now_us();
+
+		if (pread(fd, buf, READ_SIZE, off) != READ_SIZE)
+			die("read at %" PRIu64, off);
+		stats_add(OP_READ, now_us() - t, READ_SIZE);
+	}
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+/* Buffered streaming writes, left for background writeback to flush */
+static void *background_writer(void *arg)
+{
+	uint64_t base = dev_span / 2, off = 0;
+	void *buf = alloc_buf(BG_WRITE_SIZE);
+	int fd = open_dev(O_WRONLY);
+
+	(void)arg;
+	while (now_us() < deadline_us) {
+		uint64_t t = now_us();
+
+		if (pwrite(fd, buf, BG_WRITE_SIZE, base + off) != BG_WRITE_SIZE)
+			die("write at %" PRIu64, base + off);
+		stats_add(OP_WRITE, now_us() - t, BG_WRITE_SIZE);
+		off = (off + BG_WRITE_SIZE) % (dev_span / 2 - BG_WRITE_SIZE);
+	}
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+/* Small writes each followed by fdatasync(), like a database journal */
+static void *fsync_writer(void *arg)
+{
+	unsigned seed = (unsigned)(uintptr_t)arg;
+	void *buf = alloc_buf(FSYNC_SIZE);
+	int fd = open_dev(O_WRONLY);
+
+	while (now_us() < deadline_us) {
+		uint64_t off = random_offset(&seed, dev_span / 2, dev_span / 2,
+					     FSYNC_SIZE);
+		uint64_t t = now_us();
+
+		if (pwrite(fd, buf, FSYNC_SIZE, off) != FSYNC_SIZE)
+			die("write at %" PRIu64, off);
+		if (fdatasync(fd))
+			die("fdatasync");
+		stats_add(OP_FSYNC, now_us() - t, FSYNC_SIZE);
+	}
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+static void *sequential_writer(void *arg)
+{
+	uint64_t off = 0;
+	void *buf = alloc_buf(SEQ_WRITE_SIZE);
+	int fd = open_dev(O_WRONLY | O_DIRECT);
+
+	(void)arg;
+	while (now_us() < deadline_us) {
+		uint64_t t = now_us();
+
+		if (pwrite(fd, buf, SEQ_WRITE_SIZE, off) != SEQ_WRITE_SIZE)
+			die("write at %" PRIu64, off);
+		stats_add(OP_WRITE, now_us() - t, SEQ_WRITE_SIZE);
+		off = (off + SEQ_WRITE_SIZE) % (dev_span - SEQ_WRITE_SIZE);
+	}
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+/******************** Trace replay ********************/
+
+/*
+ * A trace is a text file with one request per line:
+ *
+ *	<usec since start> <R|W|S> <offset in bytes> <length in bytes>
+ *
+ * R is an O_DIRECT read, W a buffered write and S a buffered write
+ * followed by fdatasync(). Requests are issued open loop at their time
+ * stamp and their latency is measured from that time stamp, so time
+ * spent waiting for a free worker counts as well.
+ */
+struct trace_op {
+	uint64_t time;
+	char type;
+	uint64_t off;
+	size_t len;
+};
+
+static struct trace_op *trace;
+static size_t trace_nr, trace_next;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t trace_start;
+
+static void load_trace(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	size_t size = 0;
+	char line[256];
+
+	if (!f)
+		die("%s", path);
+
+	while (fgets(line, sizeof(line), f)) {
+		struct trace_op op;
+		unsigned long long time, off;
+
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%llu %c %llu %zu",
+			   &time, &op.type, &off, &op.len) != 4 ||
+		    !strchr("RWS", op.type) || !op.len ||
+		    op.len > MAX_IO_SIZE || op.len % 512 || off % 512) {
+			errno = 0;
+			die("%s: bad line: %s", path, line);
+		}
+		op.time = time;
+		/* O_DIRECT reads need aligned offsets and lengths */
+		if (op.type == 'R') {
+			off &= ~(unsigned long long)(SECTOR_ALIGN - 1);
+			op.len = (op.len + SECTOR_ALIGN - 1) &
+				~(size_t)(SECTOR_ALIGN - 1);
+		}
+		op.off = off % dev_span;
+		if (op.off + op.len > dev_span)
+			op.off = dev_span - op.len;
+
+		if (trace_nr == size) {
+			size = size ? size * 2 : 4096;
+			trace = realloc(trace, size * sizeof(*trace));
+			if (!trace)
+				die("realloc");
+		}
+		trace[trace_nr++] = op;
+	}
+	fclose(f);
+}
+
+static void *trace_worker(void *arg)
+{
+	void *buf = alloc_buf(MAX_IO_SIZE);
+	int rfd = open_dev(O_RDONLY | O_DIRECT);
+	int wfd = open_dev(O_WRONLY);
+
+	(void)arg;
+	for (;;) {
+		struct trace_op *op;
+		size_t len;
+		uint64_t t;
+
+		pthread_mutex_lock(&trace_lock);
+		op = trace_next < trace_nr ? &trace[trace_next++] : NULL;
+		pthread_mutex_unlock(&trace_lock);
+		if (!op)
+			break;
+
+		t = trace_start + op->time;
+		if (t > deadline_us)
+			break;
+		sleep_until_us(t);
+
+		len = op->len;
+		if (op->type == 'R') {
+			if (pread(rfd, buf, len, op->off) != (ssize_t)len)
+				die("read at %" PRIu64, op->off);
+			stats_add(OP_READ, now_us() - t, len);
+			continue;
+		}
+		if (pwrite(wfd, buf, len, op->off) != (ssize_t)len)
+			die("write at %" PRIu64, op->off);
+		if (op->type == 'W') {
+			stats_add(OP_WRITE, now_us() - t, len);
+			continue;
+		}
+		if (fdatasync(wfd))
+			die("fdatasync");
+		stats_add(OP_FSYNC, now_us() - t, len);
+	}
+	close(rfd);
+	close(wfd);
+	free(buf);
+	return NULL;
+}
+
+/******************** Main ********************/
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options] <workload> <device>\n"
+		"workloads:\n"
+		"  mixed     random sync reads against buffered streaming writes\n"
+		"  fsync     random sync reads against small write+fdatasync\n"
+		"  seqwrite  sequential O_DIRECT writes\n"
+		"  replay    replay the trace given with -r\n"
+		"options:\n"
+		"  -t secs   run time (default 30)\n"
+		"  -j n      reader threads, or replay workers (default 4)\n"
+		"  -w n      fsync writer threads (default 2)\n"
+		"  -s mb     limit the part of the device used (default all)\n"
+		"  -r file   trace for the replay workload\n"
+		"  -l label  first column of the report (default: workload)\n",
+		argv0);
+	exit(2);
+}
+
+static uint64_t device_size(void)
+{
+	uint64_t size;
+	struct stat st;
+	int fd = open_dev(O_RDONLY);
+
+	if (fstat(fd, &st))
+		die("stat %s", dev_path);
+	if (S_ISBLK(st.st_mode)) {
+		if (ioctl(fd, BLKGETSIZE64, &size))
+			die("BLKGETSIZE64");
+	} else {
+		size = st.st_size;
+	}
+	close(fd);
+	return size;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned secs = 30, readers = 4, writers = 2, nr = 0, i;
+	const char *label = NULL, *trace_path = NULL, *workload;
+	uint64_t span_mb = 0, start;
+	pthread_t threads[64];
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:j:w:s:r:l:")) != -1) {
+		switch (opt) {
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 'j':
+			readers = atoi(optarg);
+			break;
+		case 'w':
+			writers = atoi(optarg);
+			break;
+		case 's':
+			span_mb = strtoull(optarg, NULL, 10);
+			break;
+		case 'r':
+			trace_path = optarg;
+			break;
+		case 'l':
+			label = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || !secs || readers + writers > 60)
+		usage(argv[0]);
+	workload = argv[optind];
+	dev_path = argv[optind + 1];
+	if (!label)
+		label = workload;
+
+	for (i = 0; i < OP_MAX; i++)
+		pthread_mutex_init(&stats[i].lock, NULL);
+
+	dev_span = device_size();
+	if (span_mb && span_mb * 1024 * 1024 < dev_span)
+		dev_span = span_mb * 1024 * 1024;
+	dev_span &= ~(uint64_t)(MAX_IO_SIZE - 1);
+	if (dev_span < 4 * MAX_IO_SIZE) {
+		errno = 0;
+		die("%s: need at least %d MB", dev_path, 4 * MAX_IO_SIZE >> 20);
+	}
+
+	if (!strcmp(workload, "replay")) {
+		if (!trace_path)
+			usage(argv[0]);
+		load_trace(trace_path);
+	} else if (strcmp(workload, "mixed") && strcmp(workload, "fsync") &&
+		   strcmp(workload, "seqwrite")) {
+		usage(argv[0]);
+	}
+
+	start = now_us();
+	deadline_us = start + (uint64_t)secs * 1000000;
+	trace_start = start;
+
+#define SPAWN(fn, arg) do {						\
+		if (pthread_create(&threads[nr++], NULL, fn,		\
+				   (void *)(uintptr_t)(arg)))		\
+			die("pthread_create");				\
+	} while (0)
+
+	if (!strcmp(workload, "replay")) {
+		for (i = 0; i < readers; i++)
+			SPAWN(trace_worker, 0);
+	} else if (!strcmp(workload, "seqwrite")) {
+		SPAWN(sequential_writer, 0);
+	} else {
+		for (i = 0; i < readers; i++)
+			SPAWN(random_reader, i + 1);
+		if (!strcmp(workload, "mixed"))
+			SPAWN(background_writer, 0);
+		else
+			for (i = 0; i < writers; i++)
+				SPAWN(fsync_writer, 1000 + i);
+	}
+#undef SPAWN
+
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i], NULL);
+
+	stats_report(label, workload, (now_us() - start) / 1e6);
+	return 0;
+}
@@ -0,0 +1,85 @@
+#!/bin/sh
+#
+# Run every workload of iosched-bench against every elevator a block
+# device offers and print one result line per elevator, workload and
+# operation class. Latencies are in usec.
+#
+# THE DEVICE IS OVERWRITTEN. By default a scsi_debug RAM disk is created
+# for the run; its fixed per-command delay and queue depth are the
+# service time model. To measure real hardware instead, point DEV at an
+# unused block device, e.g. a spare eMMC partition.
+#
+# Environment:
+#   DEV        block device to use (default: create a scsi_debug disk)
+#   SIZE_MB    size of the scsi_debug disk (default 256)
+#   DELAY      scsi_debug service time per command, in jiffies (default 1)
+#   DEPTH      scsi_debug queue depth (default 2, like most eMMC hosts)
+#   ELEVATORS  elevators to compare (default: all the device offers)
+#   WORKLOADS  workloads to run (default: mixed fsync seqwrite, plus
+#              replay when TRACE is set)
+#   TRACE      trace file for the replay workload
+#   SECS       run time of each workload (default 30)
+#   BENCH      path to the iosched-bench binary
+#
+
+SIZE_MB=${SIZE_MB:-256}
+DELAY=${DELAY:-1}
+DEPTH=${DEPTH:-2}
+SECS=${SECS:-30}
+BENCH=${BENCH:-$(dirname "$0")/iosched-bench}
+
+if [ ! -x "$BENCH" ]; then
+	echo "$BENCH not found, run make first" >&2
+	exit 1
+fi
+
+SCSI_DEBUG=
+if [ -z "$DEV" ]; then
+	modprobe scsi_debug dev_size_mb=$SIZE_MB delay=$DELAY \
+		max_queue=$DEPTH || exit 1
+	SCSI_DEBUG=1
+	sleep 2
+	for b in /sys/bus/pseudo/drivers/scsi_debug/adapter*/host*/target*/*/block/*; do
+		DEV=/dev/$(basename "$b")
+	done
+	if [ ! -b "$DEV" ]; then
+		echo "no scsi_debug disk found" >&2
+		rmmod scsi_debug
+		exit 1
+	fi
+fi
+
+# elevators apply to the whole disk
+disk=$(basename "$(readlink -f "$DEV")")
+if [ ! -e /sys/block/$disk/queue/scheduler ]; then
+	disk=$(basename "$(dirname "$(readlink -f /sys/class/block/$disk)")")
+fi
+SCHED=/sys/block/$disk/queue/scheduler
+if [ ! -w "$SCHED" ]; then
+	echo "$DEV has no I/O scheduler (bio based driver?)" >&2
+	exit 1
+fi
+
+ELEVATORS=${ELEVATORS:-$(sed 's/[][]//g' "$SCHED")}
+OLD_ELEVATOR=$(sed 's/.*\[\(.*\)\].*/\1/' "$SCHED")
+if [ -z "$WORKLOADS" ]; then
+	WORKLOADS="mixed fsync seqwrite"
+	[ -n "$TRACE" ] && WORKLOADS="$WORKLOADS replay"
+fi
+
+echo "# device $DEV, ${SECS}s per run"
+for e in $ELEVATORS; do
+	if ! echo $e > "$SCHED" 2>/dev/null; then
+		echo "# $e: not available" >&2
+		continue
+	fi
+	for w in $WORKLOADS; do
+		sync
+		echo 3 > /proc/sys/vm/drop_caches
+		"$BENCH" -t $SECS -l $e ${TRACE:+-r "$TRACE"} $w "$DEV"
+	done
+done
+
+echo $OLD_ELEVATOR > "$SCHED"
+[ -n "$SCSI_DEBUG" ] && rmmod scsi_debug
+exit 0
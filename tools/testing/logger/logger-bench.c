@@ -0,0 +1,258 @@
+/*
+ * logger-bench.c -- measure Android logger write throughput against the
+ *                   number of concurrent writers, with readers draining
+ *                   the log at the same time
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The log is flooded with test entries. See README.
+ */
+
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -I../../../drivers/staging/android -o logger-bench logger-bench.c -lpthread */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+#define MAX_THREADS	64
+#define READ_BUF	(64 * 1024)
+
+/******************** Little Helpers ********************/
+
+static void die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "logger-bench: ");
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	if (errno)
+		fprintf(stderr, ": %s", strerror(errno));
+	fputc('\n', stderr);
+	exit(1);
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/******************** Workers ********************/
+
+static const char *dev_path = "/dev/log/main";
+static size_t msg_size = 100;
+static volatile int start_flag, stop_flag;
+static uint64_t deadline_us;
+
+struct worker {
+	pthread_t thread;
+	uint64_t entries;
+};
+
+/* Writes like liblog: priority, tag and message in one writev() */
+static void *writer_fn(void *arg)
+{
+	static const char tag[] = "logger-bench";
+	struct worker *w = arg;
+	unsigned char prio = 4;	/* ANDROID_LOG_INFO */
+	struct iovec iov[3];
+	char *msg;
+	int fd;
+
+	msg = malloc(msg_size);
+	if (!msg)
+		die("malloc");
+	memset(msg, 'x', msg_size - 1);
+	msg[msg_size - 1] = '\0';
+	iov[0].iov_base = &prio;
+	iov[0].iov_len = 1;
+	iov[1].iov_base = (void *)tag;
+	iov[1].iov_len = sizeof(tag);
+	iov[2].iov_base = msg;
+	iov[2].iov_len = msg_size;
+
+	fd = open(dev_path, O_WRONLY);
+	if (fd < 0)
+		die("%s", dev_path);
+
+	while (!start_flag)
+		;
+
+	while (now_us() < deadline_us) {
+		if (writev(fd, iov, 3) < 0)
+			die("writev");
+		w->entries++;
+	}
+
+	close(fd);
+	free(msg);
+	return NULL;
+}
+
+/* Drains the log like logcat, as many entries per read() as fit */
+static void *reader_fn(void *arg)
+{
+	struct worker *w = arg;
+	struct pollfd pfd;
+	int version = 2;
+	char *buf;
+	ssize_t ret, off;
+
+	buf = malloc(READ_BUF);
+	if (!buf)
+		die("malloc");
+	pfd.fd = open(dev_path, O_RDONLY | O_NONBLOCK);
+	if (pfd.fd < 0)
+		die("%s", dev_path);
+	pfd.events = POLLIN;
+	if (ioctl(pfd.fd, LOGGER_SET_VERSION, &version) ||
+	    ioctl(pfd.fd, LOGGER_SET_BATCH, 1))
+		die("%s: reader ioctls", dev_path);
+
+	while (!stop_flag) {
+		ret = read(pfd.fd, buf, READ_BUF);
+		if (ret < 0) {
+			if (errno != EAGAIN)
+				die("read");
+			poll(&pfd, 1, 100);
+			continue;
+		}
+		for (off = 0; off < ret; w->entries++)
+			off += sizeof(struct logger_entry) +
+				((struct logger_entry *)(buf + off))->len;
+	}
+
+	close(pfd.fd);
+	free(buf);
+	return NULL;
+}
+
+/*
+ * Runs nr writers for secs with nr_readers reading, and returns the
+ * entries written per second; *read_rate gets the entries read per
+ * second by each reader.
+ */
+static double run(int nr, int nr_readers, int secs, double *read_rate)
+{
+	struct worker w[MAX_THREADS], r[MAX_THREADS];
+	uint64_t entries = 0, read = 0, start;
+	int i;
+
+	memset(w, 0, sizeof(w));
+	memset(r, 0, sizeof(r));
+	start_flag = 0;
+	stop_flag = 0;
+	for (i = 0; i < nr_readers; i++)
+		if (pthread_create(&r[i].thread, NULL, reader_fn, &r[i]))
+			die("pthread_create");
+	for (i = 0; i < nr; i++)
+		if (pthread_create(&w[i].thread, NULL, writer_fn, &w[i]))
+			die("pthread_create");
+
+	start = now_us();
+	deadline_us = start + secs * 1000000ULL;
+	__sync_synchronize();
+	start_flag = 1;
+	for (i = 0; i < nr; i++) {
+		pthread_join(w[i].thread, NULL);
+		entries += w[i].entries;
+	}
+	start = now_us() - start;
+
+	stop_flag = 1;
+	for (i = 0; i < nr_readers; i++) {
+		pthread_join(r[i].thread, NULL);
+		read += r[i].entries;
+	}
+
+	*read_rate = nr_readers ? read / nr_readers / (start / 1e6) : 0;
+	return entries / (start / 1e6);
+}
+
+static int next_nr(int nr, int max)
+{
+	if (nr == max)
+		return 0;
+	return nr * 2 < max ? nr * 2 : max;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options] [device]\n"
+		"options:\n"
+		"  -t secs     time per measurement (default 5)\n"
+		"  -j threads  highest number of writers (default online cpus)\n"
+		"  -r readers  readers draining the log meanwhile (default 1)\n"
+		"  -s bytes    message size per entry (default 100)\n"
+		"device defaults to %s\n",
+		argv0, dev_path);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, secs = 5, max_threads, nr_readers = 1, nr;
+	double rate, read_rate;
+
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "t:j:r:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 'j':
+			max_threads = atoi(optarg);
+			break;
+		case 'r':
+			nr_readers = atoi(optarg);
+			break;
+		case 's':
+			msg_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind > 1 || secs <= 0 || max_threads < 1 ||
+	    max_threads > MAX_THREADS || nr_readers < 0 ||
+	    nr_readers > MAX_THREADS || msg_size < 1 ||
+	    msg_size > LOGGER_ENTRY_MAX_PAYLOAD - 16)
+		usage(argv[0]);
+	if (optind < argc)
+		dev_path = argv[optind];
+
+	printf("# %s, %zu byte messages, %d readers, %d s per run\n",
+	       dev_path, msg_size, nr_readers, secs);
+	printf("%-8s %14s %14s %14s\n", "writers", "entries/s",
+	       "per writer", "read/s/reader");
+	/* 1, 2, 4, ... writers, ending with max_threads */
+	for (nr = 1; nr; nr = next_nr(nr, max_threads)) {
+		rate = run(nr, nr_readers, secs, &read_rate);
+		printf("%-8d %14.0f %14.0f %14.0f\n", nr, rate, rate / nr,
+		       read_rate);
+		fflush(stdout);
+	}
+
+	return 0;
+}
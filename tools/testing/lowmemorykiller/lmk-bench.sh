@@ -0,0 +1,85 @@
+#!/bin/sh
+#
+# Measure the time the lowmemorykiller shrinker takes to look for a
+# victim as the number of processes grows. For each count, that many
+# sleeping processes are running with oom_adj spread over 0..14. The
+# killer is set to consider oom_adj 15 at any amount of free memory,
+# and the shrinkers are run through drop_caches. No test process has
+# oom_adj 15, so every call searches and kills nothing, and
+# /proc/reclaimstat gives the time per call.
+#
+# ANY OTHER PROCESS AT OOM_ADJ 15 IS KILLED, such as cached Android
+# apps. Run this on a test system.
+#
+# Environment:
+#   COUNTS  process counts to measure (default 100 200 400 800 1600)
+#   ROUNDS  drop_caches runs per count (default 20)
+#
+
+COUNTS=${COUNTS:-"100 200 400 800 1600"}
+ROUNDS=${ROUNDS:-20}
+PARAM=/sys/module/lowmemorykiller/parameters
+# lowmem_shrink() is called with the default shrink_slab() batch
+BATCH=128
+
+if [ ! -w $PARAM/minfree ] || [ ! -w /proc/reclaimstat ]; then
+	echo "needs root, the lowmemorykiller and /proc/reclaimstat" >&2
+	exit 1
+fi
+
+OLD_ADJ=$(cat $PARAM/adj)
+OLD_MINFREE=$(cat $PARAM/minfree)
+PIDS=
+
+restore() {
+	echo "$OLD_ADJ" > $PARAM/adj
+	echo "$OLD_MINFREE" > $PARAM/minfree
+}
+
+cleanup() {
+	restore
+	[ -n "$PIDS" ] && kill $PIDS 2>/dev/null
+	wait
+}
+trap 'cleanup; exit 1' INT TERM
+
+echo "# $ROUNDS drop_caches runs per count, times in usec"
+printf "%-10s %8s %10s %10s %10s\n" processes passes "avg/pass" \
+	"max/pass" "avg/call"
+n=0
+for count in $COUNTS; do
+	while [ $n -lt $count ]; do
+		sleep 1000000 &
+		echo $((n % 15)) > /proc/$!/oom_adj
+		PIDS="$PIDS $!"
+		n=$((n + 1))
+	done
+
+	echo 15 > $PARAM/adj
+	echo 2000000000 > $PARAM/minfree
+	echo reset > /proc/reclaimstat
+	i=0
+	while [ $i -lt $ROUNDS ]; do
+		echo 2 > /proc/sys/vm/drop_caches
+		i=$((i + 1))
+	done
+	restore
+
+	# "shrinker lowmem_shrink: count N avg Aus max Mus objects scanned S ..."
+	awk -v n=$count -v batch=$BATCH '/^shrinker lowmem_shrink/ {
+		for (i = 1; i < NF; i++) {
+			if ($i == "count") c = $(i + 1)
+			if ($i == "avg") a = $(i + 1)
+			if ($i == "max") m = $(i + 1)
+			if ($i == "scanned") s = $(i + 1)
+		}
+		sub(/us/, "", a)
+		sub(/us/, "", m)
+		calls = s / batch
+		printf "%-10d %8d %10d %10d %10.1f\n", n, c, a, m,
+			calls ? a * c / calls : 0
+	}' /proc/reclaimstat
+done
+
+cleanup
+exit 0
@@ -0,0 +1,17 @@
+#ifndef _LZO_TEST_UNALIGNED_H
+#define _LZO_TEST_UNALIGNED_H
+
+/* as linux/unaligned/packed_struct.h */
+#define get_unaligned(ptr)					\
+	(((const struct { __typeof__(*(ptr)) x; } __packed *)(ptr))->x)
+#define put_unaligned(val, ptr)					\
+	(((struct { __typeof__(*(ptr)) x; } __packed *)(ptr))->x = (val))
+
+static inline u16 get_unaligned_le16(const void *p)
+{
+	const unsigned char *b = p;
+
+	return b[0] | b[1] << 8;
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Just enough of the kernel environment to build lib/lzo in userspace.
+ */
+#ifndef _LZO_TEST_KERNEL_H
+#define _LZO_TEST_KERNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define __LITTLE_ENDIAN	1234
+#else
+#define __BIG_ENDIAN	4321
+#endif
+
+/* as select'ed by the architectures this runs on */
+#if defined(__i386__) || defined(__x86_64__) || defined(__aarch64__) || \
+	defined(__ARM_FEATURE_UNALIGNED)
+#define CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS 1
+#endif
+
+#define BITS_PER_LONG		(__SIZEOF_LONG__ * 8)
+
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+#define noinline		__attribute__((noinline))
+#undef __always_inline
+#define __always_inline		inline __attribute__((always_inline))
+#define __packed		__attribute__((packed))
+
+static inline unsigned long __ffs(unsigned long word)
+{
+	return __builtin_ctzl(word);
+}
+
+static inline unsigned long __fls(unsigned long word)
+{
+	return BITS_PER_LONG - 1 - __builtin_clzl(word);
+}
+
+#endif
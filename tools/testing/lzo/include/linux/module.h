@@ -0,0 +1,15 @@
+/*
+ * Module parameters become globals lzo_param_<variable> that lzo-test
+ * flips to switch between the implementations.
+ */
+#ifndef _LZO_TEST_MODULE_H
+#define _LZO_TEST_MODULE_H
+
+#define module_param_named(name, value, type, perm) \
+	type *const lzo_param_##value = &value
+#define MODULE_PARM_DESC(name, desc)
+#define MODULE_LICENSE(license)
+#define MODULE_DESCRIPTION(desc)
+#define EXPORT_SYMBOL_GPL(sym)
+
+#endif
@@ -0,0 +1,553 @@
+/*
+ * lzo-test.c -- check the word-at-a-time LZO1X paths against the
+ *               byte-wise ones and measure both
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * lib/lzo is built unchanged against the headers in include/ and linked
+ * in; its module parameters select the implementation. See README.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../../include/linux/lzo.h"
+
+extern bool *const lzo_param_lzo1x_fast_compress;
+extern bool *const lzo_param_lzo1x_fast_decompress;
+
+#define GUARD		64
+#define GUARD_BYTE	0xa5
+
+struct corpus {
+	const char *name;
+	size_t size;
+	void (*fill)(unsigned char *buf, size_t size);
+};
+
+static uint32_t seed;
+
+/* xorshift32, so that the corpus is the same everywhere */
+static uint32_t rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static void fill_zero(unsigned char *buf, size_t size)
+{
+	memset(buf, 0, size);
+}
+
+static void fill_random(unsigned char *buf, size_t size)
+{
+	while (size--)
+		*buf++ = rnd();
+}
+
+static void fill_text(unsigned char *buf, size_t size)
+{
+	static const char * const words[] = {
+		"the", "of", "and", "to", "in", "is", "page", "memory",
+		"swap", "kernel", "compress", "a", "that", "for", "with",
+		"zone", "reclaim", "cache", "on", "be", "it", "as", "block",
+		"device", "this", "struct", "return", "if", "not", "are",
+	};
+	size_t col = 0;
+
+	while (size) {
+		const char *w = words[rnd() % (sizeof(words) / sizeof(*words))];
+		size_t len = strlen(w);
+
+		if (len + 1 > size)
+			len = size - 1;
+		memcpy(buf, w, len);
+		buf += len;
+		size -= len;
+		col += len + 1;
+		if (!size)
+			break;
+		*buf++ = col > 72 ? '\n' : ' ';
+		if (col > 72)
+			col = 0;
+		size--;
+	}
+}
+
+/* 64-byte objects as a slab page would hold them: pointers, counters, pad */
+static void fill_heap(unsigned char *buf, size_t size)
+{
+	uint32_t obj[16];
+	size_t i, len;
+
+	while (size) {
+		memset(obj, 0, sizeof(obj));
+		obj[0] = 0xc0000000 | (rnd() & 0x0ffffff0);
+		obj[1] = 0xc0000000 | (rnd() & 0x0ffffff0);
+		obj[2] = rnd() % 100;
+		obj[3] = 1;
+		for (i = 4; i < 8; i++)
+			obj[i] = rnd() % 4 ? 0 : rnd();
+		len = size < sizeof(obj) ? size : sizeof(obj);
+		memcpy(buf, obj, len);
+		buf += len;
+		size -= len;
+	}
+}
+
+/* long runs repeated with small changes, for long matches */
+static void fill_repeat(unsigned char *buf, size_t size)
+{
+	unsigned char block[300];
+	size_t len;
+
+	fill_random(block, sizeof(block));
+	while (size) {
+		block[rnd() % sizeof(block)] = rnd();
+		len = size < sizeof(block) ? size : sizeof(block);
+		memcpy(buf, block, len);
+		buf += len;
+		size -= len;
+	}
+}
+
+/* mostly zero with a few scattered bytes, like a freshly touched page */
+static void fill_sparse(unsigned char *buf, size_t size)
+{
+	size_t i;
+
+	memset(buf, 0, size);
+	for (i = rnd() % 128; i < size; i += 1 + rnd() % 256)
+		buf[i] = rnd();
+}
+
+/* each of the above in turn, in pages */
+static void fill_mixed(unsigned char *buf, size_t size)
+{
+	static void (* const fills[])(unsigned char *, size_t) = {
+		fill_text, fill_heap, fill_zero, fill_repeat, fill_random,
+		fill_sparse,
+	};
+	size_t i, len;
+
+	for (i = 0; size; i++) {
+		len = size < 4096 ? size : 4096;
+		fills[i % 6](buf, len);
+		buf += len;
+		size -= len;
+	}
+}
+
+static const struct corpus corpus[] = {
+	{ "empty",	0,		fill_zero },
+	{ "byte",	1,		fill_random },
+	{ "short",	13,		fill_text },
+	{ "short+1",	14,		fill_text },
+	{ "short+3",	16,		fill_repeat },
+	{ "text-100",	100,		fill_text },
+	{ "zero-4k",	4096,		fill_zero },
+	{ "random-4k",	4096,		fill_random },
+	{ "text-4k",	4096,		fill_text },
+	{ "heap-4k",	4096,		fill_heap },
+	{ "repeat-4k",	4096,		fill_repeat },
+	{ "sparse-4k",	4096,		fill_sparse },
+	{ "text-4097",	4097,		fill_text },
+	{ "heap-65k",	65535,		fill_heap },
+	{ "repeat-128k", 131072,	fill_repeat },
+	{ "text-1m",	1 << 20,	fill_text },
+	{ "mixed-1m",	1 << 20,	fill_mixed },
+};
+
+#define NR_CORPUS	(sizeof(corpus) / sizeof(*corpus))
+
+struct sample {
+	unsigned char *in;
+	size_t len;
+};
+
+static struct sample samples[NR_CORPUS];
+static void *wrkmem;
+static int failures;
+
+static void fail(const struct corpus *c, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void fail(const struct corpus *c, const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("FAIL %s: ", c->name);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	putchar('\n');
+	failures++;
+}
+
+static uint32_t crc32(const unsigned char *p, size_t len)
+{
+	uint32_t crc = ~0u;
+	int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = crc >> 1 ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+
+	if (!p) {
+		perror("malloc");
+		exit(2);
+	}
+	return p;
+}
+
+static void build_corpus(void)
+{
+	size_t i;
+
+	seed = 2463534242u;
+	for (i = 0; i < NR_CORPUS; i++) {
+		samples[i].in = xmalloc(corpus[i].size);
+		samples[i].len = corpus[i].size;
+		corpus[i].fill(samples[i].in, corpus[i].size);
+	}
+}
+
+static unsigned char *compress(const struct sample *s, bool fast,
+			       size_t *out_len)
+{
+	unsigned char *out = xmalloc(lzo1x_worst_compress(s->len) + GUARD);
+	size_t i;
+
+	memset(out, GUARD_BYTE, lzo1x_worst_compress(s->len) + GUARD);
+	/* stale dictionary entries into the same buffer change the stream */
+	memset(wrkmem, 0, LZO1X_1_MEM_COMPRESS);
+	*lzo_param_lzo1x_fast_compress = fast;
+	lzo1x_1_compress(s->in, s->len, out, out_len, wrkmem);
+	for (i = *out_len; i < lzo1x_worst_compress(s->len) + GUARD; i++)
+		if (out[i] != GUARD_BYTE) {
+			*out_len = i;
+			free(out);
+			return NULL;
+		}
+	return out;
+}
+
+/*
+ * Decompresses into a buffer of exactly out_size bytes followed by a
+ * guard, and returns the error code. *out_len is set to what was
+ * written, or to -1 if anything beyond out_size was.
+ */
+static int decompress(const unsigned char *in, size_t in_len, bool fast,
+		      unsigned char *out, size_t out_size, size_t *out_len)
+{
+	size_t i;
+	int ret;
+
+	memset(out, GUARD_BYTE, out_size + GUARD);
+	*lzo_param_lzo1x_fast_decompress = fast;
+	*out_len = out_size;
+	ret = lzo1x_decompress_safe(in, in_len, out, out_len);
+	for (i = out_size; i < out_size + GUARD; i++)
+		if (out[i] != GUARD_BYTE)
+			*out_len = -1;
+	return ret;
+}
+
+static void check_decompress(const struct corpus *c, const struct sample *s,
+			     const unsigned char *comp, size_t comp_len)
+{
+	unsigned char *a = xmalloc(s->len + GUARD), *b = xmalloc(s->len + GUARD);
+	size_t a_len, b_len, cut;
+	int fast, ra, rb;
+
+	for (fast = 0; fast < 2; fast++) {
+		ra = decompress(comp, comp_len, fast, a, s->len, &a_len);
+		if (ra != LZO_E_OK || a_len != s->len ||
+		    memcmp(a, s->in, s->len))
+			fail(c, "%s decompress: error %d, %zd of %zu bytes",
+			     fast ? "fast" : "byte-wise", ra, (ssize_t)a_len,
+			     s->len);
+	}
+
+	/*
+	 * Truncated input and a short output buffer must fail the same
+	 * way on both paths, without writing past the end.
+	 */
+	for (cut = 0; cut < comp_len; cut += 1 + cut / 16) {
+		ra = decompress(comp, cut, false, a, s->len, &a_len);
+		rb = decompress(comp, cut, true, b, s->len, &b_len);
+		if (ra != rb || a_len != b_len || a_len == (size_t)-1 ||
+		    memcmp(a, b, a_len == (size_t)-1 ? 0 : a_len))
+			fail(c, "input cut at %zu: %d/%zd vs %d/%zd", cut,
+			     ra, (ssize_t)a_len, rb, (ssize_t)b_len);
+	}
+	for (cut = 0; cut < s->len; cut += 1 + cut / 16) {
+		ra = decompress(comp, comp_len, false, a, cut, &a_len);
+		rb = decompress(comp, comp_len, true, b, cut, &b_len);
+		if (ra != rb || a_len != b_len || a_len == (size_t)-1 ||
+		    memcmp(a, b, a_len == (size_t)-1 ? 0 : a_len))
+			fail(c, "output cut at %zu: %d/%zd vs %d/%zd", cut,
+			     ra, (ssize_t)a_len, rb, (ssize_t)b_len);
+	}
+
+	free(a);
+	free(b);
+}
+
+static int load_vectors(const char *path, uint32_t *crcs, size_t *lens)
+{
+	char line[256], name[64];
+	unsigned long len, comp_len;
+	unsigned int crc, comp_crc;
+	FILE *f;
+	size_t i;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%63s %lu %x %lu %x", name, &len, &crc,
+			   &comp_len, &comp_crc) != 5) {
+			fprintf(stderr, "%s: bad line: %s", path, line);
+			fclose(f);
+			return -1;
+		}
+		for (i = 0; i < NR_CORPUS; i++)
+			if (!strcmp(corpus[i].name, name))
+				break;
+		if (i == NR_CORPUS)
+			continue;
+		if (len != samples[i].len ||
+		    crc != crc32(samples[i].in, samples[i].len)) {
+			fprintf(stderr, "%s: %s: corpus differs from the one the vectors were made from\n",
+				path, name);
+			fclose(f);
+			return -1;
+		}
+		lens[i] = comp_len;
+		crcs[i] = comp_crc;
+	}
+	fclose(f);
+	return 0;
+}
+
+static void gen_vectors(void)
+{
+	unsigned char *out;
+	size_t i, out_len;
+
+	printf("# lzo-test -g: streams of the byte-wise compressor\n"
+	       "# name size crc32 compressed-size compressed-crc32\n");
+	for (i = 0; i < NR_CORPUS; i++) {
+		out = compress(&samples[i], false, &out_len);
+		if (!out) {
+			fprintf(stderr, "%s: compressor overran its buffer\n",
+				corpus[i].name);
+			exit(1);
+		}
+		printf("%-12s %8zu %08x %8zu %08x\n", corpus[i].name,
+		       samples[i].len, crc32(samples[i].in, samples[i].len),
+		       out_len, crc32(out, out_len));
+		free(out);
+	}
+}
+
+static void run_tests(const char *vectors)
+{
+	uint32_t crcs[NR_CORPUS];
+	size_t lens[NR_CORPUS];
+	unsigned char *a, *b;
+	size_t i, a_len, b_len;
+
+	for (i = 0; i < NR_CORPUS; i++)
+		lens[i] = -1;
+	if (vectors && load_vectors(vectors, crcs, lens))
+		exit(2);
+
+	for (i = 0; i < NR_CORPUS; i++) {
+		const struct corpus *c = &corpus[i];
+
+		a = compress(&samples[i], false, &a_len);
+		b = compress(&samples[i], true, &b_len);
+		if (!a || !b) {
+			fail(c, "%s compressor wrote past its output",
+			     a ? "fast" : "byte-wise");
+		} else if (a_len != b_len || memcmp(a, b, a_len)) {
+			fail(c, "streams differ: %zu vs %zu bytes", a_len,
+			     b_len);
+		} else if (lens[i] != (size_t)-1 &&
+			   (lens[i] != a_len || crcs[i] != crc32(a, a_len))) {
+			fail(c, "stream does not match the vector");
+		} else {
+			check_decompress(c, &samples[i], a, a_len);
+		}
+		if (vectors && lens[i] == (size_t)-1)
+			printf("note: no vector for %s\n", c->name);
+		free(a);
+		free(b);
+	}
+	printf("%zu samples, %d failures\n", NR_CORPUS, failures);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Runs the sample through op for at least secs and returns MB/s of
+ * uncompressed data. Large samples are processed in 4k pages, which is
+ * how zram and the swap path use LZO.
+ */
+static double bench_one(const struct sample *s, bool comp, bool fast,
+			const unsigned char *c, const size_t *c_lens,
+			double secs)
+{
+	size_t pages = s->len > 4096 ? s->len / 4096 : 1;
+	size_t page = s->len > 4096 ? 4096 : s->len;
+	unsigned char *out = xmalloc(lzo1x_worst_compress(page));
+	unsigned long iter = 0;
+	double start, t;
+	size_t p, len;
+
+	*lzo_param_lzo1x_fast_compress = fast;
+	*lzo_param_lzo1x_fast_decompress = fast;
+	start = now();
+	do {
+		const unsigned char *ci = c;
+
+		for (p = 0; p < pages; p++) {
+			if (comp) {
+				lzo1x_1_compress(s->in + p * page, page, out,
+						 &len, wrkmem);
+			} else {
+				len = page;
+				lzo1x_decompress_safe(ci, c_lens[p], out,
+						      &len);
+				ci += c_lens[p];
+			}
+		}
+		iter++;
+		t = now() - start;
+	} while (t < secs);
+
+	free(out);
+	return (double)iter * pages * page / t / 1e6;
+}
+
+static void run_bench(double secs)
+{
+	size_t i, p, pages, page, len;
+	unsigned char *c;
+	size_t *c_lens;
+
+	printf("%-12s %7s %10s %10s %6s %10s %10s %6s\n", "sample", "ratio",
+	       "comp", "comp-fast", "", "decomp", "dec-fast", "");
+	for (i = 0; i < NR_CORPUS; i++) {
+		const struct sample *s = &samples[i];
+		double r[4];
+		size_t total = 0;
+
+		if (s->len < 4096)
+			continue;
+		pages = s->len / 4096;
+		page = 4096;
+		c = xmalloc(pages * lzo1x_worst_compress(page));
+		c_lens = xmalloc(pages * sizeof(*c_lens));
+		*lzo_param_lzo1x_fast_compress = false;
+		for (p = 0; p < pages; p++) {
+			lzo1x_1_compress(s->in + p * page, page, c + total,
+					 &len, wrkmem);
+			c_lens[p] = len;
+			total += len;
+		}
+
+		r[0] = bench_one(s, true, false, c, c_lens, secs);
+		r[1] = bench_one(s, true, true, c, c_lens, secs);
+		r[2] = bench_one(s, false, false, c, c_lens, secs);
+		r[3] = bench_one(s, false, true, c, c_lens, secs);
+		printf("%-12s %6.1f%% %10.1f %10.1f %+5.0f%% %10.1f %10.1f %+5.0f%%\n",
+		       corpus[i].name, 100.0 * total / (pages * page),
+		       r[0], r[1], 100 * (r[1] / r[0] - 1),
+		       r[2], r[3], 100 * (r[3] / r[2] - 1));
+		free(c);
+		free(c_lens);
+	}
+	printf("MB/s of uncompressed data, in 4k pages\n");
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-g] [-b] [-t secs] [vectors]\n"
+		"  -g       print vectors from the byte-wise compressor\n"
+		"  -b       benchmark after testing\n"
+		"  -t secs  time per benchmark run (default 0.5)\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	bool gen = false, bench = false;
+	double secs = 0.5;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "gbt:")) != -1) {
+		switch (opt) {
+		case 'g':
+			gen = true;
+			break;
+		case 'b':
+			bench = true;
+			break;
+		case 't':
+			secs = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc - 1)
+		usage(argv[0]);
+
+	wrkmem = xmalloc(LZO1X_1_MEM_COMPRESS);
+	build_corpus();
+
+	if (gen) {
+		gen_vectors();
+		return 0;
+	}
+
+	run_tests(optind < argc ? argv[optind] : NULL);
+	if (bench && !failures)
+		run_bench(secs);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,456 @@
+/*
+ * zram-bench.c -- measure zram write and read throughput against the
+ *                 number of concurrent threads
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The device is used raw and its contents are destroyed. See README.
+ */
+
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o zram-bench zram-bench.c -lpthread */
+
+#define _GNU_SOURCE /* for O_DIRECT */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/fs.h>
+
+#define PAGE_SZ		4096
+#define MAX_THREADS	64
+
+/******************** Little Helpers ********************/
+
+static void die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "zram-bench: ");
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	if (errno)
+		fprintf(stderr, ": %s", strerror(errno));
+	fputc('\n', stderr);
+	exit(1);
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static FILE *open_attr(const char *dev, const char *attr, const char *mode)
+{
+	const char *name = strrchr(dev, '/');
+	char path[256];
+
+	snprintf(path, sizeof(path), "/sys/block/%s/%s",
+		 name ? name + 1 : dev, attr);
+	return fopen(path, mode);
+}
+
+/* Prints /sys/block/<dev>/<attr>, if there is one, for the log */
+static void show_attr(const char *dev, const char *attr)
+{
+	char val[256];
+	FILE *f;
+
+	f = open_attr(dev, attr, "r");
+	if (!f)
+		return;
+	if (fgets(val, sizeof(val), f))
+		printf("# %s: %s", attr, val);
+	fclose(f);
+}
+
+static uint64_t read_attr(const char *dev, const char *attr)
+{
+	unsigned long long val;
+	FILE *f;
+
+	f = open_attr(dev, attr, "r");
+	if (!f || fscanf(f, "%llu", &val) != 1)
+		die("reading %s", attr);
+	fclose(f);
+	return val;
+}
+
+static void write_attr(const char *dev, const char *attr, const char *val)
+{
+	FILE *f;
+
+	f = open_attr(dev, attr, "w");
+	if (!f)
+		die("opening %s", attr);
+	if (fputs(val, f) < 0 || fclose(f))
+		die("writing %s to %s", val, attr);
+}
+
+/******************** Page Contents ********************/
+
+/*
+ * The reference corpus: pages of the kinds tools/testing/lzo tests
+ * with, text, slab-like objects, long runs repeated with small changes,
+ * random data and sparse pages, in turn by page number. Each page comes
+ * from a fixed pseudo random sequence seeded by its number and the pass
+ * over the device, so every host and every backend compresses the same
+ * data. Zero pages are left out, zram stores them without compressing.
+ * The page number and pass also go into the first bytes, so that zram
+ * never finds two pages the same and dedup stays out of the figures.
+ */
+
+/* xorshift32, so that the corpus is the same everywhere */
+static uint32_t rnd(uint32_t *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return *seed;
+}
+
+static void fill_random(unsigned char *p, uint32_t *seed)
+{
+	unsigned i;
+
+	for (i = 0; i < PAGE_SZ; i++)
+		p[i] = rnd(seed);
+}
+
+static void fill_text(unsigned char *p, uint32_t *seed)
+{
+	static const char * const words[] = {
+		"the", "of", "and", "to", "in", "is", "page", "memory",
+		"swap", "kernel", "compress", "a", "that", "for", "with",
+		"zone", "reclaim", "cache", "on", "be", "it", "as", "block",
+		"device", "this", "struct", "return", "if", "not", "are",
+	};
+	size_t size = PAGE_SZ, col = 0;
+
+	while (size) {
+		const char *w = words[rnd(seed) % (sizeof(words) /
+						   sizeof(*words))];
+		size_t len = strlen(w);
+
+		if (len + 1 > size)
+			len = size - 1;
+		memcpy(p, w, len);
+		p += len;
+		size -= len;
+		col += len + 1;
+		if (!size)
+			break;
+		*p++ = col > 72 ? '\n' : ' ';
+		if (col > 72)
+			col = 0;
+		size--;
+	}
+}
+
+/* 64-byte objects as a slab page would hold them: pointers, counters, pad */
+static void fill_heap(unsigned char *p, uint32_t *seed)
+{
+	uint32_t obj[16];
+	unsigned i, off;
+
+	for (off = 0; off < PAGE_SZ; off += sizeof(obj)) {
+		memset(obj, 0, sizeof(obj));
+		obj[0] = 0xc0000000 | (rnd(seed) & 0x0ffffff0);
+		obj[1] = 0xc0000000 | (rnd(seed) & 0x0ffffff0);
+		obj[2] = rnd(seed) % 100;
+		obj[3] = 1;
+		for (i = 4; i < 8; i++)
+			obj[i] = rnd(seed) % 4 ? 0 : rnd(seed);
+		memcpy(p + off, obj, sizeof(obj));
+	}
+}
+
+/* long runs repeated with small changes, for long matches */
+static void fill_repeat(unsigned char *p, uint32_t *seed)
+{
+	unsigned char block[300];
+	unsigned i, off, len;
+
+	for (i = 0; i < sizeof(block); i++)
+		block[i] = rnd(seed);
+	for (off = 0; off < PAGE_SZ; off += len) {
+		block[rnd(seed) % sizeof(block)] = rnd(seed);
+		len = PAGE_SZ - off < sizeof(block) ? PAGE_SZ - off :
+			sizeof(block);
+		memcpy(p + off, block, len);
+	}
+}
+
+/* mostly zero with a few scattered bytes, like a freshly touched page */
+static void fill_sparse(unsigned char *p, uint32_t *seed)
+{
+	unsigned i;
+
+	memset(p, 0, PAGE_SZ);
+	for (i = rnd(seed) % 128; i < PAGE_SZ; i += 1 + rnd(seed) % 256)
+		p[i] = rnd(seed);
+}
+
+static void fill_page(unsigned char *p, uint64_t page, unsigned pass)
+{
+	static void (* const fills[])(unsigned char *, uint32_t *) = {
+		fill_text, fill_heap, fill_repeat, fill_random, fill_sparse,
+	};
+	uint32_t seed = (uint32_t)(page * 2654435761u) ^ (pass << 24) ^
+			0x5a5a5a5a;
+
+	if (!seed)
+		seed = 1;
+	fills[page % 5](p, &seed);
+	memcpy(p, &page, sizeof(page));
+	memcpy(p + sizeof(page), &pass, sizeof(pass));
+}
+
+/******************** Workers ********************/
+
+enum mode { MODE_WRITE, MODE_READ };
+
+static const char *dev_path;
+static uint64_t dev_pages;
+static volatile int start_flag;
+static uint64_t deadline_us;
+
+struct worker {
+	pthread_t thread;
+	enum mode mode;
+	uint64_t first, nr;	/* slice of the device, in pages */
+	uint64_t bytes;
+};
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned char *buf;
+	uint64_t page = 0;
+	unsigned pass = 0;
+	int fd;
+
+	if (posix_memalign((void **)&buf, PAGE_SZ, PAGE_SZ))
+		die("posix_memalign");
+	fd = open(dev_path, (w->mode == MODE_WRITE ? O_WRONLY : O_RDONLY) |
+		  O_DIRECT);
+	if (fd < 0)
+		die("%s", dev_path);
+
+	while (!start_flag)
+		;
+
+	while (now_us() < deadline_us) {
+		off_t off = (w->first + page) * PAGE_SZ;
+		ssize_t ret;
+
+		if (w->mode == MODE_WRITE) {
+			fill_page(buf, w->first + page, pass);
+			ret = pwrite(fd, buf, PAGE_SZ, off);
+		} else {
+			ret = pread(fd, buf, PAGE_SZ, off);
+		}
+		if (ret != PAGE_SZ)
+			die("%s at %jd", w->mode == MODE_WRITE ? "write" :
+			    "read", (intmax_t)off);
+		w->bytes += PAGE_SZ;
+		if (++page == w->nr) {
+			page = 0;
+			pass++;
+		}
+	}
+
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+/* Runs nr threads on disjoint slices for secs and returns MB/s */
+static double run(enum mode mode, int nr, int secs)
+{
+	struct worker w[MAX_THREADS];
+	uint64_t bytes = 0, start;
+	int i;
+
+	memset(w, 0, sizeof(w));
+	start_flag = 0;
+	for (i = 0; i < nr; i++) {
+		w[i].mode = mode;
+		w[i].nr = dev_pages / nr;
+		w[i].first = i * w[i].nr;
+		if (pthread_create(&w[i].thread, NULL, worker_fn, &w[i]))
+			die("pthread_create");
+	}
+
+	start = now_us();
+	deadline_us = start + secs * 1000000ULL;
+	__sync_synchronize();
+	start_flag = 1;
+	for (i = 0; i < nr; i++) {
+		pthread_join(w[i].thread, NULL);
+		bytes += w[i].bytes;
+	}
+
+	return bytes / ((now_us() - start) / 1e6) / (1024 * 1024);
+}
+
+/*
+ * Writes every page once, so that reads find compressed data and the
+ * device holds the whole corpus when the ratio is taken
+ */
+static void prefill(void)
+{
+	unsigned char *buf;
+	uint64_t page;
+	int fd;
+
+	fd = open(dev_path, O_WRONLY | O_DIRECT);
+	if (fd < 0)
+		die("%s", dev_path);
+	if (posix_memalign((void **)&buf, PAGE_SZ, PAGE_SZ))
+		die("posix_memalign");
+	for (page = 0; page < dev_pages; page++) {
+		fill_page(buf, page, 0);
+		if (pwrite(fd, buf, PAGE_SZ, page * PAGE_SZ) != PAGE_SZ)
+			die("write at %" PRIu64, page * PAGE_SZ);
+	}
+	free(buf);
+	close(fd);
+}
+
+/* Resets the device and brings it back with the given backend */
+static void set_backend(const char *alg, const char *disksize)
+{
+	write_attr(dev_path, "reset", "1");
+	write_attr(dev_path, "comp_algorithm", alg);
+	write_attr(dev_path, "disksize", disksize);
+}
+
+static int next_nr(int nr, int max)
+{
+	if (nr == max)
+		return 0;
+	return nr * 2 < max ? nr * 2 : max;
+}
+
+static void bench(int max_threads, int secs, int reads)
+{
+	uint64_t orig, compr, used;
+	int nr;
+
+	show_attr(dev_path, "comp_algorithm");
+	show_attr(dev_path, "max_comp_streams");
+
+	prefill();
+	orig = read_attr(dev_path, "orig_data_size");
+	compr = read_attr(dev_path, "compr_data_size");
+	used = read_attr(dev_path, "mem_used_total");
+	printf("# corpus: %.1f MB, compressed %.1f MB, ratio %.2f, "
+	       "memory used %.1f MB\n", orig / 1048576.0, compr / 1048576.0,
+	       compr ? (double)orig / compr : 0, used / 1048576.0);
+
+	printf("%-8s %12s%s\n", "threads", "write MB/s",
+	       reads ? "    read MB/s" : "");
+	/* 1, 2, 4, ... threads, ending with max_threads */
+	for (nr = 1; nr; nr = next_nr(nr, max_threads)) {
+		printf("%-8d %12.1f", nr, run(MODE_WRITE, nr, secs));
+		if (reads)
+			printf(" %12.1f", run(MODE_READ, nr, secs));
+		putchar('\n');
+		fflush(stdout);
+	}
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options] <device>\n"
+		"options:\n"
+		"  -t secs     time per measurement (default 5)\n"
+		"  -j threads  highest thread count (default online cpus)\n"
+		"  -m mb       MB of the device to use (default all)\n"
+		"  -r          measure reads as well as writes\n"
+		"  -a algs     comma separated backends to compare; the device\n"
+		"              is reset and re-created with each in turn\n",
+		argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, secs = 5, max_threads, reads = 0;
+	uint64_t size, limit = 0;
+	char *algs = NULL, *alg, disksize[32];
+	int fd;
+
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "t:j:m:ra:")) != -1) {
+		switch (opt) {
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 'j':
+			max_threads = atoi(optarg);
+			break;
+		case 'm':
+			limit = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'r':
+			reads = 1;
+			break;
+		case 'a':
+			algs = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || secs <= 0 || max_threads < 1 ||
+	    max_threads > MAX_THREADS)
+		usage(argv[0]);
+	dev_path = argv[optind];
+
+	fd = open(dev_path, O_RDONLY);
+	if (fd < 0)
+		die("%s", dev_path);
+	if (ioctl(fd, BLKGETSIZE64, &size))
+		die("BLKGETSIZE64");
+	close(fd);
+	snprintf(disksize, sizeof(disksize), "%" PRIu64, size);
+	if (limit && limit < size)
+		size = limit;
+	dev_pages = size / PAGE_SZ;
+	if (dev_pages < (uint64_t)max_threads)
+		die("%s is too small", dev_path);
+
+	printf("# %" PRIu64 " pages, %d s per run\n", dev_pages, secs);
+
+	if (!algs) {
+		bench(max_threads, secs, reads);
+		return 0;
+	}
+
+	for (alg = strtok(algs, ","); alg; alg = strtok(NULL, ",")) {
+		set_backend(alg, disksize);
+		putchar('\n');
+		bench(max_threads, secs, reads);
+	}
+
+	return 0;
+}